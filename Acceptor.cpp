@@ -2,6 +2,7 @@
 
 #include "EventLoop.h"
 #include "InetAddress.h"
+#include "base/Logging.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -12,12 +13,15 @@ namespace mutty{
     : loop_(loop),
       acceptSocket_(Socket::createNonblockingOrDie(listenAddr.family())),
       acceptChannel_(loop, acceptSocket_.fd()),
-      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+      listening_(false),
+      paused_(false)
   {
     assert(idleFd_ >= 0);
     acceptSocket_.setReuseAddr(true);
     acceptSocket_.setReusePort(reuseport);
     acceptSocket_.bindAddress(listenAddr);
+    acceptChannel_.setKind(Channel::kAcceptor);
     acceptChannel_.setReadCallback(
         std::bind(&Acceptor::handleRead, this));
   }
@@ -32,8 +36,38 @@ namespace mutty{
   void Acceptor::listen()
   {
     loop_->assertInLoopThread();
+    listening_ = true;
     acceptSocket_.listen();
-    acceptChannel_.enableReading();
+    if (!paused_)
+    {
+      acceptChannel_.enableReading();
+    }
+  }
+
+  void Acceptor::pause()
+  {
+    loop_->assertInLoopThread();
+    if (!paused_)
+    {
+      paused_ = true;
+      if (listening_)
+      {
+        acceptChannel_.disableReading();
+      }
+    }
+  }
+
+  void Acceptor::resume()
+  {
+    loop_->assertInLoopThread();
+    if (paused_)
+    {
+      paused_ = false;
+      if (listening_)
+      {
+        acceptChannel_.enableReading();
+      }
+    }
   }
 
   void Acceptor::handleRead()
@@ -44,8 +78,7 @@ namespace mutty{
     int connfd = acceptSocket_.accept(&peerAddr);
     if (connfd >= 0)
     {
-      // string hostport = peerAddr.toIpPort();
-      // LOG_TRACE << "Accepts of " << hostport;
+      LOG_TRACE << "Accepts of " << peerAddr.toIpPort();
       if (newConnectionCallback_)
       {
         newConnectionCallback_(connfd, peerAddr);
@@ -54,14 +87,13 @@ namespace mutty{
       {
         if (::close(connfd) < 0)
         {
-          std::cerr << "Socket closed failed";
-          exit(1);
+          LOG_SYSFATAL << "Socket closed failed";
         }
       }
     }
     else
     {
-      // LOG_SYSERR << "in Acceptor::handleRead";
+      LOG_SYSERR << "in Acceptor::handleRead";
       // Read the section named "The special problem of
       // accept()ing when you can't" in libev's doc.
       // By Marc Lehmann, author of libev.
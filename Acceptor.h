@@ -23,6 +23,12 @@ namespace mutty {
     { newConnectionCallback_ = cb; }
 
     void listen();
+    bool listening() const { return listening_; }
+
+    /// 暂停accept：不再关注监听socket的可读事件，新连接留在内核的backlog里
+    void pause();
+    void resume();
+    bool paused() const { return paused_; }
 
   private:
     void handleRead();
@@ -32,6 +38,8 @@ namespace mutty {
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
     int idleFd_;
+    bool listening_;
+    bool paused_;
   };
 
 }  // namespace mutty
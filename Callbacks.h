@@ -2,6 +2,7 @@
 #define MUTTY_CALLBACKS_H
 
 #include <functional>
+#include <memory>
 #include "buffer/Buffer.h"
 
 namespace mutty
@@ -14,10 +15,34 @@ class TcpConnection;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 
-using MessageCallback = std::function<void (const TcpConnectionPtr&, buffer::Buffer*)>;
+///
+/// 借用的连接句柄，只在同步执行的回调里有效(MessageCallback期间连接一定活着)，
+/// 拷贝和析构都不碰引用计数。要在回调返回后继续持有连接(放进容器、跨线程、
+/// queueInLoop)时用lock()换成TcpConnectionPtr。
+///
+/// 可以隐式转换成TcpConnectionPtr，参数是const TcpConnectionPtr&的旧回调照样能用，
+/// 只是每次调用多一次引用计数。
+class TcpConnectionRef
+{
+ public:
+  explicit TcpConnectionRef(TcpConnection* conn) : conn_(conn) {}
+
+  TcpConnection* get() const { return conn_; }
+  TcpConnection* operator->() const { return conn_; }
+  TcpConnection& operator*() const { return *conn_; }
+
+  /// 换成拥有所有权的指针，定义在TcpConnection.h
+  TcpConnectionPtr lock() const;
+  operator TcpConnectionPtr() const { return lock(); }
+
+ private:
+  TcpConnection* conn_;
+};
+
+using MessageCallback = std::function<void (const TcpConnectionRef&, buffer::Buffer*)>;
 using ConnectionCallback = std::function<void (const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void (const TcpConnectionPtr&)>;
-using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
+using WriteCompleteCallback = std::function<void (const TcpConnectionRef&)>;
 using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
 
 }  // namespace mutty
@@ -15,6 +15,7 @@ namespace mutty{
       events_(0),
       revents_(0),
       index_(-1),
+      kind_(kOther),
       tied_(false)
       // eventHandling_(false),
       // addedToLoop_(false)
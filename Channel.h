@@ -14,6 +14,19 @@ namespace mutty {
   public:
     using EventCallback = std::function<void()>;
 
+    /// 只用于EventLoopStats按类别统计handler耗时
+    enum Kind
+    {
+      kOther,
+      kWakeup,
+      kSignal,
+      kTimer,
+      kAcceptor,
+      kConnector,
+      kConnection,
+      kNumKinds,
+    };
+
     Channel(EventLoop* loop, int fd);
     // ~Channel();
 
@@ -57,6 +70,9 @@ namespace mutty {
         tied_ = true;
     }
 
+    Kind kind() const { return kind_; }
+    void setKind(Kind kind) { kind_ = kind; }
+
     int index() { return index_; }
     void set_index(int idx) { index_ = idx; }
 
@@ -73,6 +89,7 @@ namespace mutty {
     int        events_;
     int        revents_; // it's the received event types of epoll or poll
     int        index_; // used by Poller.
+    Kind       kind_;
     // bool eventHandling_;
     bool addedToLoop_{false};
     EventCallback readCallback_;
@@ -0,0 +1,292 @@
+#include "ComputePool.h"
+
+#include <assert.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/prctl.h>
+
+#include <functional>
+
+namespace mutty {
+
+  namespace
+  {
+  size_t roundUpPowerOfTwo(size_t n)
+  {
+    size_t size = 2;
+    while (size < n)
+      size <<= 1;
+    return size;
+  }
+
+  // 提交方各自轮转，不共享计数器
+  thread_local unsigned t_nextQueue = static_cast<unsigned>(
+      std::hash<std::thread::id>()(std::this_thread::get_id()));
+  // 工作线程自己提交的任务放进自己的队列
+  thread_local const ComputePool* t_pool = nullptr;
+  thread_local int t_index = -1;
+  }  // namespace
+
+  // Dmitry Vyukov的有界MPMC队列：每个槽位带序号，入队出队各一次CAS
+  class ComputePool::TaskQueue : noncopyable
+  {
+  public:
+    explicit TaskQueue(size_t capacity)
+      : cells_(new Cell[capacity]),
+        mask_(capacity - 1),
+        enqueuePos_(0),
+        dequeuePos_(0)
+    {
+      for (size_t i = 0; i < capacity; ++i)
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(Task& task)
+    {
+      size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        Cell& cell = cells_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+          if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            cell.task = std::move(task);
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (diff < 0)
+        {
+          return false;  // 满了
+        }
+        else
+        {
+          pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    bool pop(Task* task)
+    {
+      size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        Cell& cell = cells_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0)
+        {
+          if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            *task = std::move(cell.task);
+            cell.task = nullptr;
+            cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (diff < 0)
+        {
+          return false;  // 空的
+        }
+        else
+        {
+          pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    bool empty() const
+    {
+      return dequeuePos_.load(std::memory_order_relaxed) ==
+             enqueuePos_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Cell
+    {
+      std::atomic<size_t> sequence;
+      Task task;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    const size_t mask_;
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    alignas(64) std::atomic<size_t> dequeuePos_;
+  };
+
+  ComputePool::ComputePool(int numThreads, size_t queueCapacity,
+                           RejectPolicy policy, const std::string& name)
+    : numThreads_(numThreads),
+      queueCapacity_(roundUpPowerOfTwo(queueCapacity)),
+      policy_(policy),
+      name_(name),
+      running_(false),
+      sleepers_(0),
+      rejected_(0),
+      stolen_(0)
+  {
+    assert(numThreads > 0);
+    for (int i = 0; i < numThreads; ++i)
+      queues_.emplace_back(new TaskQueue(queueCapacity_));
+  }
+
+  ComputePool::~ComputePool()
+  {
+    stop();
+  }
+
+  void ComputePool::start()
+  {
+    assert(!running_);
+    running_ = true;
+    // 工作线程不处理信号
+    sigset_t all, old;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (int i = 0; i < numThreads_; ++i)
+      threads_.emplace_back(&ComputePool::threadFunc, this, i);
+    ::pthread_sigmask(SIG_SETMASK, &old, NULL);
+  }
+
+  void ComputePool::stop()
+  {
+    if (!running_.exchange(false))
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cond_.notify_all();
+    }
+    for (auto& thr : threads_)
+      thr.join();
+    threads_.clear();
+    // 工作线程退出前才放进队列的任务
+    runRemaining();
+  }
+
+  void ComputePool::runRemaining()
+  {
+    // 和submit()里放进队列之后的fence配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Task task;
+    for (const auto& q : queues_)
+    {
+      while (q->pop(&task))
+      {
+        task();
+        task = nullptr;
+      }
+    }
+  }
+
+  bool ComputePool::submit(Task task)
+  {
+    if (running_.load(std::memory_order_acquire))
+    {
+      unsigned start = t_pool == this ? static_cast<unsigned>(t_index) : t_nextQueue++;
+      for (int i = 0; i < numThreads_; ++i)
+      {
+        if (queues_[(start + i) % numThreads_]->push(task))
+        {
+          // 放进去之后再看一次running_：这里还是true，说明stop()还没置false，
+          // 它在join之后的runRemaining()一定能取到这个任务；已经是false时
+          // 工作线程可能都退出了，自己执行
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if (!running_.load(std::memory_order_relaxed))
+          {
+            runRemaining();
+            return true;
+          }
+          wakeup();
+          return true;
+        }
+      }
+    }
+
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    if (policy_ == kCallerRuns && running_.load(std::memory_order_relaxed))
+    {
+      task();
+      return true;
+    }
+    // 过载时每个都记日志只会更糟，看rejected()
+    return false;
+  }
+
+  void ComputePool::wakeup()
+  {
+    // 和threadFunc里的sleepers_++配对：要么工作线程睡前看到了任务，
+    // 要么这里看到了sleepers_ > 0
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) > 0)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cond_.notify_one();
+    }
+  }
+
+  bool ComputePool::tryTake(int index, Task* task)
+  {
+    if (queues_[index]->pop(task))
+      return true;
+    for (int i = 1; i < numThreads_; ++i)
+    {
+      if (queues_[(index + i) % numThreads_]->pop(task))
+      {
+        stolen_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ComputePool::hasTask() const
+  {
+    for (const auto& q : queues_)
+    {
+      if (!q->empty())
+        return true;
+    }
+    return false;
+  }
+
+  void ComputePool::threadFunc(int index)
+  {
+    std::string threadName = name_ + std::to_string(index);
+    ::prctl(PR_SET_NAME, threadName.c_str());
+    t_pool = this;
+    t_index = index;
+
+    Task task;
+    for (;;)
+    {
+      if (tryTake(index, &task))
+      {
+        task();
+        task = nullptr;
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      sleepers_.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!hasTask())
+      {
+        // stop()之后把剩下的任务做完再退出
+        if (!running_.load(std::memory_order_acquire))
+        {
+          sleepers_.fetch_sub(1, std::memory_order_relaxed);
+          break;
+        }
+        cond_.wait(lock);
+      }
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    t_pool = nullptr;
+    t_index = -1;
+  }
+
+}  // namespace mutty
@@ -0,0 +1,160 @@
+#ifndef MUTTY_COMPUTEPOOL_H
+#define MUTTY_COMPUTEPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "EventLoop.h"
+#include "base/noncopyable.h"
+
+namespace mutty {
+
+  ///
+  /// 给CPU密集的处理(压缩、模板渲染、加解密)用的计算线程池，不让它们阻塞EventLoop。
+  ///
+  /// 每个工作线程一个有界的无锁队列(Vyukov MPMC环形队列)，提交方轮流放进各个
+  /// 队列，工作线程先取自己的，空了再从别的队列偷。所有队列都满时按RejectPolicy
+  /// 处理。和timer的thread_pool::ThreadPool不同，没有全局的锁。
+  ///
+  /// 结果通过EventLoop::queueInLoop回到原来的loop线程：
+  ///
+  ///   conn->offload([body] { return gzip(body); })
+  ///        .then([conn](std::string gz) { conn->send(gz); });
+  ///
+  /// 任务不应抛异常。
+  class ComputePool : noncopyable
+  {
+  public:
+    typedef std::function<void()> Task;
+
+    enum RejectPolicy
+    {
+      kReject,       // submit返回false，回调不会被调用
+      kCallerRuns,   // 在提交的线程里直接执行，给提交方施加背压
+    };
+
+    /// queueCapacity是每个工作线程的队列长度，向上取整到2的幂
+    explicit ComputePool(int numThreads,
+                         size_t queueCapacity = 1024,
+                         RejectPolicy policy = kReject,
+                         const std::string& name = "ComputePool");
+    ~ComputePool();
+
+    void start();
+    /// 执行完已经提交的任务后退出，之后的提交都被拒绝。
+    /// 和stop()同时进行的submit()如果已经放进队列，任务由stop()或submit()自己执行，不会丢
+    void stop();
+
+    /// 线程安全。返回false表示被拒绝
+    bool submit(Task task);
+
+    /// 在池里执行fn，然后在loop线程里调用cb(fn的返回值)；fn返回void时调用cb()。
+    /// 返回值可以是只能移动的类型。
+    template <typename F, typename Cb>
+    bool submit(EventLoop* loop, F&& fn, Cb&& cb)
+    { return submit(bindToLoop(loop, std::forward<F>(fn), std::forward<Cb>(cb))); }
+
+    template <typename F, typename Cb>
+    static Task bindToLoop(EventLoop* loop, F&& fn, Cb&& cb);
+
+    int numThreads() const { return numThreads_; }
+    /// 被拒绝的任务数
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+    /// 从别的线程队列偷来执行的任务数
+    uint64_t stolen() const { return stolen_.load(std::memory_order_relaxed); }
+
+  private:
+    class TaskQueue;
+
+    void threadFunc(int index);
+    bool tryTake(int index, Task* task);
+    bool hasTask() const;
+    void wakeup();
+    void runRemaining();
+
+    const int numThreads_;
+    const size_t queueCapacity_;
+    const RejectPolicy policy_;
+    const std::string name_;
+    std::atomic<bool> running_;
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    // 空闲的工作线程在这里睡眠，提交方只在有人睡着时才加锁唤醒
+    std::atomic<int> sleepers_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> stolen_;
+  };
+
+  template <typename F, typename Cb>
+  ComputePool::Task ComputePool::bindToLoop(EventLoop* loop, F&& fn, Cb&& cb)
+  {
+    typedef typename std::decay<F>::type Fn;
+    typedef typename std::decay<Cb>::type Callback;
+    typedef typename std::invoke_result<Fn&>::type Result;
+    return [loop, fn = Fn(std::forward<F>(fn)), cb = Callback(std::forward<Cb>(cb))]() mutable {
+      if constexpr (std::is_void<Result>::value)
+      {
+        fn();
+        loop->queueInLoop(std::move(cb));
+      }
+      else
+      {
+        // queueInLoop要求可拷贝，结果放进shared_ptr
+        std::shared_ptr<Result> result = std::make_shared<Result>(fn());
+        loop->queueInLoop([cb = std::move(cb), result]() mutable { cb(std::move(*result)); });
+      }
+    };
+  }
+
+  ///
+  /// TcpConnection::offload()的返回值，then(cb)时才真正提交。
+  /// 回调执行前一直持有连接，回调里用conn->connected()判断连接是否还在。
+  template <typename F>
+  class Offload
+  {
+  public:
+    Offload(ComputePool* pool, EventLoop* loop, std::shared_ptr<void> guard, F fn)
+      : pool_(pool),
+        loop_(loop),
+        guard_(std::move(guard)),
+        fn_(std::move(fn))
+    {
+    }
+
+    /// 返回false表示被拒绝。没有设置ComputePool时在当前线程执行fn
+    template <typename Cb>
+    bool then(Cb&& cb)
+    {
+      std::shared_ptr<void> guard = std::move(guard_);
+      auto callback = [guard, cb = typename std::decay<Cb>::type(std::forward<Cb>(cb))](auto&&... result) mutable {
+        cb(std::forward<decltype(result)>(result)...);
+      };
+      if (pool_ == nullptr)
+      {
+        ComputePool::bindToLoop(loop_, std::move(fn_), std::move(callback))();
+        return true;
+      }
+      return pool_->submit(loop_, std::move(fn_), std::move(callback));
+    }
+
+  private:
+    ComputePool* pool_;
+    EventLoop* loop_;
+    std::shared_ptr<void> guard_;
+    F fn_;
+  };
+
+}  // namespace mutty
+
+#endif  // MUTTY_COMPUTEPOOL_H
@@ -0,0 +1,182 @@
+#ifndef MUTTY_CONNECTIONCONTEXT_H
+#define MUTTY_CONNECTIONCONTEXT_H
+
+#include <assert.h>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "base/noncopyable.h"
+
+// 连接上下文的内联存储大小，可以在编译时用-DMUTTY_CONTEXT_INLINE_SIZE=n调整
+#ifndef MUTTY_CONTEXT_INLINE_SIZE
+#define MUTTY_CONTEXT_INLINE_SIZE 128
+#endif
+
+namespace mutty {
+
+  ///
+  /// 每个loop线程一个的上下文对象池，连接断开后对象回到池里给下一个连接用。
+  /// T须可默认构造，并提供reset()把自己恢复到初始状态。
+  ///
+  /// 只在所属的loop线程里取放；在别的线程归还(连接在别的线程析构)时直接delete。
+  template <typename T>
+  class ContextPool : noncopyable
+  {
+  public:
+    static ContextPool* local()
+    {
+      thread_local ContextPool pool;
+      return &pool;
+    }
+
+    T* acquire()
+    {
+      if (idle_.empty())
+        return new T();
+      T* ctx = idle_.back().release();
+      idle_.pop_back();
+      return ctx;
+    }
+
+    void release(T* ctx)
+    {
+      if (this != local() || idle_.size() >= maxIdle_)
+      {
+        delete ctx;
+        return;
+      }
+      ctx->reset();
+      idle_.emplace_back(ctx);
+    }
+
+    /// 池里最多留多少个空闲对象，默认1024
+    void setMaxIdle(size_t n) { maxIdle_ = n; }
+    size_t idle() const { return idle_.size(); }
+
+  private:
+    ContextPool() : maxIdle_(1024) {}
+
+    std::vector<std::unique_ptr<T>> idle_;
+    size_t maxIdle_;
+  };
+
+  ///
+  /// TcpConnection上按类型存放的上下文，替代base::any：
+  ///   - 不超过MUTTY_CONTEXT_INLINE_SIZE字节的对象直接构造在连接对象里，不分配内存；
+  ///     大的对象才放到堆上，或者用ContextPool复用。每个连接都有的上下文应该在emplace处
+  ///     static_assert(fitsInline<T>())，防止变大后悄悄变成堆分配。
+  ///   - get<T>()只是一次指针转换，不做typeid比较，类型只在debug版本里assert。
+  class ConnectionContext : noncopyable
+  {
+  public:
+    static constexpr size_t kInlineSize = MUTTY_CONTEXT_INLINE_SIZE;
+
+    ConnectionContext()
+      : object_(nullptr),
+        pool_(nullptr),
+        destroy_(nullptr),
+        type_(nullptr)
+    {
+    }
+
+    ~ConnectionContext() { reset(); }
+
+    template <typename T>
+    static constexpr bool fitsInline()
+    { return sizeof(T) <= kInlineSize && alignof(T) <= alignof(std::max_align_t); }
+
+    template <typename T, typename... Args>
+    T* emplace(Args&&... args)
+    {
+      reset();
+      T* ctx;
+      if constexpr (fitsInline<T>())
+      {
+        ctx = new (storage_) T(std::forward<Args>(args)...);
+        destroy_ = &destroyInline<T>;
+      }
+      else
+      {
+        ctx = new T(std::forward<Args>(args)...);
+        destroy_ = &destroyHeap<T>;
+      }
+      set(ctx, nullptr);
+      return ctx;
+    }
+
+    /// 从pool取一个对象，reset()或析构时还回去
+    template <typename T>
+    T* acquire(ContextPool<T>* pool)
+    {
+      reset();
+      T* ctx = pool->acquire();
+      destroy_ = &releasePooled<T>;
+      set(ctx, pool);
+      return ctx;
+    }
+
+    template <typename T>
+    T* get() const
+    {
+      assert(type_ == typeTag<T>());
+      return static_cast<T*>(object_);
+    }
+
+    bool empty() const { return object_ == nullptr; }
+    /// 是不是从ContextPool取的
+    bool pooled() const { return pool_ != nullptr; }
+
+    void reset()
+    {
+      if (object_ != nullptr)
+      {
+        void* object = object_;
+        object_ = nullptr;
+        destroy_(object, pool_);
+        pool_ = nullptr;
+        destroy_ = nullptr;
+        type_ = nullptr;
+      }
+    }
+
+  private:
+    typedef void (*DestroyFunc)(void* object, void* pool);
+
+    template <typename T>
+    struct TypeTag { static constexpr char id = 0; };
+
+    template <typename T>
+    static const void* typeTag() { return &TypeTag<T>::id; }
+
+    template <typename T>
+    void set(T* ctx, void* pool)
+    {
+      object_ = ctx;
+      pool_ = pool;
+      type_ = typeTag<T>();
+    }
+
+    template <typename T>
+    static void destroyInline(void* object, void*) { static_cast<T*>(object)->~T(); }
+
+    template <typename T>
+    static void destroyHeap(void* object, void*) { delete static_cast<T*>(object); }
+
+    template <typename T>
+    static void releasePooled(void* object, void* pool)
+    { static_cast<ContextPool<T>*>(pool)->release(static_cast<T*>(object)); }
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    void* object_;
+    void* pool_;
+    DestroyFunc destroy_;
+    const void* type_;
+  };
+
+}  // namespace mutty
+
+#endif  // MUTTY_CONNECTIONCONTEXT_H
@@ -0,0 +1,127 @@
+#ifndef MUTTY_CONNECTIONREGISTRY_H
+#define MUTTY_CONNECTIONREGISTRY_H
+
+#include <assert.h>
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#include "Callbacks.h"
+#include "base/noncopyable.h"
+
+namespace mutty {
+
+  ///
+  /// TcpServer在每个IO loop上的连接表，slot map：连接ID就是槽位下标加上代数，
+  /// 查找、插入、删除都是O(1)，不用字符串也不用哈希。
+  ///
+  /// 连接ID的布局：| loop下标 16位 | 代数 16位 | 槽位 32位 |，槽位复用时代数加一，
+  /// 旧ID不会查到新连接。代数从1开始，ID不会是0。
+  ///
+  /// 除load()/addLoad()外只在所属loop线程访问。
+  class ConnectionRegistry : noncopyable
+  {
+  public:
+    explicit ConnectionRegistry(uint32_t loopIndex)
+      : loopIndex_(loopIndex),
+        freeHead_(kNoSlot),
+        size_(0),
+        load_(0)
+    {
+    }
+
+    static uint32_t loopIndexOf(uint64_t id) { return static_cast<uint32_t>(id >> 48); }
+
+    uint64_t insert(const TcpConnectionPtr& conn)
+    {
+      uint32_t slot;
+      if (freeHead_ != kNoSlot)
+      {
+        slot = freeHead_;
+        freeHead_ = slots_[slot].nextFree;
+      }
+      else
+      {
+        slot = static_cast<uint32_t>(slots_.size());
+        slots_.emplace_back();
+      }
+      slots_[slot].conn = conn;
+      ++size_;
+      return makeId(slot, slots_[slot].generation);
+    }
+
+    TcpConnectionPtr find(uint64_t id) const
+    {
+      uint32_t slot = static_cast<uint32_t>(id);
+      if (loopIndexOf(id) != loopIndex_ || slot >= slots_.size() ||
+          slots_[slot].generation != static_cast<uint16_t>(id >> 32))
+        return TcpConnectionPtr();
+      return slots_[slot].conn;
+    }
+
+    bool erase(uint64_t id)
+    {
+      uint32_t slot = static_cast<uint32_t>(id);
+      if (loopIndexOf(id) != loopIndex_ || slot >= slots_.size() ||
+          slots_[slot].generation != static_cast<uint16_t>(id >> 32) || !slots_[slot].conn)
+        return false;
+      slots_[slot].conn.reset();
+      if (++slots_[slot].generation == 0)
+        slots_[slot].generation = 1;
+      slots_[slot].nextFree = freeHead_;
+      freeHead_ = slot;
+      --size_;
+      return true;
+    }
+
+    size_t size() const { return size_; }
+
+    template <typename F>
+    void forEach(F f) const
+    {
+      for (const Slot& s : slots_)
+      {
+        if (s.conn)
+          f(s.conn);
+      }
+    }
+
+    void clear()
+    {
+      slots_.clear();
+      freeHead_ = kNoSlot;
+      size_ = 0;
+    }
+
+    /// 分给这个loop、还没断开的连接数，包括还在路上没有insert的。
+    /// acceptor loop加，IO loop减，任意线程可读。
+    size_t load() const { return load_.load(std::memory_order_seq_cst); }
+    void addLoad(long n) { load_.fetch_add(n, std::memory_order_seq_cst); }
+
+  private:
+    static const uint32_t kNoSlot = UINT32_MAX;
+
+    struct Slot
+    {
+      Slot() : generation(1), nextFree(kNoSlot) {}
+      TcpConnectionPtr conn;
+      uint16_t generation;
+      uint32_t nextFree;
+    };
+
+    uint64_t makeId(uint32_t slot, uint16_t generation) const
+    {
+      return static_cast<uint64_t>(loopIndex_) << 48 |
+             static_cast<uint64_t>(generation) << 32 | slot;
+    }
+
+    const uint32_t loopIndex_;
+    std::vector<Slot> slots_;
+    uint32_t freeHead_;
+    size_t size_;
+    std::atomic<size_t> load_;
+  };
+
+}  // namespace mutty
+
+#endif  // MUTTY_CONNECTIONREGISTRY_H
@@ -2,7 +2,9 @@
 #include "Channel.h"
 #include "EventLoop.h"
 #include "Socket.h"
+#include "base/Logging.h"
 
+#include <assert.h>
 #include <errno.h>
 
 namespace mutty{
@@ -13,10 +15,10 @@ namespace mutty{
   {
   }
 
-  // Connector::~Connector()
-  // {
-  //   assert(!channel_);
-  // }
+  Connector::~Connector()
+  {
+    assert(!channel_);
+  }
 
   void Connector::start()
   {
@@ -34,7 +36,7 @@ namespace mutty{
     }
     else
     {
-      // LOG_DEBUG << "do not connect";
+      LOG_DEBUG << "do not connect";
     }
   }
 
@@ -68,12 +70,12 @@ namespace mutty{
       case EBADF:
       case EFAULT:
       case ENOTSOCK:
-        // LOG_SYSERR << "connect error in Connector::startInLoop " << savedErrno;
+        LOG_SYSERR << "connect error in Connector::startInLoop " << savedErrno;
         ::close(sockfd);
         break;
 
       default:
-        // LOG_SYSERR << "Unexpected error in Connector::startInLoop " << savedErrno;
+        LOG_SYSERR << "Unexpected error in Connector::startInLoop " << savedErrno;
         ::close(sockfd);
         // connectErrorCallback_();
         break;
@@ -85,6 +87,7 @@ namespace mutty{
     status_ = Status::kConnecting;
     assert(!channel_);
     channel_.reset(new Channel(loop_, sockfd));
+    channel_->setKind(Channel::kConnector);
     channel_->setWriteCallback(
         std::bind(&Connector::handleWrite, this)); // FIXME: unsafe
     channel_->setErrorCallback(
@@ -118,13 +121,13 @@ namespace mutty{
       int err = Socket::getSocketError(sockfd);
       if (err)
       {
-        // LOG_WARN << "Connector::handleWrite - SO_ERROR = "
-        //          << err << " " << strerror_tl(err);
+        LOG_WARN << "Connector::handleWrite - SO_ERROR = "
+                 << err << " " << strerror_tl(err);
         retry(sockfd);
       }
       else if (Socket::isSelfConnect(sockfd))
       {
-        // LOG_WARN << "Connector::handleWrite - Self connect";
+        LOG_WARN << "Connector::handleWrite - Self connect";
         retry(sockfd);
       }
       else
@@ -153,7 +156,7 @@ namespace mutty{
     {
       int sockfd = removeAndResetChannel();
       int err = Socket::getSocketError(sockfd);
-      // LOG_TRACE << "SO_ERROR = " << err << " " << strerror_tl(err);
+      LOG_TRACE << "SO_ERROR = " << err << " " << strerror_tl(err);
       retry(sockfd);
     }
   }
@@ -164,15 +167,15 @@ namespace mutty{
     status_ = Status::kDisconnected;
     if (connect_)
     {
-      // LOG_INFO << "Connector::retry - Retry connecting to " << serverAddr_.toIpPort()
-      //          << " in " << retryDelayMs_ << " milliseconds. ";
+      LOG_INFO << "Connector::retry - Retry connecting to " << serverAddr_.toIpPort()
+               << " in " << retryDelayMs_ << " milliseconds. ";
       loop_->runAfter(m_timeval(retryDelayMs_ * 1000),
                       std::bind(&Connector::startInLoop, shared_from_this()));
       retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
     }
     else
     {
-      // LOG_DEBUG << "do not connect";
+      LOG_DEBUG << "do not connect";
     }
   }
 
@@ -0,0 +1,129 @@
+#ifndef MUTTY_COROUTINE_H
+#define MUTTY_COROUTINE_H
+
+// C++20协程接口，库本身仍按C++17编译，低于C++20时本文件为空。
+//
+//   mutty::Task session(mutty::TcpConnectionPtr conn)
+//   {
+//     buffer::PooledSlicedByteBuf line = co_await conn->readUntil("\r\n");
+//     conn->send(line.peek(), line.readableBytes());
+//     co_await conn->drain();
+//     co_await conn->getLoop()->sleep(std::chrono::milliseconds(100));
+//   }
+//
+// 协程总是在连接所属的EventLoop线程里恢复执行。等待期间收到的数据留在
+// inputBuffer()里，不会交给MessageCallback；协程自己管理的连接应当把
+// MessageCallback设为空(TcpServer::setMessageCallback(MessageCallback()))，
+// 这样协程在drain()/sleep()期间到达的数据也会留给下一次read()。
+// read/readUntil返回inputBuffer()里那段数据的视图(retainedSlice)，不拷贝也不分配，
+// 视图可以一直留着，之后的读入不会覆盖它。
+// 连接断开时挂起的read/readUntil/drain都会恢复，read类返回空的视图，
+// 用conn->connected()区分。
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#define MUTTY_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <exception>
+
+#include "buffer/PooledSlicedByteBuf.h"
+#include "timer/delay_queue/TimeEntry.h"
+
+namespace mutty
+{
+
+  class EventLoop;
+  class TcpConnection;
+
+  /// 立即开始执行、结束后自行销毁的协程返回类型
+  struct Task
+  {
+    struct promise_type
+    {
+      Task get_return_object() noexcept { return Task(); }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() noexcept {}
+      void unhandled_exception() noexcept { std::terminate(); }
+    };
+  };
+
+  // 以下awaiter都放在协程帧里，挂起时把自身地址登记到TcpConnection，不做堆分配
+
+  /// co_await conn->read(n): 凑够n字节后取出
+  class ReadAwaiter
+  {
+  public:
+    ReadAwaiter(TcpConnection* conn, size_t n) : conn_(conn), n_(n) {}
+    bool await_ready() const;
+    void await_suspend(std::coroutine_handle<> h);
+    buffer::PooledSlicedByteBuf await_resume();
+
+  private:
+    static void onReadable(void* self);
+
+    TcpConnection* conn_;
+    size_t n_;
+    std::coroutine_handle<> handle_;
+  };
+
+  /// co_await conn->readUntil("\r\n"): 取出分隔符之前的数据，分隔符被丢弃
+  /// delim必须在co_await期间有效，字符串字面量即可；"\r\n"走buffer::findCRLF，
+  /// 别的分隔符走codec::findDelimiter
+  class ReadUntilAwaiter
+  {
+  public:
+    ReadUntilAwaiter(TcpConnection* conn, const char* delim, size_t len)
+      : conn_(conn), delim_(delim), delimLen_(len), scanned_(0), found_(nullptr) {}
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    buffer::PooledSlicedByteBuf await_resume();
+
+  private:
+    static void onReadable(void* self);
+    bool search();
+
+    TcpConnection* conn_;
+    const char* delim_;
+    size_t delimLen_;
+    size_t scanned_;     // 已经找过的字节数，新数据到来时从这里继续找
+    const char* found_;
+    std::coroutine_handle<> handle_;
+  };
+
+  /// co_await conn->drain(): 等outputBuffer发送完
+  class DrainAwaiter
+  {
+  public:
+    explicit DrainAwaiter(TcpConnection* conn) : conn_(conn) {}
+    bool await_ready() const;
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const {}
+
+  private:
+    static void onDrained(void* self);
+
+    TcpConnection* conn_;
+    std::coroutine_handle<> handle_;
+  };
+
+  /// co_await loop->sleep(d): 定时器线程到期后经queueInLoop回到loop线程恢复
+  class SleepAwaiter
+  {
+  public:
+    SleepAwaiter(EventLoop* loop, const m_timeval& delay) : loop_(loop), delay_(delay) {}
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const {}
+
+  private:
+    EventLoop* loop_;
+    m_timeval delay_;
+  };
+
+}  // namespace mutty
+
+#endif  // __cplusplus >= 202002L
+
+#endif  // MUTTY_COROUTINE_H
@@ -1,12 +1,16 @@
-#include <iostream>
 #include <algorithm>
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 
 #include "EventLoop.h"
 #include "Channel.h"
 #include "Poller.h"
+#include "TcpConnection.h"
+#include "TimeoutWheel.h"
+#include "base/Logging.h"
+#include "buffer/PooledByteBufAllocator.h"
 #include "timer/delay_queue/TimeEntry.h"
 
 namespace mutty {
@@ -19,24 +23,59 @@ namespace mutty {
     int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     if (evtfd < 0)
     {
-      std::cout << "Failed in eventfd" << std::endl;
-      abort();
+      LOG_SYSFATAL << "Failed in eventfd";
     }
     return evtfd;
   }
 
+  // 定时器线程池不处理任何信号，创建时屏蔽全部信号让其线程继承，
+  // 否则onSignal()关注的信号可能被投递到这些线程上
+  Timer* createTimer()
+  {
+    sigset_t all, old;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_SETMASK, &all, &old);
+    Timer* timer = Timer::newTimer(m_timeval(1000),20);
+    ::pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return timer;
+  }
+
   class IgnoreSigPipe
   {
   public:
     IgnoreSigPipe()
     {
       ::signal(SIGPIPE, SIG_IGN);
-      // LOG_TRACE << "Ignore SIGPIPE";
+      LOG_TRACE << "Ignore SIGPIPE";
     }
   };
 
   IgnoreSigPipe initObj;
 
+  int64_t nowMs()
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void trimThreadCache()
+  {
+    buffer::PooledByteBufAllocator::trimCurrentThreadCache();
+  }
+
+  // 所有存活的EventLoop，releaseCachedMemory()用
+  std::mutex& loopsMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  std::vector<EventLoop*>& allLoops()
+  {
+    static std::vector<EventLoop*> loops;
+    return loops;
+  }
+
   EventLoop* EventLoop::getEventLoopOfCurrentThread()
   {
     return t_loopInThisThread;
@@ -49,27 +88,47 @@ namespace mutty {
       poller_(Poller::newDefaultPoller(this)),
       currentActiveChannel_(nullptr),
       eventHandling_(false),
-      timer_(Timer::newTimer(m_timeval(200000),20)),
+      timer_(createTimer()),
       callingPendingFuncs_(false),
       wakeupFd_(createEventfd()),
-      wakeupChannel_(new Channel(this, wakeupFd_))
+      wakeupChannel_(new Channel(this, wakeupFd_)),
+      signalFd_(-1),
+      idleCallback_(trimThreadCache),
+      idleMs_(kDefaultIdleMs),
+      lastBusyMs_(nowMs()),
+      idleFired_(false)
   {
+    sigemptyset(&signalMask_);
     if (t_loopInThisThread)
     {
-      // 如果当前线程已经创建了EventLoop对象，终止(LOG_FATAL)
-      std::cout << "There is already an EventLoop in this thread" << std::endl;
-      exit(-1);
+      // 如果当前线程已经创建了EventLoop对象，终止
+      LOG_FATAL << "There is already an EventLoop in this thread";
     }
     t_loopInThisThread = this;
+    wakeupChannel_->setKind(Channel::kWakeup);
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
     wakeupChannel_->enableReading();
+    std::lock_guard<std::mutex> lock(loopsMutex());
+    allLoops().push_back(this);
   }
 
   EventLoop::~EventLoop()
   {
+    {
+      std::lock_guard<std::mutex> lock(loopsMutex());
+      std::vector<EventLoop*>& loops = allLoops();
+      loops.erase(std::find(loops.begin(), loops.end(), this));
+    }
     wakeupChannel_->disableAll();
     wakeupChannel_->remove();
     ::close(wakeupFd_);
+    if (signalChannel_)
+    {
+      signalChannel_->disableAll();
+      signalChannel_->remove();
+      ::close(signalFd_);
+    }
+    timeoutWheel_.reset();
     t_loopInThisThread = nullptr;
   }
 
@@ -84,6 +143,57 @@ namespace mutty {
     timer_->addByDelay(delay, std::move(cb));
   }
 
+  void EventLoop::onSignal(int signo, SignalCallback cb)
+  {
+    // 先在调用线程屏蔽，之后创建的线程都会继承
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    runInLoop(std::bind(&EventLoop::onSignalInLoop, this, signo, std::move(cb)));
+  }
+
+  void EventLoop::onSignalInLoop(int signo, const SignalCallback& cb)
+  {
+    assertInLoopThread();
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    sigaddset(&signalMask_, signo);
+    signalCallbacks_[signo] = cb;
+    // fd为-1时新建，否则只更新该signalfd关注的信号集
+    int fd = ::signalfd(signalFd_, &signalMask_, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+    {
+      LOG_SYSFATAL << "EventLoop::onSignal signalfd";
+    }
+    if (!signalChannel_)
+    {
+      signalFd_ = fd;
+      signalChannel_.reset(new Channel(this, signalFd_));
+      signalChannel_->setKind(Channel::kSignal);
+      signalChannel_->setReadCallback(std::bind(&EventLoop::handleSignal, this));
+      signalChannel_->enableReading();
+    }
+  }
+
+  void EventLoop::handleSignal()
+  {
+    struct signalfd_siginfo info;
+    while (::read(signalFd_, &info, sizeof info) == sizeof info)
+    {
+      int signo = static_cast<int>(info.ssi_signo);
+      LOG_DEBUG << "EventLoop got signal " << signo;
+      auto it = signalCallbacks_.find(signo);
+      if (it != signalCallbacks_.end())
+      {
+        it->second(signo);
+      }
+    }
+  }
+
   void EventLoop::updateChannel(Channel* channel)
   {
     assert(channel->ownerLoop() == this);
@@ -119,23 +229,107 @@ namespace mutty {
     looping_ = true;
     quit_ = false;  // FIXME: what if someone calls quit() before loop() ?
 
+    // 每个阶段边界取一次TSC，上一阶段的结束时间就是下一阶段的开始时间
+    uint64_t start = EventLoopStats::now();
     while (!quit_)
     {
       activeChannels_.clear();
-      poller_->poll(kPollTimeMs, &activeChannels_);
+      stats_.enter(EventLoopStats::kPoll, start);
+      poller_->poll(pollTimeoutMs(), &activeChannels_);
+      uint64_t end = EventLoopStats::now();
+      stats_.recordPoll(end - start, activeChannels_.size());
+      if (idleCallback_)
+      {
+        checkIdle(nowMs());
+      }
+
       eventHandling_ = true;
       for (Channel* channel : activeChannels_)
       {
+        start = end;
+        // handleEvent()里channel可能被析构，先取kind
+        Channel::Kind kind = channel->kind();
+        stats_.enter(EventLoopStats::kHandler, start, kind);
         currentActiveChannel_ = channel;
         currentActiveChannel_->handleEvent();
+        end = EventLoopStats::now();
+        stats_.recordHandler(kind, end - start);
       }
       currentActiveChannel_ = nullptr;
       eventHandling_ = false;
-      doPendingFunctors();
+
+      start = end;
+      stats_.enter(EventLoopStats::kPendingFunctors, start);
+      size_t functors = doPendingFunctors();
+      end = EventLoopStats::now();
+      stats_.recordPendingFunctors(end - start, functors);
+
+      start = end;
+      stats_.enter(EventLoopStats::kFlush, start);
+      if (flushPendingConnections() > 0)
+      {
+        end = EventLoopStats::now();
+        stats_.recordFlush(end - start);
+        start = end;
+      }
+      stats_.endIteration();
     }
+    stats_.enter(EventLoopStats::kIdle, EventLoopStats::now());
     looping_ = false;
   }
 
+  // 还没触发空闲回调时，最多睡到该触发的时刻
+  int EventLoop::pollTimeoutMs() const
+  {
+    if (!idleCallback_ || idleFired_)
+    {
+      return kPollTimeMs;
+    }
+    int64_t remaining = lastBusyMs_ + idleMs_ - nowMs();
+    return static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(remaining, kPollTimeMs)));
+  }
+
+  void EventLoop::checkIdle(int64_t now)
+  {
+    // 有channel就绪就算忙；pending functor和定时器回调都经过wakeupChannel_
+    if (!activeChannels_.empty())
+    {
+      lastBusyMs_ = now;
+      idleFired_ = false;
+    }
+    else if (!idleFired_ && now - lastBusyMs_ >= idleMs_)
+    {
+      idleFired_ = true;
+      idleCallback_();
+    }
+  }
+
+  void EventLoop::setIdleCallback(Functor cb, int idleMs)
+  {
+    if (idleMs <= 0)
+    {
+      cb = nullptr;
+    }
+    idleCallback_ = std::move(cb);
+    idleMs_ = idleMs;
+    lastBusyMs_ = nowMs();
+    idleFired_ = false;
+  }
+
+  void EventLoop::releaseCachedMemory()
+  {
+    // 当前线程马上归还，并让别的线程在下次分配或trim时归还
+    buffer::PooledByteBufAllocator::releaseCachedMemory();
+    std::lock_guard<std::mutex> lock(loopsMutex());
+    for (EventLoop* loop : allLoops())
+    {
+      if (!loop->isInLoopThread())
+      {
+        loop->queueInLoop(trimThreadCache);
+      }
+    }
+  }
+
   void EventLoop::runInLoop(Functor cb)
   {
     if (isInLoopThread())
@@ -158,6 +352,22 @@ namespace mutty {
     }
   }
 
+  void EventLoop::queueFlush(const TcpConnectionPtr& conn)
+  {
+    assertInLoopThread();
+    pendingFlushes_.push_back(conn);
+  }
+
+  void EventLoop::addTimeout(const TcpConnectionPtr& conn, int64_t deadline)
+  {
+    assertInLoopThread();
+    if (!timeoutWheel_)
+    {
+      timeoutWheel_.reset(new TimeoutWheel(this));
+    }
+    timeoutWheel_->add(conn, deadline);
+  }
+
   bool EventLoop::hasChannel(Channel* channel)
   {
     assert(channel->ownerLoop() == this);
@@ -168,8 +378,7 @@ namespace mutty {
   void EventLoop::abortNotInLoopThread()
   {
     quit_ = true;
-    std::cout << "It is forbidden to run loop on threads other than event-loop thread" << std::endl;
-    exit(1);
+    LOG_FATAL << "It is forbidden to run loop on threads other than event-loop thread";
   }
 
   void EventLoop::wakeup()
@@ -183,11 +392,12 @@ namespace mutty {
     uint64_t one;
     ssize_t n = read(wakeupFd_, &one, sizeof(one));
     if (n < 0)
-        std::cout << "wakeup read error";
+        LOG_SYSERR << "wakeup read error";
   }
 
-  void EventLoop::doPendingFunctors()
+  size_t EventLoop::doPendingFunctors()
   {
+    size_t n = 0;
     // std::vector<Functor> functors;
     callingPendingFuncs_ = true;
     
@@ -206,10 +416,28 @@ namespace mutty {
         while (funcs_.dequeue(functor))
         {
             functor();
+            ++n;
         }
     }
 
     callingPendingFuncs_ = false;
+    return n;
+  }
+
+  // 每轮事件处理之后，对本轮积攒了输出的连接各做一次写
+  size_t EventLoop::flushPendingConnections()
+  {
+    if (pendingFlushes_.empty())
+    {
+      return 0;
+    }
+    std::vector<TcpConnectionPtr> conns;
+    conns.swap(pendingFlushes_);
+    for (const TcpConnectionPtr& conn : conns)
+    {
+      conn->flushInLoop();
+    }
+    return conns.size();
   }
 }
 
@@ -2,12 +2,17 @@
 #define MUTTY_EVENTLOOP_H
 
 #include <atomic>
+#include <map>
 #include <mutex>
+#include <signal.h>
 #include <functional>
 #include <vector>
 #include <thread>
 #include <memory>
+#include <chrono>
 #include "Callbacks.h"
+#include "Coroutine.h"
+#include "EventLoopStats.h"
 #include "MpscQueue.h"
 #include "base/noncopyable.h"
 #include "timer/Timer.h"
@@ -18,6 +23,7 @@ namespace mutty {
 
   class Channel;
   class Poller;
+  class TimeoutWheel;
 
   ///
   /// Reactor, at most one per thread.
@@ -27,6 +33,7 @@ namespace mutty {
   {
   public:
     typedef std::function<void()> Functor;
+    typedef std::function<void(int signo)> SignalCallback;
 
     EventLoop();
     ~EventLoop();
@@ -52,6 +59,49 @@ namespace mutty {
 
     void runAfter(const m_timeval &delay, TimerCallback cb);
 
+  #ifdef MUTTY_HAS_COROUTINES
+    /// co_await loop->sleep(d), resumes in this loop's thread.
+    SleepAwaiter sleep(const m_timeval& delay)
+    { return SleepAwaiter(this, delay); }
+
+    template<typename Rep, typename Period>
+    SleepAwaiter sleep(std::chrono::duration<Rep, Period> delay)
+    {
+      return SleepAwaiter(this, m_timeval(static_cast<long>(
+          std::chrono::duration_cast<std::chrono::microseconds>(delay).count())));
+    }
+  #endif
+
+    /// Runs cb in this loop's thread whenever signo arrives, via signalfd(2).
+    /// The signal is blocked in the calling thread and in the loop thread;
+    /// call it from main() before other threads start so they inherit the
+    /// mask. Registering signo again replaces its callback. Thread safe.
+    void onSignal(int signo, SignalCallback cb);
+
+    /// Batched flush: conn has buffered output in this iteration and wants
+    /// it written once after event handling. Must be called in loop thread.
+    void queueFlush(const TcpConnectionPtr& conn);
+
+    /// Calls conn->handleTimeout(deadline) once TimeoutWheel::now() passes
+    /// deadline, 1s resolution. Used by TcpConnection, loop thread only.
+    void addTimeout(const TcpConnectionPtr& conn, int64_t deadline);
+
+    /// Calls cb in loop thread once the loop has been quiet (no channel
+    /// ready, no pending functor) for idleMs; again only after the next
+    /// busy iteration. By default every loop trims its thread's buffer pool
+    /// cache after kDefaultIdleMs. Null cb or idleMs <= 0 disables it.
+    /// Call before loop() or in loop thread.
+    void setIdleCallback(Functor cb, int idleMs);
+    static const int kDefaultIdleMs = 5000;
+
+    /// Memory pressure: every buffer pool thread cache returns its cached
+    /// memory to the arenas. Loop threads do it right away, idle or not;
+    /// other threads at their next pooled allocation. Thread safe.
+    static void releaseCachedMemory();
+
+    /// Per-iteration phase histograms recorded by loop(). Thread safe.
+    void statsSnapshot(EventLoopStats::Snapshot* out) const { stats_.snapshot(out); }
+
     void updateChannel(Channel* channel);
     void removeChannel(Channel* channel);
     bool hasChannel(Channel* channel);
@@ -60,7 +110,12 @@ namespace mutty {
     void abortNotInLoopThread();
     void wakeup();
     void handleRead();  // waked up
-    void doPendingFunctors();
+    size_t doPendingFunctors();
+    size_t flushPendingConnections();
+    void onSignalInLoop(int signo, const SignalCallback& cb);
+    void handleSignal();
+    int pollTimeoutMs() const;
+    void checkIdle(int64_t nowMs);
 
     typedef std::vector<Channel*> ChannelList;
 
@@ -75,12 +130,41 @@ namespace mutty {
 
     bool eventHandling_; /* atomic */
     MpscQueue<Functor> funcs_;
-    std::unique_ptr<Timer> timer_;
+    std::vector<TcpConnectionPtr> pendingFlushes_; // only touched in loop thread
+    Timer* timer_;  // Timer::newTimer()返回进程内共享的定时器，不归本loop所有
 
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_;
+
+    // 第一次onSignal()时创建
+    int signalFd_;
+    sigset_t signalMask_;
+    std::unique_ptr<Channel> signalChannel_;
+    std::map<int, SignalCallback> signalCallbacks_;
+
+    // 第一次addTimeout()时创建
+    std::unique_ptr<TimeoutWheel> timeoutWheel_;
+
+    EventLoopStats stats_;  // 只有loop线程写
+
+    // 空闲回调，只在loop线程用
+    Functor idleCallback_;
+    int idleMs_;
+    int64_t lastBusyMs_;
+    bool idleFired_;
   };
 
+#ifdef MUTTY_HAS_COROUTINES
+  inline void SleepAwaiter::await_suspend(std::coroutine_handle<> h)
+  {
+    // runAfter的回调在定时器线程执行，切回loop线程再恢复
+    EventLoop* loop = loop_;
+    loop_->runAfter(delay_, [loop, h] {
+      loop->queueInLoop([h] { h.resume(); });
+    });
+  }
+#endif
+
 }  // namespace mutty
 
 #endif  // MUTTY_NET_EVENTLOOP_H
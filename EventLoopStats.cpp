@@ -0,0 +1,160 @@
+#include "EventLoopStats.h"
+
+#include <stdio.h>
+
+namespace mutty {
+
+  namespace
+  {
+  int64_t monotonicNs()
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  // 进程启动时的TSC和单调时钟，之后换算时间隔越长越准
+  struct TscBase
+  {
+    TscBase() : tsc(EventLoopStats::now()), ns(monotonicNs()) {}
+    uint64_t tsc;
+    int64_t ns;
+  };
+  const TscBase g_tscBase;
+
+  const char* kPhaseNames[] = { "idle", "poll", "handler", "pendingFunctors", "flush" };
+  const char* kKindNames[Channel::kNumKinds] =
+  {
+    "other", "wakeup", "signal", "timer", "acceptor", "connector", "connection",
+  };
+
+  void appendHistogram(std::string* out, const char* name,
+                       const Log2Histogram::Snapshot& h, const char* unit)
+  {
+    if (h.count == 0)
+      return;
+    char line[256];
+    snprintf(line, sizeof line,
+             "%-20s count=%llu mean=%.0f%s p50=%.0f%s p99=%.0f%s p999=%.0f%s max=%.0f%s\n",
+             name, static_cast<unsigned long long>(h.count),
+             h.mean(), unit, h.percentile(0.5), unit, h.percentile(0.99), unit,
+             h.percentile(0.999), unit, h.maxValue(), unit);
+    out->append(line);
+  }
+  }  // namespace
+
+  Log2Histogram::Log2Histogram()
+    : sum_(0),
+      max_(0)
+  {
+    for (int i = 0; i < kBuckets; ++i)
+      counts_[i].store(0, std::memory_order_relaxed);
+  }
+
+  void Log2Histogram::snapshot(Snapshot* out, double unit) const
+  {
+    out->count = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      out->counts[i] = counts_[i].load(std::memory_order_relaxed);
+      out->count += out->counts[i];
+    }
+    out->sum = sum_.load(std::memory_order_relaxed);
+    out->max = max_.load(std::memory_order_relaxed);
+    out->unit = unit;
+  }
+
+  double Log2Histogram::Snapshot::percentile(double p) const
+  {
+    if (count == 0)
+      return 0.0;
+    uint64_t rank = static_cast<uint64_t>(p * count);
+    if (rank >= count)
+      rank = count - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      seen += counts[i];
+      if (seen > rank)
+      {
+        uint64_t upper = i == 0 ? 0 : (i == 64 ? UINT64_MAX : (uint64_t(1) << i) - 1);
+        return (upper < max ? upper : max) * unit;
+      }
+    }
+    return max * unit;
+  }
+
+  EventLoopStats::EventLoopStats()
+    : iterations_(0),
+      phase_(kIdle),
+      phaseStart_(0)
+  {
+  }
+
+  double EventLoopStats::nsPerTick()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    // 离基准点太近时误差大，至少等1ms
+    uint64_t tsc;
+    int64_t ns;
+    do
+    {
+      tsc = now();
+      ns = monotonicNs();
+    } while (ns - g_tscBase.ns < 1000000);
+    return static_cast<double>(ns - g_tscBase.ns) / static_cast<double>(tsc - g_tscBase.tsc);
+#else
+    return 1.0;
+#endif
+  }
+
+  void EventLoopStats::snapshot(Snapshot* out) const
+  {
+    double unit = nsPerTick();
+    out->iterations = iterations_.load(std::memory_order_relaxed);
+    poll_.snapshot(&out->poll, unit);
+    for (int i = 0; i < Channel::kNumKinds; ++i)
+      handlers_[i].snapshot(&out->handlers[i], unit);
+    pendingFunctors_.snapshot(&out->pendingFunctors, unit);
+    flush_.snapshot(&out->flush, unit);
+    activeChannels_.snapshot(&out->activeChannels, 1.0);
+    functorQueueDepth_.snapshot(&out->functorQueueDepth, 1.0);
+
+    int phase = phase_.load(std::memory_order_relaxed);
+    uint64_t start = phaseStart_.load(std::memory_order_relaxed);
+    out->phase = static_cast<Phase>(phase & 0xff);
+    out->phaseKind = static_cast<Channel::Kind>(phase >> 8);
+    uint64_t current = now();
+    out->phaseElapsedNs = out->phase != kIdle && current > start ? (current - start) * unit : 0.0;
+  }
+
+  std::string EventLoopStats::Snapshot::toString() const
+  {
+    std::string out;
+    char line[128];
+    snprintf(line, sizeof line, "iterations=%llu phase=%s",
+             static_cast<unsigned long long>(iterations), kPhaseNames[phase]);
+    out.append(line);
+    if (phase == kHandler)
+    {
+      out.append("(");
+      out.append(kKindNames[phaseKind]);
+      out.append(")");
+    }
+    snprintf(line, sizeof line, " for %.0fns\n", phaseElapsedNs);
+    out.append(line);
+
+    appendHistogram(&out, "poll", poll, "ns");
+    for (int i = 0; i < Channel::kNumKinds; ++i)
+    {
+      std::string name = std::string("handler.") + kKindNames[i];
+      appendHistogram(&out, name.c_str(), handlers[i], "ns");
+    }
+    appendHistogram(&out, "pendingFunctors", pendingFunctors, "ns");
+    appendHistogram(&out, "flush", flush, "ns");
+    appendHistogram(&out, "activeChannels", activeChannels, "");
+    appendHistogram(&out, "functorQueueDepth", functorQueueDepth, "");
+    return out;
+  }
+
+}  // namespace mutty
@@ -0,0 +1,152 @@
+#ifndef MUTTY_EVENTLOOPSTATS_H
+#define MUTTY_EVENTLOOPSTATS_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Channel.h"
+#include "base/noncopyable.h"
+
+namespace mutty {
+
+  ///
+  /// 以2为底的对数直方图，第i个桶统计[2^(i-1), 2^i)，第0个桶只统计0。
+  ///
+  /// 只有loop线程写，其它线程随时可以读。写入是relaxed的load+store而不是
+  /// fetch_add，在x86上就是普通的mov，没有lock前缀；读到的快照各桶之间
+  /// 不保证是同一时刻的，用于观测足够了。
+  class Log2Histogram : noncopyable
+  {
+  public:
+    static const int kBuckets = 65;
+
+    struct Snapshot
+    {
+      uint64_t counts[kBuckets];
+      uint64_t count;
+      uint64_t sum;
+      uint64_t max;
+      double unit;  // 每个样本单位对应的数值，时间直方图为纳秒/tick，计数直方图为1
+
+      double mean() const { return count ? sum * unit / count : 0.0; }
+      double maxValue() const { return max * unit; }
+      /// p in [0, 1]，返回所在桶的上界(不超过max)
+      double percentile(double p) const;
+    };
+
+    Log2Histogram();
+
+    void record(uint64_t v)
+    {
+      int b = v == 0 ? 0 : 64 - __builtin_clzll(v);
+      add(counts_[b], 1);
+      add(sum_, v);
+      if (v > max_.load(std::memory_order_relaxed))
+        max_.store(v, std::memory_order_relaxed);
+    }
+
+    void snapshot(Snapshot* out, double unit) const;
+
+  private:
+    static void add(std::atomic<uint64_t>& a, uint64_t n)
+    { a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    std::atomic<uint64_t> counts_[kBuckets];
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+  };
+
+  ///
+  /// EventLoop每轮循环各阶段的耗时直方图，由loop线程记录，任意线程取快照。
+  ///
+  /// 时间用TSC计，一个阶段只多一次rdtsc；快照时才换算成纳秒。
+  class EventLoopStats : noncopyable
+  {
+  public:
+    enum Phase
+    {
+      kIdle,             // loop()没有在运行
+      kPoll,             // 阻塞在poll
+      kHandler,          // 在某个Channel的handleEvent里
+      kPendingFunctors,  // doPendingFunctors
+      kFlush,            // 批量flush连接输出
+    };
+
+    struct Snapshot
+    {
+      uint64_t iterations;
+      Log2Histogram::Snapshot poll;                         // ns
+      Log2Histogram::Snapshot handlers[Channel::kNumKinds];  // ns，按Channel::Kind
+      Log2Histogram::Snapshot pendingFunctors;              // ns
+      Log2Histogram::Snapshot flush;                        // ns，只统计有连接要flush的轮次
+      Log2Histogram::Snapshot activeChannels;               // 每轮poll返回的channel数
+      Log2Histogram::Snapshot functorQueueDepth;            // 每轮执行的functor数
+      // loop线程此刻所处的阶段和已经持续的时间，handler卡住时可以看出来
+      Phase phase;
+      Channel::Kind phaseKind;  // phase为kHandler时有效
+      double phaseElapsedNs;
+
+      std::string toString() const;
+    };
+
+    EventLoopStats();
+
+    /// 当前TSC，没有TSC的平台上是CLOCK_MONOTONIC纳秒
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      struct timespec ts;
+      ::clock_gettime(CLOCK_MONOTONIC, &ts);
+      return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+    /// 纳秒/tick，用进程启动以来的TSC和CLOCK_MONOTONIC换算
+    static double nsPerTick();
+
+    // 以下只在loop线程调用
+    void enter(Phase phase, uint64_t tsc, Channel::Kind kind = Channel::kOther)
+    {
+      phase_.store(phase | (kind << 8), std::memory_order_relaxed);
+      phaseStart_.store(tsc, std::memory_order_relaxed);
+    }
+    void recordPoll(uint64_t ticks, size_t activeChannels)
+    {
+      poll_.record(ticks);
+      activeChannels_.record(activeChannels);
+    }
+    void recordHandler(Channel::Kind kind, uint64_t ticks) { handlers_[kind].record(ticks); }
+    void recordPendingFunctors(uint64_t ticks, size_t functors)
+    {
+      pendingFunctors_.record(ticks);
+      functorQueueDepth_.record(functors);
+    }
+    void recordFlush(uint64_t ticks) { flush_.record(ticks); }
+    void endIteration()
+    { iterations_.store(iterations_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    /// 线程安全
+    void snapshot(Snapshot* out) const;
+
+  private:
+    std::atomic<uint64_t> iterations_;
+    std::atomic<int> phase_;           // Phase | Kind << 8
+    std::atomic<uint64_t> phaseStart_;
+    Log2Histogram poll_;
+    Log2Histogram handlers_[Channel::kNumKinds];
+    Log2Histogram pendingFunctors_;
+    Log2Histogram flush_;
+    Log2Histogram activeChannels_;
+    Log2Histogram functorQueueDepth_;
+  };
+
+}  // namespace mutty
+
+#endif  // MUTTY_EVENTLOOPSTATS_H
@@ -1,5 +1,7 @@
-#include <iostream>
 #include "InetAddress.h"
+#include "base/Logging.h"
+
+#include <cstddef>
 
 //     /* Structure describing an Internet socket address.  */
 //     sa_data把目标地址和端口信息混在一起 #include <sys/socket.h>
@@ -77,8 +79,7 @@ namespace mutty {
       addr6_.sin6_port = htons(port);
       if (::inet_pton(AF_INET6, ip.c_str(), &addr6_.sin6_addr) <= 0)
       {
-        std::cout << "sockets::ipv6Netendian transfer failed"<<std::endl;
-        exit(1);
+        LOG_FATAL << "sockets::ipv6Netendian transfer failed: " << ip;
       }
     }
     else
@@ -88,8 +89,7 @@ namespace mutty {
       addr_.sin_port = htons(port);
       if (::inet_pton(AF_INET, ip.c_str(), &addr_.sin_addr) <= 0)
       {
-        std::cout << "sockets::ipv4Netendian transfer failed"<<std::endl;
-        exit(1);
+        LOG_FATAL << "sockets::ipv4Netendian transfer failed: " << ip;
       }
     }
   }
@@ -148,8 +148,7 @@ namespace mutty {
     {
       if (ret)
       {
-        std::cerr << "InetAddress::resolve";
-        exit(1);
+        LOG_SYSERR << "InetAddress::resolve";
       }
       return false;
     }
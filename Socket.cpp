@@ -1,5 +1,5 @@
-#include <iostream>
 #include "Socket.h"
+#include "base/Logging.h"
 
 namespace mutty{
   // 自连接是指(sourceIP, sourcePort) = (destIP, destPort)
@@ -35,8 +35,7 @@ namespace mutty{
     int ret = ::bind(sockfd_, addr.getSockAddr(), static_cast<socklen_t>(sizeof(struct sockaddr_in6)));
     if (ret < 0)
     {
-      std::cerr << "sockets::bindOrDie";
-      exit(1);
+      LOG_SYSFATAL << "sockets::bindOrDie";
     }
   }
 
@@ -45,8 +44,7 @@ namespace mutty{
     int ret = ::listen(sockfd_, SOMAXCONN);
     if (ret < 0)
     {
-      // std::cerr << "sockets::listenOrDie";
-      exit(1);
+      LOG_SYSFATAL << "sockets::listenOrDie";
     }
   }
 
@@ -68,8 +66,7 @@ namespace mutty{
   {
     if (::shutdown(sockfd_, SHUT_WR) < 0)
     {
-      std::cerr << "sockets::shutdownWrite" << std::endl;
-      exit(1);
+      LOG_SYSERR << "sockets::shutdownWrite";
     }
   }
 
@@ -87,8 +84,7 @@ namespace mutty{
                       static_cast<struct sockaddr *>((void *)(&localaddr)), 
                       &addrlen) < 0)
     {
-      std::cerr << "sockets::getLocalAddr";
-      exit(1);
+      LOG_SYSFATAL << "sockets::getLocalAddr";
     }
     return localaddr;
   }
@@ -102,8 +98,7 @@ namespace mutty{
                       static_cast<struct sockaddr *>((void *)(&peeraddr)),
                       &addrlen) < 0)
     {
-      std::cerr << "sockets::getPeerAddr";
-      exit(1);
+      LOG_SYSFATAL << "sockets::getPeerAddr";
     }
     return peeraddr;
   }
@@ -132,13 +127,12 @@ namespace mutty{
                           &optval, static_cast<socklen_t>(sizeof optval));
     if (ret < 0 && on)
     {
-      // LOG_SYSERR << "SO_REUSEPORT failed.";
+      LOG_SYSERR << "SO_REUSEPORT failed.";
     }
   #else
     if (on)
     {
-      std::cerr << "SO_REUSEPORT is not supported.";
-      exit(1);
+      LOG_FATAL << "SO_REUSEPORT is not supported.";
     }
   #endif
   }
@@ -153,7 +147,6 @@ namespace mutty{
 
   Socket::~Socket()
   {
-    std::cout << "Socket deconstructed:" << sockfd_;
     if (sockfd_ >= 0)
         close(sockfd_);
   }
@@ -11,6 +11,7 @@
 
 #include "InetAddress.h"
 #include "base/noncopyable.h"
+#include "base/Logging.h"
 
 namespace mutty{
   class InetAddress;
@@ -41,8 +42,7 @@ namespace mutty{
       int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
       if (sockfd < 0)
       {
-        // LOG_SYSFATAL << "sockets::createNonblockingOrDie";
-        exit(1);
+        LOG_SYSFATAL << "sockets::createNonblockingOrDie";
       }
       return sockfd;
     }
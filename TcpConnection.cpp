@@ -1,12 +1,14 @@
 
-#include <iostream>
 #include <errno.h>
+#include <stdio.h>
 
 #include "TcpConnection.h"
 #include "Channel.h"
 #include "EventLoop.h"
 #include "Socket.h"
 #include "buffer/Buffer.h"
+#include "TimeoutWheel.h"
+#include "base/Logging.h"
 
 namespace mutty{
   TcpConnection::TcpConnection(EventLoop* loop,
@@ -14,18 +16,39 @@ namespace mutty{
                               int sockfd,
                               const InetAddress& localAddr,
                               const InetAddress& peerAddr)
+    : TcpConnection(loop, std::shared_ptr<const std::string>(), sockfd, localAddr, peerAddr)
+  {
+    name_ = nameArg;
+  }
+
+  TcpConnection::TcpConnection(EventLoop* loop,
+                              const std::shared_ptr<const std::string>& namePrefix,
+                              int sockfd,
+                              const InetAddress& localAddr,
+                              const InetAddress& peerAddr)
     : loop_(loop),
-      name_(nameArg),
+      id_(0),
+      namePrefix_(namePrefix),
       state_(kConnecting),
       reading_(true),
+      batchedFlush_(false),
+      flushPending_(false),
       socket_(new Socket(sockfd)),
       channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64*1024*1024)
+      readWaiter_(nullptr),
+      readWaiterArg_(nullptr),
+      drainWaiter_(nullptr),
+      drainWaiterArg_(nullptr),
+      highWaterMark_(64*1024*1024),
+      writeTimeout_(0),
+      writeDeadline_(0),
+      requestDeadline_(0),
+      timeoutArmedAt_(0),
+      computePool_(nullptr)
   {
-    inputBuffer_.swap(buffer::Buffer(16384));
-    outputBuffer_.swap(buffer::Buffer(16384));
+    channel_->setKind(Channel::kConnection);
     channel_->setReadCallback(
         std::bind(&TcpConnection::handleRead, this));
     channel_->setWriteCallback(
@@ -42,6 +65,22 @@ namespace mutty{
     assert(state_ == kDisconnected);
   }
 
+  const std::string& TcpConnection::name() const
+  {
+    if (name_.empty() && namePrefix_)
+    {
+      char buf[32];
+      // loop下标.槽位.代数，见ConnectionRegistry
+      snprintf(buf, sizeof buf, "#%u.%u.%u",
+               static_cast<unsigned>(id_ >> 48),
+               static_cast<unsigned>(id_ & 0xffffffff),
+               static_cast<unsigned>((id_ >> 32) & 0xffff));
+      name_ = *namePrefix_ + buf;
+    }
+    return name_;
+  }
+
+
   void TcpConnection::send(const void* data, int len)
   {
     send(std::string(static_cast<const char*>(data), len));
@@ -102,11 +141,12 @@ namespace mutty{
     bool faultError = false;
     if (state_ == kDisconnected)
     {
-      std::cout << "disconnected, give up writing";
+      LOG_WARN << "disconnected, give up writing";
       return;
     }
     // if no thing in output queue, try writing directly
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // batched模式下一律先进outputBuffer_，由flushInLoop()合并写
+    if (!batchedFlush_ && !channel_->isWriting() && outputBuffer_.readableBytes() == 0)
     {
       nwrote = ::write(channel_->fd(), data, len);
       if (nwrote >= 0)
@@ -114,7 +154,7 @@ namespace mutty{
         remaining = len - nwrote;
         if (remaining == 0 && writeCompleteCallback_)
         {
-          loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+          queueWriteComplete();
         }
       }
       else // nwrote < 0
@@ -122,7 +162,7 @@ namespace mutty{
         nwrote = 0;
         if (errno != EWOULDBLOCK)
         {
-          // LOG_SYSERR << "TcpConnection::sendInLoop";
+          LOG_SYSERR << "TcpConnection::sendInLoop";
           if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
           {
             faultError = true;
@@ -142,17 +182,73 @@ namespace mutty{
         loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
       }
       outputBuffer_.writeBytes(static_cast<const char*>(data)+nwrote, remaining);
-      if (!channel_->isWriting())
+      if (batchedFlush_)
+      {
+        // 正在关注POLLOUT时由handleWrite()负责发送
+        if (!channel_->isWriting() && !flushPending_)
+        {
+          flushPending_ = true;
+          loop_->queueFlush(shared_from_this());
+        }
+      }
+      else if (!channel_->isWriting())
       {
         channel_->enableWriting(); // 关注POLLOUT事件
       }
     }
+    updateWriteDeadline(nwrote > 0);
+  }
+
+  void TcpConnection::flushInLoop()
+  {
+    loop_->assertInLoopThread();
+    flushPending_ = false;
+    if (state_ == kDisconnected || channel_->isWriting())
+    {
+      return;
+    }
+    // 本轮所有send()都已追加到outputBuffer_，这里一次write发出
+    ssize_t n = ::write(channel_->fd(),
+                        outputBuffer_.peek(),
+                        outputBuffer_.readableBytes());
+    if (n >= 0)
+    {
+      outputBuffer_.retrieve(n);
+    }
+    else if (errno != EWOULDBLOCK)
+    {
+      LOG_SYSERR << "TcpConnection::flushInLoop";
+      if (errno == EPIPE || errno == ECONNRESET)
+      {
+        return; // 等handleRead()/handleClose()收尾
+      }
+    }
+    updateWriteDeadline(n > 0);
+
+    if (outputBuffer_.readableBytes() == 0)
+    {
+      outputBuffer_.release();
+      if (writeCompleteCallback_)
+      {
+        queueWriteComplete();
+      }
+      if (state_ == kDisconnecting)
+      {
+        shutdownInLoop();
+      }
+      wakeDrainWaiter();
+    }
+    else
+    {
+      channel_->enableWriting();
+    }
   }
 
   void TcpConnection::shutdownInLoop()
   {
     loop_->assertInLoopThread();
-    if (!channel_->isWriting())
+    // batched模式下数据可能还在outputBuffer_里等flushInLoop()
+    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
     {
       // we are not writing
       socket_->shutdownWrite();
@@ -234,6 +330,9 @@ namespace mutty{
       connectionCallback_(shared_from_this());
     }
     channel_->remove();
+    // 池里的上下文在loop线程里还回去，连接对象可能在别的线程才析构
+    if (typedContext_.pooled())
+      typedContext_.reset();
   }
 
   void TcpConnection::handleRead()
@@ -243,7 +342,17 @@ namespace mutty{
     ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
     if (n > 0)
     {
-      messageCallback_(shared_from_this(), &inputBuffer_);
+      if (readWaiter_)
+      {
+        wakeReadWaiter();
+      }
+      else if (messageCallback_)
+      {
+        // 同步回调期间channel的tie保证连接活着，借用句柄不碰引用计数
+        messageCallback_(TcpConnectionRef(this), &inputBuffer_);
+      }
+      // 消息都处理完了就把内存还给池，空闲连接不占缓冲区
+      inputBuffer_.release();
     }
     else if (n == 0)
     {
@@ -252,7 +361,7 @@ namespace mutty{
     else
     {
       errno = savedErrno;
-      std::cout << "TcpConnection::handleRead";
+      LOG_SYSERR << "TcpConnection::handleRead";
       handleError();
     }
   }
@@ -268,51 +377,158 @@ namespace mutty{
       if (n > 0)
       {
         outputBuffer_.retrieve(n);
+        updateWriteDeadline(true);
         if (outputBuffer_.readableBytes() == 0)
         {
+          outputBuffer_.release();
           channel_->disableWriting();
           if (writeCompleteCallback_)
           {
-            loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            queueWriteComplete();
           }
           if (state_ == kDisconnecting) // 发送缓冲区已清空并且连接状态是kDisconnecting, 要关闭连接
           {
             shutdownInLoop();
           }
+          wakeDrainWaiter();
         }
       }
       else
       {
-        std::cout << "TcpConnection::handleWrite";
+        LOG_SYSERR << "TcpConnection::handleWrite";
       }
     }
     else
     {
-      std::cout << "Connection fd = " << channel_->fd()
+      LOG_TRACE << "Connection fd = " << channel_->fd()
                 << " is down, no more writing";
     }
   }
 
+  void TcpConnection::queueWriteComplete()
+  {
+    // 排队执行时要持有连接；不拷贝writeCompleteCallback_
+    TcpConnectionPtr guard(shared_from_this());
+    loop_->queueInLoop([guard] {
+      if (guard->writeCompleteCallback_)
+        guard->writeCompleteCallback_(TcpConnectionRef(guard.get()));
+    });
+  }
+
   void TcpConnection::handleClose()
   {
     loop_->assertInLoopThread();
-    std::cout << "fd = " << channel_->fd() << " state = " << stateToString();
+    LOG_TRACE << "fd = " << channel_->fd() << " state = " << stateToString();
     assert(state_ == kConnected || state_ == kDisconnecting);
     // we don't close fd, leave it to dtor, so we can find leaks easily.
     state_ = kDisconnected;
     channel_->disableAll();
 
     TcpConnectionPtr guardThis(shared_from_this());
+    // 挂起在read/drain上的协程在这里恢复，看到的是disconnected
+    wakeReadWaiter();
+    wakeDrainWaiter();
     connectionCallback_(guardThis); // 可以不调用
     // must be the last line
     closeCallback_(guardThis); // 调用TcpServer::removeConnection
   }
 
+  void TcpConnection::startRequestTimeout(int seconds)
+  {
+    loop_->assertInLoopThread();
+    requestDeadline_ = TimeoutWheel::now() + seconds;
+    scheduleTimeout(requestDeadline_);
+  }
+
+  // 每次写出进展都把deadline往后推，只改字段，不动TimeoutWheel
+  void TcpConnection::updateWriteDeadline(bool wrote)
+  {
+    if (writeTimeout_ <= 0)
+    {
+      return;
+    }
+    if (outputBuffer_.readableBytes() == 0)
+    {
+      writeDeadline_ = 0;
+    }
+    else if (wrote || writeDeadline_ == 0)
+    {
+      writeDeadline_ = TimeoutWheel::now() + writeTimeout_;
+      scheduleTimeout(writeDeadline_);
+    }
+  }
+
+  // 已登记的条目不晚于deadline时不用再登记，到期时handleTimeout()会按当前deadline续上
+  void TcpConnection::scheduleTimeout(int64_t deadline)
+  {
+    if (timeoutArmedAt_ == 0 || deadline < timeoutArmedAt_)
+    {
+      timeoutArmedAt_ = deadline;
+      loop_->addTimeout(shared_from_this(), deadline);
+    }
+  }
+
+  void TcpConnection::handleTimeout(int64_t deadline)
+  {
+    loop_->assertInLoopThread();
+    if (deadline != timeoutArmedAt_)
+    {
+      return;  // 之后登记了更早的条目，由它负责
+    }
+    timeoutArmedAt_ = 0;
+    if (state_ != kConnected && state_ != kDisconnecting)
+    {
+      return;
+    }
+
+    int64_t now = TimeoutWheel::now();
+    if (writeDeadline_ != 0 && writeDeadline_ <= now)
+    {
+      LOG_WARN << "TcpConnection::handleTimeout [" << name() << "] - no write progress for "
+               << writeTimeout_ << "s, " << outputBuffer_.readableBytes()
+               << " bytes pending, force close";
+      forceClose();
+    }
+    else if (requestDeadline_ != 0 && requestDeadline_ <= now)
+    {
+      LOG_WARN << "TcpConnection::handleTimeout [" << name() << "] - request timeout, force close";
+      forceClose();
+    }
+    else
+    {
+      int64_t next = writeDeadline_;
+      if (next == 0 || (requestDeadline_ != 0 && requestDeadline_ < next))
+        next = requestDeadline_;
+      if (next != 0)
+        scheduleTimeout(next);
+    }
+  }
+
+  void TcpConnection::wakeReadWaiter()
+  {
+    if (readWaiter_)
+    {
+      WaiterFunc fn = readWaiter_;
+      readWaiter_ = nullptr;
+      fn(readWaiterArg_);
+    }
+  }
+
+  void TcpConnection::wakeDrainWaiter()
+  {
+    if (drainWaiter_)
+    {
+      WaiterFunc fn = drainWaiter_;
+      drainWaiter_ = nullptr;
+      fn(drainWaiterArg_);
+    }
+  }
+
   void TcpConnection::handleError()
   {
     int err = Socket::getSocketError(channel_->fd());
-    std::cout << "TcpConnection::handleError [" << name_
-            << "] - SO_ERROR = " << err << std::endl;
+    LOG_ERROR << "TcpConnection::handleError [" << name()
+              << "] - SO_ERROR = " << err << " " << strerror_tl(err);
   }
 
 }
\ No newline at end of file
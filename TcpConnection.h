@@ -3,12 +3,17 @@
 
 #include <memory>
 #include <string>
+#include <string.h>
 
 #include "base/noncopyable.h"
 #include "Callbacks.h"
+#include "ComputePool.h"
+#include "ConnectionContext.h"
 #include "buffer/Buffer.h"
 #include "InetAddress.h"
 #include "base/any.h"
+#include "Coroutine.h"
+#include "codec/ByteScan.h"
 
 using namespace base;
 
@@ -30,10 +35,20 @@ namespace mutty
                   int sockfd,
                   const InetAddress& localAddr,
                   const InetAddress& peerAddr);
+    /// name() is formatted on first use as "<namePrefix>#<loop>.<slot>.<generation>"
+    TcpConnection(EventLoop* loop,
+                  const std::shared_ptr<const std::string>& namePrefix,
+                  int sockfd,
+                  const InetAddress& localAddr,
+                  const InetAddress& peerAddr);
     ~TcpConnection();
 
     EventLoop* getLoop() const { return loop_; }
-    const std::string& name() const { return name_; }
+    /// Formatted lazily for server connections: call in loop thread,
+    /// or anywhere once it has been called.
+    const std::string& name() const;
+    /// Unique within its TcpServer, 0 for client connections
+    uint64_t id() const { return id_; }
     const InetAddress& localAddress() const { return localAddr_; }
     const InetAddress& peerAddress() const { return peerAddr_; }
     bool connected() const { return state_ == kConnected; }
@@ -48,6 +63,11 @@ namespace mutty
     // void shutdownAndForceCloseAfter(double seconds); // NOT thread safe, no simultaneous calling
     void forceClose();
     void setTcpNoDelay(bool on);
+    /// Batched flush: sends in the loop thread only append to the output
+    /// buffer, the loop writes it once after this iteration's events.
+    /// Set before connectEstablished(), default off.
+    void setBatchedFlush(bool on) { batchedFlush_ = on; }
+    bool batchedFlush() const { return batchedFlush_; }
     // reading or not
     // void startRead();
     // void stopRead();
@@ -62,6 +82,24 @@ namespace mutty
     any* getMutableContext()
     { return &context_; }
 
+    /// Typed context without base::any: constructed inline in the connection
+    /// when sizeof(T) <= MUTTY_CONTEXT_INLINE_SIZE, replaces the previous one.
+    template <typename T, typename... Args>
+    T* emplaceContext(Args&&... args)
+    { return typedContext_.emplace<T>(std::forward<Args>(args)...); }
+
+    /// Typed context taken from this loop's ContextPool<T>, returned to it in
+    /// connectDestroyed() (context<T>() is null afterwards) and reset() there
+    /// before the next connection gets it. T needs reset(). Call in loop thread.
+    template <typename T>
+    T* acquireContext()
+    { return typedContext_.acquire<T>(ContextPool<T>::local()); }
+
+    /// No type check in release builds, T must match emplaceContext/acquireContext.
+    template <typename T>
+    T* context() const
+    { return typedContext_.get<T>(); }
+
     void setConnectionCallback(const ConnectionCallback& cb)
     { connectionCallback_ = cb; }
 
@@ -85,10 +123,65 @@ namespace mutty
     void setCloseCallback(const CloseCallback& cb)
     { closeCallback_ = cb; }
 
+    /// Internal use only, set by TcpServer before connectEstablished().
+    void setId(uint64_t id) { id_ = id; }
+
+    /// Force close when output is pending but no byte has been written for
+    /// seconds, e.g. the peer stopped reading. 0 disables (default).
+    /// Set before connectEstablished() or in loop thread.
+    void setWriteTimeout(int seconds) { writeTimeout_ = seconds; }
+    /// Force close unless cancelRequestTimeout() is called within seconds,
+    /// calling it again restarts the deadline. Loop thread only.
+    void startRequestTimeout(int seconds);
+    void cancelRequestTimeout() { requestDeadline_ = 0; }
+
+    /// Pool for offload(), nullptr runs the work inline.
+    void setComputePool(ComputePool* pool) { computePool_ = pool; }
+    ComputePool* computePool() const { return computePool_; }
+    /// inputBuffer_/outputBuffer_以后从allocator分配，nullptr为默认的全局实例。
+    /// Not owned. Call before connectEstablished() or in loop thread.
+    void setAllocator(buffer::PooledByteBufAllocator* allocator)
+    {
+      inputBuffer_.setAllocator(allocator);
+      outputBuffer_.setAllocator(allocator);
+    }
+    buffer::PooledByteBufAllocator* allocator() const { return inputBuffer_.allocator(); }
+    /// Runs fn on the ComputePool, then(cb) calls cb(result) back in this
+    /// connection's loop thread. The connection is kept alive until then.
+    template <typename F>
+    Offload<typename std::decay<F>::type> offload(F&& fn)
+    {
+      return Offload<typename std::decay<F>::type>(
+          computePool_, loop_, shared_from_this(), std::forward<F>(fn));
+    }
+
+    /// Low-level hooks for the awaiters in Coroutine.h, called in loop thread.
+    /// A read waiter replaces messageCallback_ for the next read, a drain
+    /// waiter fires when outputBuffer_ empties; both also fire on close.
+    /// They are one-shot: cleared before the call, re-arm to keep waiting.
+    typedef void (*WaiterFunc)(void* arg);
+    void setReadWaiter(WaiterFunc fn, void* arg)
+    { readWaiter_ = fn; readWaiterArg_ = arg; }
+    void setDrainWaiter(WaiterFunc fn, void* arg)
+    { drainWaiter_ = fn; drainWaiterArg_ = arg; }
+
+  #ifdef MUTTY_HAS_COROUTINES
+    ReadAwaiter read(size_t n)
+    { return ReadAwaiter(this, n); }
+    ReadUntilAwaiter readUntil(const char* delim)
+    { return ReadUntilAwaiter(this, delim, strlen(delim)); }
+    DrainAwaiter drain()
+    { return DrainAwaiter(this); }
+  #endif
+
     // called when TcpServer accepts a new connection
     void connectEstablished();   // should be called only once
     // called when TcpServer has removed me from its map
     void connectDestroyed();  // should be called only once
+    // called by EventLoop after event handling, see setBatchedFlush()
+    void flushInLoop();
+    // called by TimeoutWheel
+    void handleTimeout(int64_t deadline);
 
   private:
     enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
@@ -96,21 +189,30 @@ namespace mutty
     void handleWrite();
     void handleClose();
     void handleError();
+    void queueWriteComplete();
     // void sendInLoop(string&& message);
     void sendInLoop(const std::string& message);
     void sendInLoop(const void* message, size_t len);
     void shutdownInLoop();
     // void shutdownAndForceCloseInLoop(double seconds);
     void forceCloseInLoop();
+    void wakeReadWaiter();
+    void wakeDrainWaiter();
+    void updateWriteDeadline(bool wrote);
+    void scheduleTimeout(int64_t deadline);
     // void startReadInLoop();
     // void stopReadInLoop();
 
     const char* stateToString() const;
 
     EventLoop* loop_;
-    const std::string name_;
+    uint64_t id_;
+    mutable std::string name_;
+    std::shared_ptr<const std::string> namePrefix_;
     StateE state_;  // FIXME: use atomic variable
     bool reading_;
+    bool batchedFlush_;
+    bool flushPending_;   // already queued in loop_->queueFlush()
     // we don't expose those classes to client.
     std::unique_ptr<Socket> socket_;
     std::unique_ptr<Channel> channel_;
@@ -121,16 +223,134 @@ namespace mutty
     WriteCompleteCallback writeCompleteCallback_;
     HighWaterMarkCallback highWaterMarkCallback_;
     CloseCallback closeCallback_;
+    WaiterFunc readWaiter_;
+    void* readWaiterArg_;
+    WaiterFunc drainWaiter_;
+    void* drainWaiterArg_;
     size_t highWaterMark_;
+    // 超时，deadline是TimeoutWheel::now()的秒数，0表示没有
+    int writeTimeout_;
+    int64_t writeDeadline_;    // outputBuffer_非空时，最后一次写出进展 + writeTimeout_
+    int64_t requestDeadline_;
+    int64_t timeoutArmedAt_;   // 已登记到TimeoutWheel的最早deadline
+    ComputePool* computePool_;
     buffer::Buffer inputBuffer_;
     buffer::Buffer outputBuffer_; // FIXME: use list<Buffer> as output buffer.
     any context_;
+    ConnectionContext typedContext_;
     // FIXME: creationTime_, lastReceiveTime_
     //        bytesReceived_, bytesSent_
   };
 
   typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
 
+  inline TcpConnectionPtr TcpConnectionRef::lock() const
+  {
+    return conn_->shared_from_this();
+  }
+
+#ifdef MUTTY_HAS_COROUTINES
+  inline bool ReadAwaiter::await_ready() const
+  {
+    return static_cast<size_t>(conn_->inputBuffer()->readableBytes()) >= n_ || conn_->disconnected();
+  }
+
+  inline void ReadAwaiter::await_suspend(std::coroutine_handle<> h)
+  {
+    handle_ = h;
+    conn_->setReadWaiter(&ReadAwaiter::onReadable, this);
+  }
+
+  inline buffer::PooledSlicedByteBuf ReadAwaiter::await_resume()
+  {
+    if (static_cast<size_t>(conn_->inputBuffer()->readableBytes()) < n_)
+    {
+      return buffer::PooledSlicedByteBuf();
+    }
+    return conn_->inputBuffer()->readRetainedSlice(static_cast<int>(n_));
+  }
+
+  inline void ReadAwaiter::onReadable(void* arg)
+  {
+    ReadAwaiter* self = static_cast<ReadAwaiter*>(arg);
+    if (self->await_ready())
+      self->handle_.resume();
+    else
+      self->conn_->setReadWaiter(&ReadAwaiter::onReadable, self);
+  }
+
+  inline bool ReadUntilAwaiter::search()
+  {
+    buffer::Buffer* buf = conn_->inputBuffer();
+    size_t readable = static_cast<size_t>(buf->readableBytes());
+    if (readable < delimLen_)
+    {
+      return false;
+    }
+    const char* begin = buf->peek();
+    const char* end = begin + readable;
+    const char* found = delimLen_ == 2 && delim_[0] == '\r' && delim_[1] == '\n'
+        ? buffer::findCRLF(begin + scanned_, end)
+        : codec::findDelimiter(begin + scanned_, end, delim_, delimLen_);
+    if (found != NULL)
+    {
+      found_ = found;
+      return true;
+    }
+    // 末尾可能是分隔符的前半部分，留到下次再找
+    scanned_ = readable - delimLen_ + 1;
+    return false;
+  }
+
+  inline bool ReadUntilAwaiter::await_ready()
+  {
+    return search() || conn_->disconnected();
+  }
+
+  inline void ReadUntilAwaiter::await_suspend(std::coroutine_handle<> h)
+  {
+    handle_ = h;
+    conn_->setReadWaiter(&ReadUntilAwaiter::onReadable, this);
+  }
+
+  inline buffer::PooledSlicedByteBuf ReadUntilAwaiter::await_resume()
+  {
+    if (found_ == nullptr)
+    {
+      return buffer::PooledSlicedByteBuf();
+    }
+    buffer::Buffer* buf = conn_->inputBuffer();
+    buffer::PooledSlicedByteBuf result = buf->readRetainedSlice(static_cast<int>(found_ - buf->peek()));
+    buf->retrieve(delimLen_);
+    return result;
+  }
+
+  inline void ReadUntilAwaiter::onReadable(void* arg)
+  {
+    ReadUntilAwaiter* self = static_cast<ReadUntilAwaiter*>(arg);
+    if (self->await_ready())
+      self->handle_.resume();
+    else
+      self->conn_->setReadWaiter(&ReadUntilAwaiter::onReadable, self);
+  }
+
+  inline bool DrainAwaiter::await_ready() const
+  {
+    return conn_->outputBuffer()->readableBytes() == 0 || conn_->disconnected();
+  }
+
+  inline void DrainAwaiter::await_suspend(std::coroutine_handle<> h)
+  {
+    handle_ = h;
+    conn_->setDrainWaiter(&DrainAwaiter::onDrained, this);
+  }
+
+  inline void DrainAwaiter::onDrained(void* arg)
+  {
+    static_cast<DrainAwaiter*>(arg)->handle_.resume();
+  }
+#endif
+
 }  // namespace mutty
 
 #endif  // MUTTY_TCPCONNECTION_H
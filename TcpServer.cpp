@@ -1,5 +1,6 @@
-#include <iostream>
-#include <stdio.h>  // snprintf
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "TcpServer.h"
 #include "Acceptor.h"
@@ -7,6 +8,7 @@
 #include "buffer/Buffer.h"
 #include "EventLoopThreadPool.h"
 #include "Socket.h"
+#include "base/Logging.h"
 
 
 using namespace std::placeholders;
@@ -16,10 +18,10 @@ namespace mutty{
   {
   }
 
-  void defaultMessageCallback(const TcpConnectionPtr&, buffer::Buffer* buf)
+  void defaultMessageCallback(const TcpConnectionRef&, buffer::Buffer* buf)
   {
-    std::cout << "unhandled recv message [" << buf->readableBytes()
-            << " bytes]";
+    LOG_DEBUG << "unhandled recv message [" << buf->readableBytes()
+              << " bytes]";
     buf->retrieveAll();
   }
 
@@ -31,9 +33,25 @@ namespace mutty{
       ipPort_(listenAddr.toIpPort()),
       acceptor_(new Acceptor(loop, listenAddr, reUsePort)),
       name_(nameArg),
+      connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + listenAddr.toIpPort())),
+      nextLoop_(0),
+      started_(false),
       connectionCallback_(defaultConnectionCallback),
       messageCallback_(defaultMessageCallback),
-      nextConnId_(1)
+      batchedFlush_(false),
+      writeTimeout_(0),
+      computePool_(nullptr),
+      allocator_(nullptr),
+      maxConnections_(0),
+      maxConnectionsPerLoop_(0),
+      maxConnectionsPerIp_(0),
+      overloadPolicy_(kReject),
+      rejectedByMaxConnections_(0),
+      rejectedByMaxConnectionsPerLoop_(0),
+      rejectedByMaxConnectionsPerIp_(0),
+      acceptPauses_(0),
+      numConnections_(0),
+      acceptPaused_(false)
   {
     acceptor_->setNewConnectionCallback(
         std::bind(&TcpServer::newConnection, this, _1, _2));
@@ -43,79 +61,218 @@ namespace mutty{
   {
     loop_->assertInLoopThread();
     acceptor_.reset();
-    for (auto& item : connections_)
+    for (size_t i = 0; i < registries_.size(); ++i)
     {
-      TcpConnectionPtr conn(item.second);
-      item.second.reset();
-      conn->getLoop()->runInLoop(
-        std::bind(&TcpConnection::connectDestroyed, conn));
+      std::shared_ptr<ConnectionRegistry> registry = registries_[i];
+      ioLoops_[i]->runInLoop([registry] {
+        // connectDestroyed()不会再回调removeConnection()
+        registry->forEach([](const TcpConnectionPtr& conn) { conn->connectDestroyed(); });
+        registry->clear();
+      });
     }
     threadPool_.reset();
   }
 
   void TcpServer::start()
   {
-    static std::once_flag flag;
-    std::call_once(flag, [this] {
-      threadPool_->start();
-
-      loop_->runInLoop(
-          std::bind(&Acceptor::listen, acceptor_.get()));
-    });
+    if (started_.exchange(true))
+      return;
+    loop_->assertInLoopThread();
+    if (threadPool_)
+    {
+      ioLoops_ = threadPool_->getAllLoops();
+    }
+    else
+    {
+      ioLoops_.push_back(loop_);
+    }
+    assert(ioLoops_.size() <= 0xffff);
+    for (size_t i = 0; i < ioLoops_.size(); ++i)
+    {
+      registries_.push_back(std::make_shared<ConnectionRegistry>(static_cast<uint32_t>(i)));
+    }
+    loop_->runInLoop(
+        std::bind(&Acceptor::listen, acceptor_.get()));
   }
   // 非线程安全，只能在本线程调用
-  // 新连接到达时Acceptor回调
+  // 新连接到达时Acceptor回调，这里只做准入判断和选loop，连接在IO loop里建立
   void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
   {
-    std::cout << "new connection:fd=" << sockfd
-              << " address=" << peerAddr.toIpPort();
-
     loop_->assertInLoopThread();
-    EventLoop *ioLoop = nullptr;
-    if (threadPool_ && threadPool_->size() > 0)
+    if (maxConnections_ > 0 && numConnections_.load() >= maxConnections_)
+    {
+      reject(sockfd, peerAddr, &rejectedByMaxConnections_);
+      return;
+    }
+    std::string ip;
+    if (maxConnectionsPerIp_ > 0)
+    {
+      ip = peerAddr.toIp();
+      auto it = ipConnections_.find(ip);
+      if (it != ipConnections_.end() && it->second >= maxConnectionsPerIp_)
+      {
+        reject(sockfd, peerAddr, &rejectedByMaxConnectionsPerIp_);
+        return;
+      }
+    }
+    int index = selectIoLoop();
+    if (index < 0)
+    {
+      reject(sockfd, peerAddr, &rejectedByMaxConnectionsPerLoop_);
+      return;
+    }
+    registries_[index]->addLoad(1);
+    numConnections_.fetch_add(1);
+    if (maxConnectionsPerIp_ > 0)
+    {
+      ++ipConnections_[ip];
+    }
+
+    LOG_DEBUG << "TcpServer::newConnection [" << name_
+              << "] - new connection from " << peerAddr.toIpPort();
+    ioLoops_[index]->runInLoop(
+        std::bind(&TcpServer::newConnectionInLoop, this, index, sockfd, peerAddr));
+
+    if (overloadPolicy_ == kPauseAccept && !acceptor_->paused() && overloaded())
     {
-        ioLoop = threadPool_->getNextLoop();
+      acceptor_->pause();
+      acceptPauses_.store(acceptPauses_.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+      LOG_WARN << "TcpServer::newConnection [" << name_ << "] - "
+               << numConnections_.load() << " connections, pause accepting";
+      // 先置标志再检查：IO loop先减计数再看标志，两边至少有一方看到对方
+      acceptPaused_.store(true);
+      resumeAcceptIfNeeded();
     }
-    if (ioLoop == nullptr)
-        ioLoop = loop_;
-    char buf[64];
-    snprintf(buf, sizeof(buf), "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+  }
 
-    // std::cout << "TcpServer::newConnection [" << name_
-    //         << "] - new connection [" << connName
-    //         << "] from " << peerAddr.toIpPort();
+  void TcpServer::newConnectionInLoop(size_t loopIndex, int sockfd, const InetAddress& peerAddr)
+  {
+    EventLoop* ioLoop = ioLoops_[loopIndex];
+    ioLoop->assertInLoopThread();
     TcpConnectionPtr conn(
-              new TcpConnection(ioLoop, connName, sockfd, InetAddress(Socket::getLocalAddr(sockfd)), peerAddr)
+              new TcpConnection(ioLoop, connNamePrefix_, sockfd, InetAddress(Socket::getLocalAddr(sockfd)), peerAddr)
               );
-
-    connections_[connName] = conn;
+    conn->setId(registries_[loopIndex]->insert(conn));
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setBatchedFlush(batchedFlush_);
+    conn->setWriteTimeout(writeTimeout_);
+    conn->setComputePool(computePool_);
+    conn->setAllocator(allocator_);
     conn->setCloseCallback(
         std::bind(&TcpServer::removeConnection, this, _1)); // FIXME: unsafe
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    conn->connectEstablished();
   }
 
+  int TcpServer::selectIoLoop()
+  {
+    // 从round-robin的下一个开始，最多看一圈
+    for (size_t i = 0; i < ioLoops_.size(); ++i)
+    {
+      size_t index = nextLoop_;
+      nextLoop_ = (nextLoop_ + 1) % ioLoops_.size();
+      if (maxConnectionsPerLoop_ == 0 || registries_[index]->load() < maxConnectionsPerLoop_)
+        return static_cast<int>(index);
+    }
+    return -1;
+  }
+
+  bool TcpServer::overloaded() const
+  {
+    if (maxConnections_ > 0 && numConnections_.load() >= maxConnections_)
+    {
+      return true;
+    }
+    if (maxConnectionsPerLoop_ > 0)
+    {
+      for (const auto& registry : registries_)
+      {
+        if (registry->load() < maxConnectionsPerLoop_)
+          return false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void TcpServer::reject(int sockfd, const InetAddress& peerAddr, std::atomic<uint64_t>* counter)
+  {
+    counter->store(counter->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    LOG_DEBUG << "TcpServer::newConnection [" << name_
+              << "] - reject connection from " << peerAddr.toIpPort();
+    ::close(sockfd);
+  }
+
+  TcpServer::AdmissionStats TcpServer::admissionStats() const
+  {
+    AdmissionStats stats;
+    stats.rejectedByMaxConnections = rejectedByMaxConnections_.load(std::memory_order_relaxed);
+    stats.rejectedByMaxConnectionsPerLoop = rejectedByMaxConnectionsPerLoop_.load(std::memory_order_relaxed);
+    stats.rejectedByMaxConnectionsPerIp = rejectedByMaxConnectionsPerIp_.load(std::memory_order_relaxed);
+    stats.acceptPauses = acceptPauses_.load(std::memory_order_relaxed);
+    stats.connections = numConnections_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  EventLoop* TcpServer::getLoopOf(uint64_t id) const
+  {
+    size_t index = ConnectionRegistry::loopIndexOf(id);
+    return index < ioLoops_.size() ? ioLoops_[index] : nullptr;
+  }
+
+  TcpConnectionPtr TcpServer::findConnection(uint64_t id) const
+  {
+    size_t index = ConnectionRegistry::loopIndexOf(id);
+    if (index >= registries_.size())
+      return TcpConnectionPtr();
+    ioLoops_[index]->assertInLoopThread();
+    return registries_[index]->find(id);
+  }
+
+  // 在连接所在的IO loop里调用
   void TcpServer::removeConnection(const TcpConnectionPtr& conn)
   {
-    std::cout << "connectionClosed";
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    LOG_DEBUG << "TcpServer::removeConnection [" << name_
+              << "] - connection " << conn->name();
+    size_t index = ConnectionRegistry::loopIndexOf(conn->id());
+    conn->getLoop()->assertInLoopThread();
+    bool erased = registries_[index]->erase(conn->id());
+    (void)erased;
+    assert(erased);
+    registries_[index]->addLoad(-1);
+    numConnections_.fetch_sub(1);
+    if (maxConnectionsPerIp_ > 0)
+    {
+      loop_->runInLoop(std::bind(&TcpServer::releaseIp, this, conn->peerAddress().toIp()));
+    }
+    if (acceptPaused_.load())
+    {
+      loop_->runInLoop(std::bind(&TcpServer::resumeAcceptIfNeeded, this));
+    }
     //在channel->handlevent后shared_ptr变成weak_ptr引用计数减一，故在此之前要添加一个引用计数
-    static_cast<TcpConnection *>(conn.get())->connectDestroyed(); // ?
+    conn->connectDestroyed();
+  }
+
+  void TcpServer::releaseIp(const std::string& ip)
+  {
+    loop_->assertInLoopThread();
+    auto it = ipConnections_.find(ip);
+    if (it != ipConnections_.end() && --it->second == 0)
+    {
+      ipConnections_.erase(it);
+    }
   }
 
-  void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn)
+  void TcpServer::resumeAcceptIfNeeded()
   {
     loop_->assertInLoopThread();
-    //因为channel中还有一个由weak_ptr升级的shared_ptr所以删除这个conn的引用计数也不会变成0
-    size_t n = connections_.erase(conn->name());
-    (void)n;
-    assert(n == 1);
-    EventLoop* ioLoop = conn->getLoop();
-    // ioLoop->queueInLoop(
-    //     std::bind(&TcpConnection::connectDestroyed, conn));
+    if (acceptor_ && acceptor_->paused() && !overloaded())
+    {
+      LOG_INFO << "TcpServer [" << name_ << "] - resume accepting";
+      acceptPaused_.store(false);
+      acceptor_->resume();
+    }
   }
 }
@@ -2,8 +2,10 @@
 #define MUTTY_TCPSERVER_H
 
 #include <atomic>
-#include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
+#include "ConnectionRegistry.h"
 #include "TcpConnection.h"
 #include "EventLoopThreadPool.h"
 
@@ -16,6 +18,22 @@ namespace mutty
 
   class TcpServer : public noncopyable {
   public:
+    /// 超过连接数上限时的处理
+    enum OverloadPolicy
+    {
+      kReject,       // 接受后立即关闭
+      kPauseAccept,  // 到达上限时停止accept，有连接断开后恢复；新连接在内核backlog里等待
+    };
+
+    /// 被拒绝的连接数，任意线程可读
+    struct AdmissionStats
+    {
+      uint64_t rejectedByMaxConnections;
+      uint64_t rejectedByMaxConnectionsPerLoop;
+      uint64_t rejectedByMaxConnectionsPerIp;
+      uint64_t acceptPauses;  // kPauseAccept下暂停accept的次数
+      size_t connections;     // 当前连接数
+    };
 
     TcpServer(EventLoop* loop,
               const InetAddress& listenAddr,
@@ -50,27 +68,100 @@ namespace mutty
     void setWriteCompleteCallback(const WriteCompleteCallback& cb)
     { writeCompleteCallback_ = cb; }
 
-  private:
+    /// Coalesce sends of one loop iteration into a single write per connection.
+    /// Applies to connections accepted afterwards. Not thread safe.
+    void setBatchedFlush(bool on)
+    { batchedFlush_ = on; }
+
+    /// See TcpConnection::setWriteTimeout(), applies to connections accepted
+    /// afterwards. Not thread safe.
+    void setWriteTimeout(int seconds)
+    { writeTimeout_ = seconds; }
+
+    /// Pool for TcpConnection::offload(), applies to connections accepted
+    /// afterwards. Not owned. Not thread safe.
+    void setComputePool(ComputePool* pool)
+    { computePool_ = pool; }
+
+    /// Buffer pool for connections accepted afterwards, see
+    /// PooledByteBufAllocator::Builder. Null (default) is the process-wide
+    /// PooledByteBufAllocator::ALLOCATOR(). Not owned; allocators live for the
+    /// whole process, so build one at startup and share it. Not thread safe.
+    void setAllocator(buffer::PooledByteBufAllocator* allocator)
+    { allocator_ = allocator; }
+    buffer::PooledByteBufAllocator* allocator() const { return allocator_; }
+
+    /// Admission control, 0 means unlimited (default).
+    /// Not thread safe, call before start().
+    void setMaxConnections(size_t n)
+    { maxConnections_ = n; }
+    /// 每个IO loop的上限，新连接按round-robin找第一个未满的loop
+    void setMaxConnectionsPerLoop(size_t n)
+    { maxConnectionsPerLoop_ = n; }
+    /// 同一来源IP的上限，超过时总是直接关闭，不会暂停accept
+    void setMaxConnectionsPerIp(size_t n)
+    { maxConnectionsPerIp_ = n; }
+    void setOverloadPolicy(OverloadPolicy policy)
+    { overloadPolicy_ = policy; }
+
     /// Thread safe.
-    void removeConnection(const TcpConnectionPtr& conn);
-    /// Not thread safe, but in loop
-    void removeConnectionInLoop(const TcpConnectionPtr& conn);
+    AdmissionStats admissionStats() const;
 
-    typedef std::map<std::string, TcpConnectionPtr> ConnectionMap;
+    /// The loop owning connection id, valid after start(). Thread safe.
+    EventLoop* getLoopOf(uint64_t id) const;
+    /// Call in getLoopOf(id)'s thread, null if it is gone.
+    TcpConnectionPtr findConnection(uint64_t id) const;
+
+  private:
+    /// 连接所在的IO loop线程
+    void newConnectionInLoop(size_t loopIndex, int sockfd, const InetAddress& peerAddr);
+    void removeConnection(const TcpConnectionPtr& conn);
+    /// acceptor loop
+    void releaseIp(const std::string& ip);
+    void resumeAcceptIfNeeded();
+    /// 选一个未满的IO loop，返回下标，都满了返回-1
+    int selectIoLoop();
+    bool overloaded() const;
+    void reject(int sockfd, const InetAddress& peerAddr, std::atomic<uint64_t>* counter);
 
     EventLoop* loop_;  // the acceptor loop
     std::unique_ptr<Acceptor> acceptor_; // avoid revealing Acceptor
     void newConnection(int sockfd, const InetAddress& peerAddr);
     const std::string name_;
     const std::string ipPort_;
-    ConnectionMap connections_; // 该服务器建立的所有连接
+    // 连接名的公共前缀"name-ip:port"，连接名用到时才格式化
+    std::shared_ptr<const std::string> connNamePrefix_;
+    // start()时确定，之后不变；registries_[i]只在ioLoops_[i]线程访问(load除外)，
+    // 连接的建立和断开都在各自的IO loop里完成，不经过acceptor loop
+    std::vector<EventLoop*> ioLoops_;
+    std::vector<std::shared_ptr<ConnectionRegistry>> registries_;
+    size_t nextLoop_;  // round-robin，只在acceptor loop访问
+    std::atomic<bool> started_;
 
     MessageCallback messageCallback_;
     ConnectionCallback connectionCallback_;
     WriteCompleteCallback writeCompleteCallback_;
-    // always in loop thread
-    int nextConnId_; //下一个连接ID
+    bool batchedFlush_;
+    int writeTimeout_;
+    ComputePool* computePool_;
+    buffer::PooledByteBufAllocator* allocator_;
     std::shared_ptr<EventLoopThreadPool> threadPool_;
+
+    size_t maxConnections_;
+    size_t maxConnectionsPerLoop_;
+    size_t maxConnectionsPerIp_;
+    OverloadPolicy overloadPolicy_;
+    // 只在loop_线程访问，只在设置了maxConnectionsPerIp_时维护
+    std::unordered_map<std::string, size_t> ipConnections_;
+    // 单写者，其它线程relaxed读
+    std::atomic<uint64_t> rejectedByMaxConnections_;
+    std::atomic<uint64_t> rejectedByMaxConnectionsPerLoop_;
+    std::atomic<uint64_t> rejectedByMaxConnectionsPerIp_;
+    std::atomic<uint64_t> acceptPauses_;
+    // acceptor loop接受时加，IO loop断开时减
+    std::atomic<size_t> numConnections_;
+    // kPauseAccept下accept已暂停，IO loop断开连接时据此通知acceptor loop
+    std::atomic<bool> acceptPaused_;
   };
 
 }  // namespace mutty
@@ -0,0 +1,140 @@
+#include "TimeoutWheel.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "base/Logging.h"
+
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace mutty {
+
+  namespace
+  {
+  int createTimerfd()
+  {
+    int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+    {
+      LOG_SYSFATAL << "Failed in timerfd_create";
+    }
+    return fd;
+  }
+  }  // namespace
+
+  TimeoutWheel::TimeoutWheel(EventLoop* loop)
+    : loop_(loop),
+      timerfd_(createTimerfd()),
+      timerChannel_(loop, timerfd_),
+      size_(0),
+      lastTick_(now()),
+      armed_(false)
+  {
+    timerChannel_.setKind(Channel::kTimer);
+    timerChannel_.setReadCallback(std::bind(&TimeoutWheel::handleRead, this));
+    timerChannel_.enableReading();
+  }
+
+  TimeoutWheel::~TimeoutWheel()
+  {
+    timerChannel_.disableAll();
+    timerChannel_.remove();
+    ::close(timerfd_);
+  }
+
+  int64_t TimeoutWheel::now()
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec;
+  }
+
+  void TimeoutWheel::add(const std::weak_ptr<TcpConnection>& conn, int64_t deadline)
+  {
+    loop_->assertInLoopThread();
+    if (!armed_)
+    {
+      // 停表期间没有条目，直接跳到当前时间
+      lastTick_ = now();
+      arm();
+    }
+    // 已经过期的放到下一个tick
+    if (deadline <= lastTick_)
+    {
+      deadline = lastTick_ + 1;
+    }
+    buckets_[deadline % kBuckets].push_back(Entry{conn, deadline});
+    ++size_;
+  }
+
+  void TimeoutWheel::handleRead()
+  {
+    loop_->assertInLoopThread();
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof howmany);
+    if (n != sizeof howmany)
+    {
+      LOG_SYSERR << "TimeoutWheel::handleRead reads " << n << " bytes";
+    }
+
+    int64_t current = now();
+    int64_t last = lastTick_;
+    // 落后超过一圈时每个桶只需要扫一次
+    int64_t ticks = std::min<int64_t>(current - last, kBuckets);
+    lastTick_ = current;
+    std::vector<Entry> expired;
+    for (int64_t i = 1; i <= ticks; ++i)
+    {
+      std::vector<Entry>& bucket = buckets_[(last + i) % kBuckets];
+      size_t keep = 0;
+      for (size_t j = 0; j < bucket.size(); ++j)
+      {
+        if (bucket[j].deadline <= current)
+          expired.push_back(std::move(bucket[j]));
+        else
+          bucket[keep++] = std::move(bucket[j]);  // 后面的圈
+      }
+      bucket.resize(keep);
+    }
+    size_ -= expired.size();
+
+    // 回调里可能再add()，先从桶里摘出来再调用
+    for (const Entry& entry : expired)
+    {
+      TcpConnectionPtr conn(entry.conn.lock());
+      if (conn)
+      {
+        conn->handleTimeout(entry.deadline);
+      }
+    }
+    if (size_ == 0)
+    {
+      disarm();
+    }
+  }
+
+  void TimeoutWheel::arm()
+  {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof spec);
+    spec.it_value.tv_sec = 1;
+    spec.it_interval.tv_sec = 1;
+    if (::timerfd_settime(timerfd_, 0, &spec, NULL) < 0)
+    {
+      LOG_SYSERR << "TimeoutWheel::arm timerfd_settime";
+    }
+    armed_ = true;
+  }
+
+  void TimeoutWheel::disarm()
+  {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof spec);
+    ::timerfd_settime(timerfd_, 0, &spec, NULL);
+    armed_ = false;
+  }
+
+}  // namespace mutty
@@ -0,0 +1,58 @@
+#ifndef MUTTY_TIMEOUTWHEEL_H
+#define MUTTY_TIMEOUTWHEEL_H
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "Channel.h"
+#include "base/noncopyable.h"
+
+namespace mutty {
+
+  class EventLoop;
+  class TcpConnection;
+
+  ///
+  /// 每个EventLoop一个的秒级时间轮，给TcpConnection的超时用。
+  ///
+  /// 由timerfd每秒驱动，只在loop线程访问，不加锁。条目只保存weak_ptr和
+  /// 到期时间，连接的deadline推后时不去修改轮子，到期时由
+  /// TcpConnection::handleTimeout()重新检查，需要的话再登记一次。
+  /// 轮子为空时停掉timerfd。
+  class TimeoutWheel : noncopyable
+  {
+  public:
+    explicit TimeoutWheel(EventLoop* loop);
+    ~TimeoutWheel();
+
+    /// CLOCK_MONOTONIC_COARSE的秒数，deadline都用它表示
+    static int64_t now();
+
+    /// 在deadline(秒)之后调用conn->handleTimeout(deadline)，精度1秒
+    void add(const std::weak_ptr<TcpConnection>& conn, int64_t deadline);
+
+  private:
+    struct Entry
+    {
+      std::weak_ptr<TcpConnection> conn;
+      int64_t deadline;
+    };
+    static const int kBuckets = 64;  // 超过64秒的条目按圈数留在桶里
+
+    void handleRead();
+    void arm();
+    void disarm();
+
+    EventLoop* loop_;
+    const int timerfd_;
+    Channel timerChannel_;
+    std::vector<Entry> buckets_[kBuckets];
+    size_t size_;
+    int64_t lastTick_;  // 已经处理到的秒
+    bool armed_;
+  };
+
+}  // namespace mutty
+
+#endif  // MUTTY_TIMEOUTWHEEL_H
@@ -0,0 +1,253 @@
+#include "AsyncLogging.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace mutty
+{
+
+  namespace
+  {
+  std::atomic<size_t> g_nextLoggingId(0);
+
+  size_t roundUpPowerOfTwo(size_t n)
+  {
+    size_t size = 4096;
+    while (size < n)
+      size <<= 1;
+    return size;
+  }
+  }  // namespace
+
+  // 单生产者(所属线程)/单消费者(持有mutex_的线程)的字节环形缓冲
+  struct AsyncLogging::ThreadBuffer
+  {
+    explicit ThreadBuffer(size_t size)
+      : data(new char[size]),
+        capacity(size),
+        head(0),
+        tail(0),
+        closed(false)
+    {
+    }
+
+    std::unique_ptr<char[]> data;
+    const size_t capacity;      // 2的幂
+    std::atomic<size_t> head;   // 生产者写入位置，只增不减
+    std::atomic<size_t> tail;   // 消费者读取位置，只增不减
+    std::atomic<bool> closed;   // 所属线程已经退出
+  };
+
+  thread_local AsyncLogging::ThreadBufferList AsyncLogging::t_buffers;
+
+  AsyncLogging::ThreadBufferList::~ThreadBufferList()
+  {
+    for (const auto& buf : buffers)
+    {
+      if (buf)
+        buf->closed.store(true, std::memory_order_release);
+    }
+  }
+
+  AsyncLogging::AsyncLogging(int fd, int flushIntervalMs, size_t threadBufferSize)
+    : fd_(fd),
+      ownFd_(false),
+      flushIntervalMs_(flushIntervalMs),
+      threadBufferSize_(roundUpPowerOfTwo(threadBufferSize)),
+      id_(g_nextLoggingId++),
+      running_(false),
+      dropped_(0),
+      reportedDropped_(0)
+  {
+  }
+
+  AsyncLogging::AsyncLogging(const std::string& filename, int flushIntervalMs, size_t threadBufferSize)
+    : fd_(::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)),
+      ownFd_(true),
+      flushIntervalMs_(flushIntervalMs),
+      threadBufferSize_(roundUpPowerOfTwo(threadBufferSize)),
+      id_(g_nextLoggingId++),
+      running_(false),
+      dropped_(0),
+      reportedDropped_(0)
+  {
+    if (fd_ < 0)
+    {
+      fprintf(stderr, "AsyncLogging: open %s failed: %s\n", filename.c_str(), strerror(errno));
+      abort();
+    }
+  }
+
+  AsyncLogging::~AsyncLogging()
+  {
+    stop();
+    if (ownFd_)
+      ::close(fd_);
+  }
+
+  void AsyncLogging::start()
+  {
+    assert(!running_);
+    running_ = true;
+    // 后台线程不处理信号
+    sigset_t all, old;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_SETMASK, &all, &old);
+    thread_ = std::thread(&AsyncLogging::threadFunc, this);
+    ::pthread_sigmask(SIG_SETMASK, &old, NULL);
+  }
+
+  void AsyncLogging::stop()
+  {
+    if (running_.exchange(false))
+    {
+      cond_.notify_one();
+      thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    drainLocked();
+  }
+
+  void AsyncLogging::append(const char* logline, int len)
+  {
+    if (!running_.load(std::memory_order_acquire))
+    {
+      // 未启动或已停止，退化为同步写
+      writeFully(logline, len);
+      return;
+    }
+
+    ThreadBuffer* buf = threadBuffer();
+    size_t head = buf->head.load(std::memory_order_relaxed);
+    size_t tail = buf->tail.load(std::memory_order_acquire);
+    size_t used = head - tail;
+    size_t n = static_cast<size_t>(len);
+    if (buf->capacity - used < n)
+    {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      cond_.notify_one();
+      return;
+    }
+
+    size_t pos = head & (buf->capacity - 1);
+    size_t first = std::min(n, buf->capacity - pos);
+    memcpy(buf->data.get() + pos, logline, first);
+    memcpy(buf->data.get(), logline + first, n - first);
+    buf->head.store(head + n, std::memory_order_release);
+
+    // 刚过半时提前唤醒后台线程
+    size_t half = buf->capacity / 2;
+    if (used <= half && used + n > half)
+    {
+      cond_.notify_one();
+    }
+  }
+
+  void AsyncLogging::flush()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    drainLocked();
+  }
+
+  AsyncLogging::ThreadBuffer* AsyncLogging::threadBuffer()
+  {
+    std::vector<std::shared_ptr<ThreadBuffer>>& list = t_buffers.buffers;
+    if (id_ < list.size() && list[id_])
+    {
+      return list[id_].get();
+    }
+    // 每个线程第一次写这个AsyncLogging时注册，只有这里加锁
+    std::shared_ptr<ThreadBuffer> buf = std::make_shared<ThreadBuffer>(threadBufferSize_);
+    if (list.size() <= id_)
+      list.resize(id_ + 1);
+    list[id_] = buf;
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.push_back(buf);
+    return buf.get();
+  }
+
+  void AsyncLogging::threadFunc()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+      cond_.wait_for(lock, std::chrono::milliseconds(flushIntervalMs_));
+      drainLocked();
+    }
+  }
+
+  void AsyncLogging::drainLocked()
+  {
+    for (auto it = buffers_.begin(); it != buffers_.end(); )
+    {
+      ThreadBuffer* buf = it->get();
+      // 先读closed再读head，closed之后不会再有新数据
+      bool closed = buf->closed.load(std::memory_order_acquire);
+      size_t tail = buf->tail.load(std::memory_order_relaxed);
+      size_t head = buf->head.load(std::memory_order_acquire);
+      if (head != tail)
+      {
+        size_t len = head - tail;
+        size_t pos = tail & (buf->capacity - 1);
+        size_t first = std::min(len, buf->capacity - pos);
+        writeFully(buf->data.get() + pos, first);
+        if (len > first)
+          writeFully(buf->data.get(), len - first);
+        buf->tail.store(head, std::memory_order_release);
+      }
+      if (closed)
+        it = buffers_.erase(it);
+      else
+        ++it;
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped_)
+    {
+      char line[128];
+      int n = snprintf(line, sizeof line, "AsyncLogging: dropped %llu log lines\n",
+                       static_cast<unsigned long long>(dropped - reportedDropped_));
+      writeFully(line, n);
+      reportedDropped_ = dropped;
+    }
+  }
+
+  void AsyncLogging::writeFully(const char* data, size_t len)
+  {
+    while (len > 0)
+    {
+      ssize_t n = ::write(fd_, data, len);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        fprintf(stderr, "AsyncLogging::writeFully failed: %s\n", strerror(errno));
+        return;
+      }
+      data += n;
+      len -= n;
+    }
+  }
+
+  AsyncLogging& AsyncLogging::defaultLogging()
+  {
+    // 不析构，避免其它静态对象析构时写日志访问到已销毁的对象
+    static AsyncLogging* logging = [] {
+      AsyncLogging* p = new AsyncLogging(STDOUT_FILENO);
+      p->start();
+      ::atexit([] { AsyncLogging::defaultLogging().stop(); });
+      return p;
+    }();
+    return *logging;
+  }
+
+}  // namespace mutty
@@ -0,0 +1,82 @@
+#ifndef MUTTY_ASYNCLOGGING_H
+#define MUTTY_ASYNCLOGGING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace mutty
+{
+
+  ///
+  /// 异步日志后端
+  ///
+  /// 每个写日志的线程有自己的单生产者/单消费者环形缓冲，append()只做一次memcpy，
+  /// 不加锁也不进内核；后台线程按flushInterval或缓冲过半时把所有线程的缓冲写到fd。
+  /// 缓冲写满时丢弃该条日志并计数，不会阻塞调用线程。
+  ///
+  class AsyncLogging : noncopyable
+  {
+  public:
+    /// 不接管fd的所有权
+    explicit AsyncLogging(int fd,
+                          int flushIntervalMs = 1000,
+                          size_t threadBufferSize = 256 * 1024);
+    /// 以O_APPEND打开文件，析构时关闭
+    explicit AsyncLogging(const std::string& filename,
+                          int flushIntervalMs = 1000,
+                          size_t threadBufferSize = 256 * 1024);
+    ~AsyncLogging();
+
+    void start();
+    /// 停止后台线程并写出剩余日志，之后的append()直接同步写
+    void stop();
+
+    void append(const char* logline, int len);
+    /// 在调用线程里同步写出所有已提交的日志
+    void flush();
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    /// Logger默认输出，第一次使用时创建并启动，进程退出时(atexit)写出剩余日志
+    static AsyncLogging& defaultLogging();
+
+  private:
+    struct ThreadBuffer;
+    // 线程退出时把自己的缓冲标记为closed，由后台线程写完后回收
+    struct ThreadBufferList
+    {
+      std::vector<std::shared_ptr<ThreadBuffer>> buffers;  // 按AsyncLogging::id_索引
+      ~ThreadBufferList();
+    };
+    static thread_local ThreadBufferList t_buffers;
+
+    ThreadBuffer* threadBuffer();
+    void threadFunc();
+    void drainLocked();
+    void writeFully(const char* data, size_t len);
+
+    const int fd_;
+    const bool ownFd_;
+    const int flushIntervalMs_;
+    const size_t threadBufferSize_;
+    const size_t id_;  // 线程局部缓冲表的下标
+
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> dropped_;
+    uint64_t reportedDropped_;  // guarded by mutex_
+    std::mutex mutex_;  // 保护buffers_，同时保证同一时刻只有一个消费者
+    std::condition_variable cond_;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+    std::thread thread_;
+  };
+
+}  // namespace mutty
+
+#endif  // MUTTY_ASYNCLOGGING_H
@@ -1,10 +1,10 @@
 #include "EPollPoller.h"
 
 #include "../Channel.h"
+#include "Logging.h"
 
 #include <assert.h>
 #include <errno.h>
-#include <iostream>
 #include <poll.h>
 #include <sys/epoll.h>
 #include <unistd.h>
@@ -36,8 +36,7 @@ namespace mutty {
   {
     if (epollfd_ < 0)
     {
-      std::cerr << "EPollPoller::EPollPoller";
-      exit(1);
+      LOG_SYSFATAL << "EPollPoller::EPollPoller";
     }
   }
 
@@ -72,9 +71,7 @@ namespace mutty {
       if (savedErrno != EINTR)
       {
         errno = savedErrno;
-        // LOG_SYSERR << "EPollPoller::poll()";
-        std::cout << "EPollEpollPoller::poll()";
-        exit(1);
+        LOG_SYSFATAL << "EPollPoller::poll()";
       }
     }
   }
@@ -170,11 +167,11 @@ namespace mutty {
     {
       if (operation == EPOLL_CTL_DEL)
       {
-        // LOG_SYSERR << "epoll_ctl op =" << operationToString(operation) << " fd =" << fd;
+        LOG_SYSERR << "epoll_ctl op =" << operation << " fd =" << fd;
       }
       else
       {
-        // LOG_SYSFATAL << "epoll_ctl op =" << operationToString(operation) << " fd =" << fd;
+        LOG_SYSFATAL << "epoll_ctl op =" << operation << " fd =" << fd;
       }
     }
   }
@@ -0,0 +1,223 @@
+#include "Logging.h"
+#include "AsyncLogging.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace mutty
+{
+
+  namespace
+  {
+  thread_local char t_errnobuf[512];
+  thread_local char t_time[32];
+  thread_local time_t t_lastSecond;
+  thread_local int t_tid;
+
+  int currentTid()
+  {
+    if (t_tid == 0)
+      t_tid = static_cast<int>(::syscall(SYS_gettid));
+    return t_tid;
+  }
+
+  Logger::LogLevel initLogLevel()
+  {
+    if (::getenv("MUTTY_LOG_TRACE"))
+      return Logger::TRACE;
+    else if (::getenv("MUTTY_LOG_DEBUG"))
+      return Logger::DEBUG;
+    else
+      return Logger::INFO;
+  }
+
+  const char* LogLevelName[Logger::NUM_LOG_LEVELS] =
+  {
+    "TRACE ",
+    "DEBUG ",
+    "INFO  ",
+    "WARN  ",
+    "ERROR ",
+    "FATAL ",
+  };
+
+  const char digits[] = "9876543210123456789";
+  const char* zero = digits + 9;
+  const char digitsHex[] = "0123456789ABCDEF";
+
+  void defaultOutput(const char* msg, int len)
+  {
+    AsyncLogging::defaultLogging().append(msg, len);
+  }
+
+  void defaultFlush()
+  {
+    AsyncLogging::defaultLogging().flush();
+  }
+
+  Logger::OutputFunc g_output = defaultOutput;
+  Logger::FlushFunc g_flush = defaultFlush;
+  }  // namespace
+
+  // 常量初始化，其它编译单元的静态对象构造时写日志也不会读到未初始化的0(TRACE)；
+  // 环境变量在其它静态对象之前(init_priority)生效
+  Logger::LogLevel g_logLevel = Logger::INFO;
+
+  namespace
+  {
+  struct LogLevelInitializer
+  {
+    LogLevelInitializer() { g_logLevel = initLogLevel(); }
+  };
+  LogLevelInitializer g_logLevelInitializer __attribute__((init_priority(101)));
+  }  // namespace
+
+  const char* strerror_tl(int savedErrno)
+  {
+    return strerror_r(savedErrno, t_errnobuf, sizeof t_errnobuf);
+  }
+
+  template<typename T>
+  void LogStream::formatInteger(T v)
+  {
+    // 最长的64位整数也不超过32个字符
+    if (data_ + sizeof data_ - cur_ < 32)
+      return;
+    T i = v;
+    char* p = cur_;
+    do
+    {
+      int lsd = static_cast<int>(i % 10);
+      i /= 10;
+      *p++ = zero[lsd];
+    } while (i != 0);
+    if (v < 0)
+      *p++ = '-';
+    std::reverse(cur_, p);
+    cur_ = p;
+  }
+
+  template void LogStream::formatInteger(int);
+  template void LogStream::formatInteger(unsigned int);
+  template void LogStream::formatInteger(long);
+  template void LogStream::formatInteger(unsigned long);
+  template void LogStream::formatInteger(long long);
+  template void LogStream::formatInteger(unsigned long long);
+
+  LogStream& LogStream::operator<<(const void* p)
+  {
+    uintptr_t v = reinterpret_cast<uintptr_t>(p);
+    if (data_ + sizeof data_ - cur_ >= 32)
+    {
+      char* buf = cur_;
+      buf[0] = '0';
+      buf[1] = 'x';
+      char* q = buf + 2;
+      do
+      {
+        *q++ = digitsHex[v % 16];
+        v /= 16;
+      } while (v != 0);
+      std::reverse(buf + 2, q);
+      cur_ = q;
+    }
+    return *this;
+  }
+
+  LogStream& LogStream::operator<<(double v)
+  {
+    if (data_ + sizeof data_ - cur_ >= 32)
+    {
+      cur_ += snprintf(cur_, 32, "%.12g", v);
+    }
+    return *this;
+  }
+
+  Logger::Logger(const char* file, int line, LogLevel level)
+    : Logger(file, line, level, 0)
+  {
+  }
+
+  Logger::Logger(const char* file, int line, LogLevel level, int savedErrno)
+    : level_(level),
+      savedErrno_(savedErrno),
+      file_(file),
+      line_(line)
+  {
+    formatTime();
+    stream_ << currentTid() << ' ' << LogLevelName[level];
+    if (savedErrno_ != 0)
+    {
+      stream_ << strerror_tl(savedErrno_) << " (errno=" << savedErrno_ << ") ";
+    }
+  }
+
+  Logger::Logger(const char* file, int line, LogLevel level, const char* func)
+    : Logger(file, line, level)
+  {
+    stream_ << func << ' ';
+  }
+
+  Logger::Logger(const char* file, int line, bool toAbort)
+    : Logger(file, line, toAbort ? FATAL : ERROR, errno)
+  {
+  }
+
+  Logger::~Logger()
+  {
+    finish(file_, line_);
+    g_output(stream_.data(), stream_.length());
+    if (level_ == FATAL)
+    {
+      g_flush();
+      abort();
+    }
+  }
+
+  void Logger::formatTime()
+  {
+    struct timeval tv;
+    ::gettimeofday(&tv, NULL);
+    // 同一秒内的日期部分每个线程只格式化一次
+    if (tv.tv_sec != t_lastSecond)
+    {
+      t_lastSecond = tv.tv_sec;
+      struct tm tm_time;
+      ::localtime_r(&tv.tv_sec, &tm_time);
+      ::strftime(t_time, sizeof t_time, "%Y%m%d %H:%M:%S", &tm_time);
+    }
+    char us[16];
+    int n = snprintf(us, sizeof us, ".%06d ", static_cast<int>(tv.tv_usec));
+    stream_ << t_time;
+    stream_.append(us, n);
+  }
+
+  void Logger::finish(const char* file, int line)
+  {
+    const char* slash = strrchr(file, '/');
+    stream_ << " - " << (slash ? slash + 1 : file) << ':' << line << '\n';
+  }
+
+  void Logger::setLogLevel(Logger::LogLevel level)
+  {
+    g_logLevel = level;
+  }
+
+  void Logger::setOutput(OutputFunc out)
+  {
+    g_output = out;
+  }
+
+  void Logger::setFlush(FlushFunc flush)
+  {
+    g_flush = flush;
+  }
+
+}  // namespace mutty
@@ -0,0 +1,133 @@
+#ifndef MUTTY_LOGGING_H
+#define MUTTY_LOGGING_H
+
+#include <string.h>
+#include <string>
+
+#include "noncopyable.h"
+
+namespace mutty
+{
+
+  ///
+  /// 定长的格式化缓冲，一条日志只在栈上格式化，不做任何堆分配
+  ///
+  class LogStream : noncopyable
+  {
+  public:
+    static const int kBufferSize = 4000;
+
+    LogStream() : cur_(data_) {}
+
+    LogStream& operator<<(bool v) { append(v ? "1" : "0", 1); return *this; }
+    LogStream& operator<<(short v) { return *this << static_cast<int>(v); }
+    LogStream& operator<<(unsigned short v) { return *this << static_cast<unsigned int>(v); }
+    LogStream& operator<<(int v) { formatInteger(v); return *this; }
+    LogStream& operator<<(unsigned int v) { formatInteger(v); return *this; }
+    LogStream& operator<<(long v) { formatInteger(v); return *this; }
+    LogStream& operator<<(unsigned long v) { formatInteger(v); return *this; }
+    LogStream& operator<<(long long v) { formatInteger(v); return *this; }
+    LogStream& operator<<(unsigned long long v) { formatInteger(v); return *this; }
+    LogStream& operator<<(const void* p);
+    LogStream& operator<<(float v) { return *this << static_cast<double>(v); }
+    LogStream& operator<<(double v);
+    LogStream& operator<<(char v) { append(&v, 1); return *this; }
+    LogStream& operator<<(const char* str)
+    {
+      if (str)
+        append(str, strlen(str));
+      else
+        append("(null)", 6);
+      return *this;
+    }
+    LogStream& operator<<(const std::string& v) { append(v.data(), v.size()); return *this; }
+
+    void append(const char* data, size_t len)
+    {
+      size_t avail = static_cast<size_t>(data_ + sizeof data_ - cur_);
+      if (len > avail)
+        len = avail;  // 超长截断
+      memcpy(cur_, data, len);
+      cur_ += len;
+    }
+
+    const char* data() const { return data_; }
+    int length() const { return static_cast<int>(cur_ - data_); }
+    void reset() { cur_ = data_; }
+
+  private:
+    template<typename T>
+    void formatInteger(T v);
+
+    char data_[kBufferSize];
+    char* cur_;
+  };
+
+  class Logger
+  {
+  public:
+    enum LogLevel
+    {
+      TRACE,
+      DEBUG,
+      INFO,
+      WARN,
+      ERROR,
+      FATAL,
+      NUM_LOG_LEVELS,
+    };
+
+    Logger(const char* file, int line, LogLevel level);
+    Logger(const char* file, int line, LogLevel level, const char* func);
+    Logger(const char* file, int line, bool toAbort);  // LOG_SYSERR / LOG_SYSFATAL
+    ~Logger();
+
+    LogStream& stream() { return stream_; }
+
+    static LogLevel logLevel();
+    static void setLogLevel(LogLevel level);
+
+    /// 默认输出到进程内的AsyncLogging(stdout)，见AsyncLogging::defaultLogging()
+    typedef void (*OutputFunc)(const char* msg, int len);
+    typedef void (*FlushFunc)();
+    static void setOutput(OutputFunc);
+    static void setFlush(FlushFunc);
+
+  private:
+    // errno在格式化时间之前取出，避免被格式化改掉
+    Logger(const char* file, int line, LogLevel level, int savedErrno);
+    void formatTime();
+    void finish(const char* file, int line);
+
+    LogStream stream_;
+    LogLevel level_;
+    int savedErrno_;
+    const char* file_;
+    int line_;
+  };
+
+  extern Logger::LogLevel g_logLevel;
+
+  inline Logger::LogLevel Logger::logLevel()
+  {
+    return g_logLevel;
+  }
+
+  const char* strerror_tl(int savedErrno);
+
+}  // namespace mutty
+
+// 级别判断在构造Logger之前，被过滤掉的日志不做任何格式化
+#define LOG_TRACE if (mutty::Logger::logLevel() <= mutty::Logger::TRACE) \
+  mutty::Logger(__FILE__, __LINE__, mutty::Logger::TRACE, __func__).stream()
+#define LOG_DEBUG if (mutty::Logger::logLevel() <= mutty::Logger::DEBUG) \
+  mutty::Logger(__FILE__, __LINE__, mutty::Logger::DEBUG, __func__).stream()
+#define LOG_INFO if (mutty::Logger::logLevel() <= mutty::Logger::INFO) \
+  mutty::Logger(__FILE__, __LINE__, mutty::Logger::INFO).stream()
+#define LOG_WARN mutty::Logger(__FILE__, __LINE__, mutty::Logger::WARN).stream()
+#define LOG_ERROR mutty::Logger(__FILE__, __LINE__, mutty::Logger::ERROR).stream()
+#define LOG_FATAL mutty::Logger(__FILE__, __LINE__, mutty::Logger::FATAL).stream()
+#define LOG_SYSERR mutty::Logger(__FILE__, __LINE__, false).stream()
+#define LOG_SYSFATAL mutty::Logger(__FILE__, __LINE__, true).stream()
+
+#endif  // MUTTY_LOGGING_H
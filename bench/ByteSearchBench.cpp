@@ -0,0 +1,216 @@
+// 字节查找的微基准：std::search/std::find(原来Buffer::findCRLF的写法)对比
+// buffer/ByteSearch.h里的scalar/sse2/avx2实现，每组输出一行JSON到stdout
+//
+//   mutty_bytesearch --sizes=16,64,512,4096,65536 --chunk=256 --duration=0.2
+//
+// 数据是头部样式的文本，末尾是"\r\n\r\n"，每次查找都要扫完整段。
+// crlf/byte/anyof的数据里没有别的'\r'/'\n'；crlfcrlf和incremental的数据按行用"\r\n"分隔，
+// 和真实的HTTP头部一样，每行的'\r'都是一次误报。
+// incremental: 一条size字节的消息每次到达chunk字节，每到一次找一次"\r\n\r\n"，
+//              对比每次从头扫(rescan)和从上次扫到的位置接着扫(resume)。
+
+#include "../buffer/Buffer.h"
+#include "../buffer/ByteSearch.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace buffer;
+
+namespace
+{
+
+struct Options
+{
+  std::vector<int> sizes = { 16, 64, 512, 4096, 65536 };
+  int chunk = 256;
+  double duration = 0.2;
+};
+
+const char kCRLF[] = "\r\n";
+const char kCRLFCRLF[] = "\r\n\r\n";
+const char kAnyOf[] = "\r\n";
+
+volatile size_t g_sink = 0;  // 防止查找被优化掉
+
+std::string makeInput(int size, bool lines)
+{
+  static const char kFiller[] = "Accept-Encoding: gzip, deflate; X-Request-Id: 7f3a9c21; ";
+  std::string s;
+  s.reserve(size);
+  while (static_cast<int>(s.size()) < size - 4)
+  {
+    size_t column = s.size() % (sizeof(kFiller) - 1);
+    if (lines && column == sizeof(kFiller) - 3)
+      s.append(kCRLF, std::min<size_t>(2, size - 4 - s.size()));
+    else
+      s.push_back(kFiller[column]);
+  }
+  s.append(kCRLFCRLF, std::min(4, size));
+  return s;
+}
+
+// 跑满duration秒，返回每次调用的纳秒数
+double measure(double duration, const std::function<size_t()>& fn)
+{
+  typedef std::chrono::steady_clock Clock;
+  long calls = 0;
+  long batch = 1;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0;
+  while (elapsed < duration)
+  {
+    for (long i = 0; i < batch; ++i)
+      g_sink += fn();
+    calls += batch;
+    batch *= 2;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return elapsed * 1e9 / calls;
+}
+
+void report(const char* op, const char* impl, int size, double ns)
+{
+  printf("{\"op\":\"%s\",\"impl\":\"%s\",\"size\":%d,\"ns_per_call\":%.1f,\"gb_per_s\":%.2f}\n",
+         op, impl, size, ns, size / ns);
+}
+
+size_t offsetOf(const char* hit, const char* begin)
+{
+  return hit == NULL ? 0 : hit - begin + 1;
+}
+
+void runKernels(const Options& opts, int size)
+{
+  const std::string input = makeInput(size, false);
+  const char* begin = input.data();
+  const char* end = begin + input.size();
+  const std::string headers = makeInput(size, true);
+  const char* hbegin = headers.data();
+  const char* hend = hbegin + headers.size();
+
+  report("crlf", "std::search", size, measure(opts.duration, [=] {
+    const char* hit = std::search(begin, end, kCRLF, kCRLF + 2);
+    return offsetOf(hit == end ? NULL : hit, begin);
+  }));
+  report("crlfcrlf", "std::search", size, measure(opts.duration, [=] {
+    const char* hit = std::search(hbegin, hend, kCRLFCRLF, kCRLFCRLF + 4);
+    return offsetOf(hit == hend ? NULL : hit, hbegin);
+  }));
+  report("byte", "std::find", size, measure(opts.duration, [=] {
+    const char* hit = std::find(begin, end, '\n');
+    return offsetOf(hit == end ? NULL : hit, begin);
+  }));
+  report("anyof", "std::find_first_of", size, measure(opts.duration, [=] {
+    const char* hit = std::find_first_of(begin, end, kAnyOf, kAnyOf + 2);
+    return offsetOf(hit == end ? NULL : hit, begin);
+  }));
+
+  const char* names[] = { "scalar", "sse2", "avx2" };
+  for (const char* name : names)
+  {
+    const ByteSearchKernels* k = byteSearchKernels(name);
+    if (k == NULL)
+      continue;
+    report("crlf", name, size, measure(opts.duration, [=] {
+      return offsetOf(k->findCRLF(begin, end), begin);
+    }));
+    report("crlfcrlf", name, size, measure(opts.duration, [=] {
+      return offsetOf(k->findCRLFCRLF(hbegin, hend), hbegin);
+    }));
+    report("byte", name, size, measure(opts.duration, [=] {
+      return offsetOf(k->findByte(begin, end, '\n'), begin);
+    }));
+    report("anyof", name, size, measure(opts.duration, [=] {
+      return offsetOf(k->findAnyOf(begin, end, kAnyOf, 2), begin);
+    }));
+  }
+}
+
+void runIncremental(const Options& opts, int size)
+{
+  const std::string input = makeInput(size, true);
+  Buffer buf;
+  for (int resume = 0; resume < 2; ++resume)
+  {
+    double ns = measure(opts.duration, [&] {
+      size_t scanned = 0;
+      const char* hit = NULL;
+      for (int off = 0; off < size && hit == NULL; off += opts.chunk)
+      {
+        buf.writeBytes(input.data() + off, std::min(opts.chunk, size - off));
+        hit = resume ? buf.findCRLFCRLF(&scanned) : buf.findCRLFCRLF();
+      }
+      size_t result = offsetOf(hit, buf.peek());
+      buf.retrieveAll();
+      return result;
+    });
+    printf("{\"op\":\"incremental\",\"impl\":\"%s\",\"size\":%d,\"chunk\":%d,\"ns_per_message\":%.1f}\n",
+           resume ? "resume" : "rescan", size, opts.chunk, ns);
+  }
+}
+
+// 逗号分隔的正整数；有一项不合法就返回空，parseOptions()据此报错
+std::vector<int> parseList(const char* s)
+{
+  std::vector<int> v;
+  while (*s)
+  {
+    char* end;
+    long n = strtol(s, &end, 10);
+    if (end == s || n <= 0 || n > INT_MAX || (*end != ',' && *end != '\0'))
+      return std::vector<int>();
+    v.push_back(static_cast<int>(n));
+    s = *end == ',' ? end + 1 : end;
+  }
+  return v;
+}
+
+bool parseOptions(int argc, char* argv[], Options* opts)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const char* eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || eq == NULL)
+      return false;
+    std::string key(arg + 2, eq);
+    const char* value = eq + 1;
+    if (key == "sizes")
+      opts->sizes = parseList(value);
+    else if (key == "chunk")
+      opts->chunk = atoi(value);
+    else if (key == "duration")
+      opts->duration = atof(value);
+    else
+      return false;
+  }
+  return !opts->sizes.empty() && opts->chunk > 0 && opts->duration > 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  Options opts;
+  if (!parseOptions(argc, argv, &opts))
+  {
+    fprintf(stderr, "Usage: %s [--sizes=16,64,512,4096,65536] [--chunk=256] [--duration=0.2]\n",
+            argv[0]);
+    return 1;
+  }
+  fprintf(stderr, "active kernels: %s\n", activeByteSearch().name);
+  for (int size : opts.sizes)
+    runKernels(opts, size);
+  for (int size : opts.sizes)
+    runIncremental(opts, size);
+  return 0;
+}
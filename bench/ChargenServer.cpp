@@ -0,0 +1,61 @@
+// chargen(RFC 864): 连接建立后不停地发送字符，测发送路径的吞吐
+// 每次outputBuffer发空(WriteCompleteCallback)再发下一块
+//
+//   mutty_chargen [port=2019] [ioThreads=0]
+
+#include "../EventLoop.h"
+#include "../TcpServer.h"
+#include "../base/Logging.h"
+
+#include <stdlib.h>
+
+using namespace mutty;
+
+std::string g_message;
+
+void onConnection(const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+    conn->send(g_message);
+  }
+}
+
+void onMessage(const TcpConnectionRef& conn, buffer::Buffer* buf)
+{
+  buf->retrieveAll();
+}
+
+void onWriteComplete(const TcpConnectionRef& conn)
+{
+  conn->send(g_message);
+}
+
+int main(int argc, char* argv[])
+{
+  uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 2019);
+  int ioThreads = argc > 2 ? atoi(argv[2]) : 0;
+
+  // 可打印字符轮转，每行72个，共94行
+  std::string line;
+  for (int i = 33; i < 127; ++i)
+  {
+    line.push_back(static_cast<char>(i));
+  }
+  line += line;
+  for (size_t i = 0; i < 127-33; ++i)
+  {
+    g_message += line.substr(i, 72) + '\n';
+  }
+
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "ChargenServer");
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setWriteCompleteCallback(onWriteComplete);
+  server.setIoLoopNum(ioThreads);
+  server.start();
+  LOG_INFO << "ChargenServer listening on " << server.ipPort() << ", " << ioThreads << " io threads";
+  loop.loop();
+}
@@ -0,0 +1,37 @@
+// discard: 丢弃收到的所有数据，测接收路径(readFd + Buffer)的吞吐
+//
+//   mutty_discard [port=2009] [ioThreads=0]
+
+#include "../EventLoop.h"
+#include "../TcpServer.h"
+#include "../base/Logging.h"
+
+#include <stdlib.h>
+
+using namespace mutty;
+
+void onConnection(const TcpConnectionPtr& conn)
+{
+  LOG_DEBUG << "DiscardServer - " << conn->peerAddress().toIpPort() << " is "
+            << (conn->connected() ? "UP" : "DOWN");
+}
+
+void onMessage(const TcpConnectionRef& conn, buffer::Buffer* buf)
+{
+  buf->retrieveAll();
+}
+
+int main(int argc, char* argv[])
+{
+  uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 2009);
+  int ioThreads = argc > 2 ? atoi(argv[2]) : 0;
+
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "DiscardServer");
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setIoLoopNum(ioThreads);
+  server.start();
+  LOG_INFO << "DiscardServer listening on " << server.ipPort() << ", " << ioThreads << " io threads";
+  loop.loop();
+}
@@ -0,0 +1,40 @@
+// echo: 收到什么发回什么
+//
+//   mutty_echo [port=2007] [ioThreads=0] [batch]
+
+#include "../EventLoop.h"
+#include "../TcpServer.h"
+#include "../base/Logging.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace mutty;
+
+void onConnection(const TcpConnectionPtr& conn)
+{
+  LOG_DEBUG << "EchoServer - " << conn->peerAddress().toIpPort() << " is "
+            << (conn->connected() ? "UP" : "DOWN");
+}
+
+void onMessage(const TcpConnectionRef& conn, buffer::Buffer* buf)
+{
+  conn->send(buf);
+}
+
+int main(int argc, char* argv[])
+{
+  uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 2007);
+  int ioThreads = argc > 2 ? atoi(argv[2]) : 0;
+  bool batch = argc > 3 && strcmp(argv[3], "batch") == 0;
+
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(port), "EchoServer");
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setBatchedFlush(batch);
+  server.setIoLoopNum(ioThreads);
+  server.start();
+  LOG_INFO << "EchoServer listening on " << server.ipPort() << ", " << ioThreads << " io threads";
+  loop.loop();
+}
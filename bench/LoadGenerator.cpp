@@ -0,0 +1,422 @@
+// 压测客户端：按 连接数 x 消息大小 扫描，每组输出一行JSON到stdout，日志走stderr
+//
+//   mutty_loadgen --port=2007 --mode=pingpong --conns=1,10,100 --sizes=64,1024,16384 \
+//                 --duration=5 --warmup=1 --threads=4 [--host=127.0.0.1]
+//
+// pingpong: 每个连接发一条size字节的消息，收齐回显后记录往返时间再发下一条，
+//           配合mutty_echo/mutty_pingpong，输出吞吐和延迟分位数
+// discard:  每个连接持续发送size字节的消息，配合mutty_discard，只统计发送吞吐
+// chargen:  只接收，配合mutty_chargen，统计接收吞吐，size不起作用
+
+#include "../Connector.h"
+#include "../EventLoop.h"
+#include "../EventLoopThreadPool.h"
+#include "../Socket.h"
+#include "../TcpConnection.h"
+#include "../base/Logging.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace mutty;
+using namespace std::placeholders;
+
+namespace
+{
+
+struct Options
+{
+  std::string host = "127.0.0.1";
+  uint16_t port = 2007;
+  std::string mode = "pingpong";
+  std::vector<int> conns = {1, 10, 100};
+  std::vector<int> sizes = {64, 1024, 16384};
+  double duration = 5;
+  double warmup = 1;
+  int threads = 4;
+};
+
+int64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class CountDownLatch : noncopyable
+{
+public:
+  explicit CountDownLatch(int count) : count_(count) {}
+
+  void countDown()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--count_ == 0)
+      cond_.notify_all();
+  }
+
+  bool waitFor(double seconds)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cond_.wait_for(lock, std::chrono::duration<double>(seconds),
+                          [this] { return count_ <= 0; });
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  int count_;
+};
+
+// 一组(conns, size)共享的状态
+struct Run
+{
+  Run(const Options& opts, int conns, int size)
+    : mode(opts.mode),
+      message(size, 'x'),
+      measuring(false),
+      connected(conns),
+      closed(conns)
+  {
+  }
+
+  const std::string mode;
+  const std::string message;
+  std::atomic<bool> measuring;
+  CountDownLatch connected;
+  CountDownLatch closed;
+};
+
+// 一个连接，除构造外都在所属loop线程里执行
+class Session : noncopyable
+{
+public:
+  Session(EventLoop* loop, const InetAddress& serverAddr, Run* run, int id)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      connector_(std::make_shared<Connector>(loop, serverAddr)),
+      run_(run),
+      id_(id),
+      remaining_(0),
+      sentAt_(0),
+      bytesRead_(0),
+      bytesWritten_(0),
+      messages_(0)
+  {
+    connector_->setNewConnectionCallback(std::bind(&Session::onNewConnection, this, _1));
+  }
+
+  void start() { connector_->start(); }
+
+  void stop()
+  {
+    loop_->runInLoop([this] {
+      if (conn_)
+        conn_->forceClose();
+    });
+  }
+
+  // 只有loop线程写，relaxed读即可
+  uint64_t bytesRead() const { return bytesRead_.load(std::memory_order_relaxed); }
+  uint64_t bytesWritten() const { return bytesWritten_.load(std::memory_order_relaxed); }
+  uint64_t messages() const { return messages_.load(std::memory_order_relaxed); }
+  /// 连接关闭之后才能读
+  const std::vector<int64_t>& latencies() const { return latencies_; }
+
+private:
+  static constexpr size_t kFillBytes = 64 * 1024;
+
+  static void add(std::atomic<uint64_t>& a, uint64_t n)
+  { a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+  void onNewConnection(int sockfd)
+  {
+    char name[32];
+    snprintf(name, sizeof name, "LoadGenerator#%d", id_);
+    conn_ = std::make_shared<TcpConnection>(loop_, name, sockfd,
+                                            InetAddress(Socket::getLocalAddr(sockfd)), serverAddr_);
+    conn_->setConnectionCallback(std::bind(&Session::onConnection, this, _1));
+    conn_->setMessageCallback(std::bind(&Session::onMessage, this, _1, _2));
+    conn_->setWriteCompleteCallback(std::bind(&Session::onWriteComplete, this, _1));
+    conn_->setCloseCallback(std::bind(&Session::onClose, this, _1));
+    conn_->setBatchedFlush(run_->mode == "discard");
+    conn_->connectEstablished();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (!conn->connected())
+      return;
+    conn->setTcpNoDelay(true);
+    run_->connected.countDown();
+    if (run_->mode == "pingpong")
+      sendMessage();
+    else if (run_->mode == "discard")
+      fill();
+  }
+
+  void onMessage(const TcpConnectionRef& conn, buffer::Buffer* buf)
+  {
+    size_t n = buf->readableBytes();
+    buf->retrieveAll();
+    add(bytesRead_, n);
+    if (run_->mode != "pingpong")
+      return;
+
+    remaining_ -= std::min(remaining_, n);
+    if (remaining_ == 0)
+    {
+      add(messages_, 1);
+      if (run_->measuring.load(std::memory_order_relaxed))
+        latencies_.push_back(nowNs() - sentAt_);
+      sendMessage();
+    }
+  }
+
+  void onWriteComplete(const TcpConnectionRef& conn)
+  {
+    if (run_->mode == "discard")
+      fill();
+  }
+
+  void onClose(const TcpConnectionPtr& conn)
+  {
+    conn->connectDestroyed();
+    conn_.reset();
+    // 必须是最后一句，之后主线程可能析构本对象
+    run_->closed.countDown();
+  }
+
+  // discard: 用batched flush，send只追加到outputBuffer，每轮循环末尾写一次，
+  // 写空后的WriteCompleteCallback在下一轮再补满。直接写的话每次写完都会
+  // 排队一个WriteCompleteCallback，在pendingFunctors里一直接力，loop回不到poll
+  void fill()
+  {
+    size_t target = std::max<size_t>(run_->message.size(), kFillBytes);
+    while (conn_ && conn_->connected() && conn_->outputBuffer()->readableBytes() < target)
+    {
+      sendMessage();
+      add(messages_, 1);
+    }
+  }
+
+  void sendMessage()
+  {
+    remaining_ = run_->message.size();
+    sentAt_ = nowNs();
+    conn_->send(run_->message);
+    add(bytesWritten_, run_->message.size());
+  }
+
+  EventLoop* loop_;
+  const InetAddress serverAddr_;
+  std::shared_ptr<Connector> connector_;
+  TcpConnectionPtr conn_;
+  Run* run_;
+  const int id_;
+
+  size_t remaining_;   // pingpong: 本条消息还没收到的回显字节数
+  int64_t sentAt_;
+  std::vector<int64_t> latencies_;  // ns，只记录measuring期间的
+
+  std::atomic<uint64_t> bytesRead_;
+  std::atomic<uint64_t> bytesWritten_;
+  std::atomic<uint64_t> messages_;
+};
+
+struct Totals
+{
+  uint64_t bytesRead = 0;
+  uint64_t bytesWritten = 0;
+  uint64_t messages = 0;
+};
+
+Totals collect(const std::vector<std::unique_ptr<Session>>& sessions)
+{
+  Totals t;
+  for (const auto& s : sessions)
+  {
+    t.bytesRead += s->bytesRead();
+    t.bytesWritten += s->bytesWritten();
+    t.messages += s->messages();
+  }
+  return t;
+}
+
+double percentileUs(const std::vector<int64_t>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0.0;
+  size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+  return sorted[idx] / 1000.0;
+}
+
+void runOnce(const Options& opts, EventLoopThreadPool* pool, int conns, int size)
+{
+  Run run(opts, conns, size);
+  InetAddress serverAddr(opts.host, opts.port);
+  std::vector<std::unique_ptr<Session>> sessions;
+  for (int i = 0; i < conns; ++i)
+  {
+    sessions.emplace_back(new Session(pool->getNextLoop(), serverAddr, &run, i));
+    sessions.back()->start();
+  }
+  if (!run.connected.waitFor(10))
+  {
+    LOG_ERROR << "LoadGenerator - cannot connect " << conns << " connections to "
+              << serverAddr.toIpPort();
+    exit(1);  // Connector还在重试，不析构sessions直接退出
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(opts.warmup));
+  Totals begin = collect(sessions);
+  int64_t beginNs = nowNs();
+  run.measuring = true;
+  std::this_thread::sleep_for(std::chrono::duration<double>(opts.duration));
+  run.measuring = false;
+  Totals end = collect(sessions);
+  double seconds = (nowNs() - beginNs) / 1e9;
+
+  for (const auto& s : sessions)
+  {
+    s->stop();
+  }
+  if (!run.closed.waitFor(10))
+  {
+    LOG_ERROR << "LoadGenerator - connections did not close";
+    exit(1);
+  }
+
+  std::vector<int64_t> latencies;
+  for (const auto& s : sessions)
+  {
+    latencies.insert(latencies.end(), s->latencies().begin(), s->latencies().end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  uint64_t bytes = opts.mode == "chargen" ? end.bytesRead - begin.bytesRead
+                                          : end.bytesWritten - begin.bytesWritten;
+  printf("{\"mode\":\"%s\",\"conns\":%d,\"size\":%d,\"threads\":%d,\"seconds\":%.3f,",
+         opts.mode.c_str(), conns, size, opts.threads, seconds);
+  // chargen是字节流，没有消息的概念，只报吞吐
+  if (opts.mode != "chargen")
+    printf("\"msgs_per_sec\":%.1f,", (end.messages - begin.messages) / seconds);
+  printf("\"mib_per_sec\":%.3f", bytes / seconds / (1024.0 * 1024.0));
+  if (opts.mode == "pingpong")
+  {
+    printf(",\"samples\":%zu,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,"
+           "\"p999_us\":%.1f,\"max_us\":%.1f",
+           latencies.size(),
+           percentileUs(latencies, 0.5), percentileUs(latencies, 0.9),
+           percentileUs(latencies, 0.99), percentileUs(latencies, 0.999),
+           latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+  }
+  printf("}\n");
+  fflush(stdout);
+}
+
+// 逗号分隔的正整数；有一项不合法就返回空，parseOptions()据此报错
+std::vector<int> parseList(const char* s)
+{
+  std::vector<int> v;
+  while (*s)
+  {
+    char* end;
+    long n = strtol(s, &end, 10);
+    if (end == s || n <= 0 || n > INT_MAX || (*end != ',' && *end != '\0'))
+      return std::vector<int>();
+    v.push_back(static_cast<int>(n));
+    s = *end == ',' ? end + 1 : end;
+  }
+  return v;
+}
+
+void usage(const char* prog)
+{
+  fprintf(stderr,
+          "Usage: %s [--host=127.0.0.1] [--port=2007] [--mode=pingpong|discard|chargen]\n"
+          "          [--conns=1,10,100] [--sizes=64,1024,16384] [--duration=5] [--warmup=1]\n"
+          "          [--threads=4]\n", prog);
+}
+
+bool parseOptions(int argc, char* argv[], Options* opts)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const char* eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || eq == NULL)
+      return false;
+    std::string key(arg + 2, eq);
+    const char* value = eq + 1;
+    if (key == "host")
+      opts->host = value;
+    else if (key == "port")
+      opts->port = static_cast<uint16_t>(atoi(value));
+    else if (key == "mode")
+      opts->mode = value;
+    else if (key == "conns")
+      opts->conns = parseList(value);
+    else if (key == "sizes")
+      opts->sizes = parseList(value);
+    else if (key == "duration")
+      opts->duration = atof(value);
+    else if (key == "warmup")
+      opts->warmup = atof(value);
+    else if (key == "threads")
+      opts->threads = atoi(value);
+    else
+      return false;
+  }
+  return (opts->mode == "pingpong" || opts->mode == "discard" || opts->mode == "chargen")
+         && opts->threads > 0 && !opts->conns.empty() && !opts->sizes.empty();
+}
+
+void stderrOutput(const char* msg, int len)
+{
+  ssize_t n = ::write(STDERR_FILENO, msg, len);
+  (void)n;
+}
+
+void noFlush()
+{
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  Options opts;
+  if (!parseOptions(argc, argv, &opts))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  // stdout只留给结果
+  Logger::setOutput(stderrOutput);
+  Logger::setFlush(noFlush);
+
+  EventLoop loop;  // 只作为线程池的baseLoop，不运行
+  EventLoopThreadPool pool(&loop, opts.threads, "LoadGenerator");
+  pool.start();
+
+  std::vector<int> sizes = opts.sizes;
+  if (opts.mode == "chargen")
+    sizes.assign(1, 0);
+  for (int conns : opts.conns)
+  {
+    for (int size : sizes)
+    {
+      runOnce(opts, &pool, conns, size);
+    }
+  }
+}
@@ -7,24 +7,63 @@
 
 namespace buffer{
   Buffer::Buffer()
-  :m_internalByteBuf(nullptr)
+  :m_internalByteBuf(nullptr),
+   m_sizeHint(kInitialSize),
+   m_allocator(nullptr)
   {
   }
   
   Buffer::Buffer(int size)
+  :Buffer(size, nullptr)
+  {
+  }
+
+  Buffer::Buffer(int size, PooledByteBufAllocator* allocator)
+  :m_internalByteBuf(nullptr),
+   m_sizeHint(std::max(size, kMinSizeHint)),
+   m_allocator(allocator)
   {
     assert(size >= 0);
-    m_internalByteBuf = PooledByteBufAllocator::ALLOCATOR()->buffer(size);
+    allocate(size);
   }
 
   Buffer::~Buffer()
   {
     if(m_internalByteBuf != nullptr)
-      m_internalByteBuf->deallocate();
+      m_internalByteBuf->release();
+  }
+
+  void Buffer::allocate(int size)
+  {
+    assert(m_internalByteBuf == nullptr);
+    PooledByteBufAllocator* allocator = m_allocator != nullptr ? m_allocator : PooledByteBufAllocator::ALLOCATOR();
+    m_internalByteBuf = allocator->buffer(size);
+  }
+
+  bool Buffer::release()
+  {
+    if (m_internalByteBuf == nullptr || m_internalByteBuf->readableBytes() > 0)
+      return false;
+    m_internalByteBuf->release();
+    m_internalByteBuf = nullptr;
+    return true;
+  }
+
+  void Buffer::unshare(int minSize)
+  {
+    // 视图还在用原来的内存，剩下没读的数据搬到新内存里，原来的那块等视图都释放了再回池
+    PooledByteBuf* shared = m_internalByteBuf;
+    int readable = shared->readableBytes();
+    m_internalByteBuf = nullptr;
+    allocate(std::max(readable + minSize, m_sizeHint));
+    m_internalByteBuf->writeBytes(shared->peek(), readable);
+    shared->release();
   }
 
   ssize_t Buffer::readFd(int fd, int* savedErrno)
   {
+    // 只有可读时才会调用，这时分配不会浪费在空闲连接上
+    prepareWrite(0);
     // saved an ioctl()/FIONREAD call to tell how much to read
     char extrabuf[65536];
     struct iovec vec[2];
@@ -50,6 +89,14 @@ namespace buffer{
       m_internalByteBuf->m_writerIndex = capacity();
       writeBytes(extrabuf, n - writable);
     }
+
+    // 读满了就加倍，读得很少就减半，类似Netty的AdaptiveRecvByteBufAllocator
+    if (n > 0 && static_cast<size_t>(n) >= writable)
+      m_sizeHint = std::min(m_sizeHint * 2, kMaxSizeHint);
+    else if (n >= 0 && n < m_sizeHint / 4)
+      m_sizeHint = std::max(m_sizeHint / 2, kMinSizeHint);
+    if (n <= 0)
+      release();
     return n;
   }
 }
@@ -5,8 +5,10 @@
 #include <vector>
 #include <string>
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 #include <iostream>
+#include "ByteSearch.h"
 #include "PooledByteBuf.h"
 
 //#include <unistd.h>  // ssize_t
@@ -14,48 +16,95 @@
 namespace buffer
 {
 
+// Buffer()不占内存，第一次写入或readFd()时才从池里分配；
+// release()在没有可读数据时把内存还给池，之后还可以继续用。
+// 没有分配时peek()/begin()/beginWrite()返回nullptr，readableBytes()为0。
+// retainedSlice()/readRetainedSlice()不拷贝地取出一段可读数据，视图持有底层内存的引用；
+// 有视图时Buffer的下一次写入先换一块新内存(只拷贝剩下没读的部分)，不会覆盖视图。
+// 默认从PooledByteBufAllocator::ALLOCATOR()分配，setAllocator()换成别的allocator实例。
 class Buffer{
-  static constexpr char kCRLF[] = "\r\n";
  public:
   static const size_t kCheapPrepend = 8;
   static const size_t kInitialSize = 1024;
+  // readFd()按需分配的大小在这个范围内自适应，上限不超过线程缓存能缓存的大小
+  static constexpr int kMinSizeHint = 512;
+  static constexpr int kMaxSizeHint = 32 * 1024;
 
   Buffer();
   explicit Buffer(int size);
+  /// allocator为nullptr时用默认的
+  Buffer(int size, PooledByteBufAllocator* allocator);
   ~Buffer();
 
+  /// 之后的分配都从allocator来，已经分配的内存不动；nullptr恢复默认
+  void setAllocator(PooledByteBufAllocator* allocator) { m_allocator = allocator; }
+  PooledByteBufAllocator* allocator() const { return m_allocator; }
+
   inline const int readableBytes() const
-  { return m_internalByteBuf->readableBytes(); }
+  { return m_internalByteBuf ? m_internalByteBuf->readableBytes() : 0; }
 
   inline const int writableBytes() const
-  { return m_internalByteBuf->writableBytes(); }
+  { return m_internalByteBuf ? m_internalByteBuf->writableBytes() : 0; }
 
   void swap(Buffer&& rhs)
   {
     std::swap(m_internalByteBuf, rhs.m_internalByteBuf);
+    std::swap(m_sizeHint, rhs.m_sizeHint);
+    std::swap(m_allocator, rhs.m_allocator);
   }
 
-  inline const char* peek() const { return m_internalByteBuf->peek(); }
-  inline char* begin() const { return m_internalByteBuf->tmpBuf(); }
-  inline const int capacity() const { return m_internalByteBuf->capacity(); }
+  inline const char* peek() const { return m_internalByteBuf ? m_internalByteBuf->peek() : nullptr; }
+  inline char* begin() const { return m_internalByteBuf ? m_internalByteBuf->tmpBuf() : nullptr; }
+  inline const int capacity() const { return m_internalByteBuf ? m_internalByteBuf->capacity() : 0; }
+  inline bool allocated() const { return m_internalByteBuf != nullptr; }
 
   // retrieve returns void, to prevent
   // string str(retrieve(readableBytes()), readableBytes());
   // the evaluation of two functions are unspecified
-  void retrieve(size_t len) { m_internalByteBuf->retrieve(len); }
-  void retrieveAll() { m_internalByteBuf->retrieveAll(); }
-  std::string retrieveAllAsString() { return m_internalByteBuf->retrieveAllAsString(); }
-  std::string retrieveAsString(size_t len) { return m_internalByteBuf->retrieveAsString(len); }
+  void retrieve(size_t len)
+  {
+    assert(m_internalByteBuf || len == 0);
+    if (m_internalByteBuf) m_internalByteBuf->retrieve(len);
+  }
+  void retrieveAll() { if (m_internalByteBuf) m_internalByteBuf->retrieveAll(); }
+  std::string retrieveAllAsString()
+  { return m_internalByteBuf ? m_internalByteBuf->retrieveAllAsString() : std::string(); }
+  std::string retrieveAsString(size_t len)
+  {
+    assert(m_internalByteBuf || len == 0);
+    return m_internalByteBuf ? m_internalByteBuf->retrieveAsString(len) : std::string();
+  }
 
   // append
   Buffer * writeBytes(const char* data, int length) {
+      prepareWrite(length);
       m_internalByteBuf->writeBytes(data, length);
       return this;
   }
 
   Buffer * writeBytes(const std::string& str ) {
-      m_internalByteBuf->writeBytes(str.data(), str.size());
-      return this;
+      return writeBytes(str.data(), static_cast<int>(str.size()));
+  }
+
+  /// 没有可读数据时归还内存，返回是否归还了
+  bool release();
+
+  /// [start, start + len)这段可读数据的视图，不拷贝
+  PooledSlicedByteBuf retainedSlice(const char* start, int len) const
+  {
+    assert(peek() <= start && start + len <= beginWrite());
+    return m_internalByteBuf->retainedSlice(static_cast<int>(start - begin()), len);
+  }
+
+  /// 取出接下来len字节的视图，相当于不拷贝的retrieveAsString(len)
+  PooledSlicedByteBuf readRetainedSlice(int len)
+  {
+    assert(len <= readableBytes());
+    if (len == 0)
+      return PooledSlicedByteBuf();
+    PooledSlicedByteBuf slice = retainedSlice(peek(), len);
+    retrieve(len);
+    return slice;
   }
 
   // void hasWritten(size_t len)
@@ -70,25 +119,50 @@ class Buffer{
   //   m_internalByteBuf->m_writerIndex -= len;
   // }
 
-  inline char* beginWrite() { return begin() + m_internalByteBuf->m_writerIndex; }
-  inline const char* beginWrite() const { return begin() + m_internalByteBuf->m_writerIndex; }
+  inline char* beginWrite()
+  { return m_internalByteBuf ? begin() + m_internalByteBuf->m_writerIndex : nullptr; }
+  inline const char* beginWrite() const
+  { return m_internalByteBuf ? begin() + m_internalByteBuf->m_writerIndex : nullptr; }
 
+  // 查找都走ByteSearch.h，按CPU选SSE2/AVX2实现
   const char* findCRLF() const
-  {
-    // FIXME: replace with memmem()?
-    const char* crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF+2);
-    return crlf == beginWrite() ? NULL : crlf;
-  }
+  { return buffer::findCRLF(peek(), beginWrite()); }
 
   const char* findCRLF(const char* start) const
   {
     assert(peek() <= start);
     assert(start <= beginWrite());
-    // FIXME: replace with memmem()?
-    const char* crlf = std::search(start, beginWrite(), kCRLF, kCRLF+2);
-    return crlf == beginWrite() ? NULL : crlf;
+    return buffer::findCRLF(start, beginWrite());
   }
 
+  // 可续扫的版本：从peek()+*scanned开始找，没找到时把*scanned推进到已经确认不含
+  // "\r\n"的位置(留一个字节给跨读的'\r')，找到时清零。
+  // 数据一点点到达时每次只扫新来的部分；*scanned在retrieve之后要一起清零。
+  const char* findCRLF(size_t* scanned) const
+  { return findResumable(scanned, 2, buffer::findCRLF); }
+
+  // 同上，计数器只占4字节，给要控制对象大小的调用方(HttpContext)
+  const char* findCRLF(uint32_t* scanned) const
+  {
+    size_t n = *scanned;
+    const char* hit = findCRLF(&n);
+    *scanned = static_cast<uint32_t>(n);
+    return hit;
+  }
+
+  const char* findCRLFCRLF() const
+  { return buffer::findCRLFCRLF(peek(), beginWrite()); }
+
+  const char* findCRLFCRLF(size_t* scanned) const
+  { return findResumable(scanned, 4, buffer::findCRLFCRLF); }
+
+  const char* findByte(char c) const
+  { return buffer::findByte(peek(), beginWrite(), c); }
+
+  // 找set里任意一个字节第一次出现的位置
+  const char* findAnyOf(const char* set, size_t setSize) const
+  { return buffer::findAnyOf(peek(), beginWrite(), set, setSize); }
+
   void retrieveUntil(const char* end)
   {
       assert(peek() <= end);
@@ -103,7 +177,34 @@ class Buffer{
   ssize_t readFd(int fd, int* savedErrno);
 
  private:
+  // 写之前：没有内存就分配，内存被视图共享着就换一块
+  void prepareWrite(int minSize)
+  {
+    if (m_internalByteBuf == nullptr)
+      allocate(std::max(minSize, m_sizeHint));
+    else if (m_internalByteBuf->shared())
+      unshare(minSize);
+  }
+  void allocate(int size);
+  void unshare(int minSize);
+
+  const char* findResumable(size_t* scanned, size_t patternLen,
+                            const char* (*find)(const char*, const char*)) const
+  {
+    const size_t readable = readableBytes();
+    if (*scanned > readable)
+      *scanned = 0;
+    const char* hit = find(peek() + *scanned, beginWrite());
+    if (hit != NULL)
+      *scanned = 0;
+    else if (readable >= patternLen)
+      *scanned = readable - (patternLen - 1);
+    return hit;
+  }
+
   PooledByteBuf* m_internalByteBuf;
+  int m_sizeHint;  // 下次按需分配的大小，readFd()根据每次读到的字节数调整
+  PooledByteBufAllocator* m_allocator;  // nullptr表示默认的ALLOCATOR()
   // std::vector<char> buffer_;
 };
 
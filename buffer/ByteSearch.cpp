@@ -0,0 +1,276 @@
+#include "ByteSearch.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MUTTY_BYTESEARCH_X86 1
+#endif
+
+namespace buffer
+{
+namespace
+{
+
+const char* scalarFindByte(const char* begin, const char* end, char c)
+{
+  return static_cast<const char*>(::memchr(begin, c, end - begin));
+}
+
+// 先找'\r'再看后面，glibc的memchr本身就很快
+const char* scalarFindCRLF(const char* begin, const char* end)
+{
+  const char* last = end - 1;
+  const char* p = begin;
+  while (p < last)
+  {
+    p = static_cast<const char*>(::memchr(p, '\r', last - p));
+    if (p == NULL)
+      return NULL;
+    if (p[1] == '\n')
+      return p;
+    ++p;
+  }
+  return NULL;
+}
+
+const char* scalarFindCRLFCRLF(const char* begin, const char* end)
+{
+  const char* last = end - 3;
+  const char* p = begin;
+  while (p < last)
+  {
+    p = static_cast<const char*>(::memchr(p, '\r', last - p));
+    if (p == NULL)
+      return NULL;
+    if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n')
+      return p;
+    ++p;
+  }
+  return NULL;
+}
+
+const char* scalarFindAnyOf(const char* begin, const char* end, const char* set, size_t setSize)
+{
+  bool table[256] = { false };
+  for (size_t i = 0; i < setSize; ++i)
+    table[static_cast<unsigned char>(set[i])] = true;
+  for (const char* p = begin; p < end; ++p)
+  {
+    if (table[static_cast<unsigned char>(*p)])
+      return p;
+  }
+  return NULL;
+}
+
+const ByteSearchKernels kScalar = {
+  "scalar", scalarFindByte, scalarFindCRLF, scalarFindCRLFCRLF, scalarFindAnyOf
+};
+
+#if defined(MUTTY_BYTESEARCH_X86) && defined(__SSE2__)
+
+// SIMD实现每次看64字节，把比较结果压成64位掩码再用位运算组合：
+// "\r\n"的第i位 = cr[i] & lf[i+1]，所以每块只有前63位有效，下一块从第63字节开始；
+// "\r\n\r\n"同理只有前61位有效。块内不用错位重复加载，不足64字节的尾巴交给标量。
+// 先只比'\r'，块里没有'\r'就不用再比'\n'。
+const uint64_t kCRLFValid = (1ULL << 63) - 1;
+const uint64_t kCRLFCRLFValid = (1ULL << 61) - 1;
+
+inline uint64_t sse2Mask64(const char* p, __m128i needle)
+{
+  uint64_t m0 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), needle));
+  uint64_t m1 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), needle));
+  uint64_t m2 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), needle));
+  uint64_t m3 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), needle));
+  return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+const char* sse2FindByte(const char* begin, const char* end, char c)
+{
+  const __m128i needle = _mm_set1_epi8(c);
+  const char* p = begin;
+  for (; p + 64 <= end; p += 64)
+  {
+    uint64_t mask = sse2Mask64(p, needle);
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindByte(p, end, c);
+}
+
+const char* sse2FindCRLF(const char* begin, const char* end)
+{
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const char* p = begin;
+  for (; p + 64 <= end; p += 63)
+  {
+    uint64_t crMask = sse2Mask64(p, cr) & kCRLFValid;
+    if (crMask == 0)
+      continue;
+    uint64_t mask = crMask & (sse2Mask64(p, lf) >> 1);
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindCRLF(p, end);
+}
+
+const char* sse2FindCRLFCRLF(const char* begin, const char* end)
+{
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const char* p = begin;
+  for (; p + 64 <= end; p += 61)
+  {
+    uint64_t crMask = sse2Mask64(p, cr);
+    if ((crMask & kCRLFCRLFValid) == 0)
+      continue;
+    uint64_t pair = crMask & (sse2Mask64(p, lf) >> 1);
+    uint64_t mask = pair & (pair >> 2) & kCRLFCRLFValid;
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindCRLFCRLF(p, end);
+}
+
+const char* sse2FindAnyOf(const char* begin, const char* end, const char* set, size_t setSize)
+{
+  if (setSize > 16)
+    return scalarFindAnyOf(begin, end, set, setSize);
+  __m128i needles[16];
+  for (size_t i = 0; i < setSize; ++i)
+    needles[i] = _mm_set1_epi8(set[i]);
+  const char* p = begin;
+  for (; p + 64 <= end; p += 64)
+  {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < setSize; ++i)
+      mask |= sse2Mask64(p, needles[i]);
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindAnyOf(p, end, set, setSize);
+}
+
+const ByteSearchKernels kSse2 = {
+  "sse2", sse2FindByte, sse2FindCRLF, sse2FindCRLFCRLF, sse2FindAnyOf
+};
+
+// AVX2的函数单独按avx2编译，整个库不需要-mavx2；只有CPU支持时才会被选中
+#define MUTTY_AVX2 __attribute__((target("avx2")))
+
+MUTTY_AVX2 inline uint64_t avx2Mask64(const char* p, __m256i needle)
+{
+  uint32_t lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), needle));
+  uint32_t hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), needle));
+  return lo | (static_cast<uint64_t>(hi) << 32);
+}
+
+MUTTY_AVX2 const char* avx2FindByte(const char* begin, const char* end, char c)
+{
+  const __m256i needle = _mm256_set1_epi8(c);
+  const char* p = begin;
+  for (; p + 64 <= end; p += 64)
+  {
+    uint64_t mask = avx2Mask64(p, needle);
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindByte(p, end, c);
+}
+
+MUTTY_AVX2 const char* avx2FindCRLF(const char* begin, const char* end)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const char* p = begin;
+  for (; p + 64 <= end; p += 63)
+  {
+    uint64_t crMask = avx2Mask64(p, cr) & kCRLFValid;
+    if (crMask == 0)
+      continue;
+    uint64_t mask = crMask & (avx2Mask64(p, lf) >> 1);
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindCRLF(p, end);
+}
+
+MUTTY_AVX2 const char* avx2FindCRLFCRLF(const char* begin, const char* end)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const char* p = begin;
+  for (; p + 64 <= end; p += 61)
+  {
+    uint64_t crMask = avx2Mask64(p, cr);
+    if ((crMask & kCRLFCRLFValid) == 0)
+      continue;
+    uint64_t pair = crMask & (avx2Mask64(p, lf) >> 1);
+    uint64_t mask = pair & (pair >> 2) & kCRLFCRLFValid;
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindCRLFCRLF(p, end);
+}
+
+MUTTY_AVX2 const char* avx2FindAnyOf(const char* begin, const char* end, const char* set, size_t setSize)
+{
+  if (setSize > 16)
+    return scalarFindAnyOf(begin, end, set, setSize);
+  __m256i needles[16];
+  for (size_t i = 0; i < setSize; ++i)
+    needles[i] = _mm256_set1_epi8(set[i]);
+  const char* p = begin;
+  for (; p + 64 <= end; p += 64)
+  {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < setSize; ++i)
+      mask |= avx2Mask64(p, needles[i]);
+    if (mask != 0)
+      return p + __builtin_ctzll(mask);
+  }
+  return scalarFindAnyOf(p, end, set, setSize);
+}
+
+const ByteSearchKernels kAvx2 = {
+  "avx2", avx2FindByte, avx2FindCRLF, avx2FindCRLFCRLF, avx2FindAnyOf
+};
+
+bool cpuHasAvx2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+#endif  // MUTTY_BYTESEARCH_X86 && __SSE2__
+
+}  // namespace
+
+const ByteSearchKernels* byteSearchKernels(const char* name)
+{
+  if (::strcmp(name, "scalar") == 0)
+    return &kScalar;
+#if defined(MUTTY_BYTESEARCH_X86) && defined(__SSE2__)
+  if (::strcmp(name, "sse2") == 0)
+    return &kSse2;
+  if (::strcmp(name, "avx2") == 0)
+    return cpuHasAvx2() ? &kAvx2 : NULL;
+#endif
+  return NULL;
+}
+
+namespace detail
+{
+const ByteSearchKernels& selectByteSearch()
+{
+#if defined(MUTTY_BYTESEARCH_X86) && defined(__SSE2__)
+  return cpuHasAvx2() ? kAvx2 : kSse2;
+#else
+  return kScalar;
+#endif
+}
+}  // namespace detail
+
+}  // namespace buffer
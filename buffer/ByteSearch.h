@@ -0,0 +1,50 @@
+#ifndef MUTTY_BYTESEARCH_H
+#define MUTTY_BYTESEARCH_H
+
+#include <stddef.h>
+
+namespace buffer
+{
+
+// 协议解析用的字节查找：找单个字节、"\r\n"、"\r\n\r\n"、字节集合中的任意一个。
+// 有标量、SSE2(16字节一比)、AVX2(32字节一比)三套实现，第一次调用时按CPU选最快的。
+// 都在[begin, end)里找第一个匹配，返回它的位置，找不到返回NULL。
+struct ByteSearchKernels
+{
+  const char* name;
+  const char* (*findByte)(const char* begin, const char* end, char c);
+  const char* (*findCRLF)(const char* begin, const char* end);
+  const char* (*findCRLFCRLF)(const char* begin, const char* end);
+  // set里最多16个字节时走SIMD，更多时查表
+  const char* (*findAnyOf)(const char* begin, const char* end, const char* set, size_t setSize);
+};
+
+// name是"scalar"/"sse2"/"avx2"，当前CPU或编译目标不支持时返回NULL。给测试和压测用
+const ByteSearchKernels* byteSearchKernels(const char* name);
+
+namespace detail
+{
+const ByteSearchKernels& selectByteSearch();
+}  // namespace detail
+
+inline const ByteSearchKernels& activeByteSearch()
+{
+  static const ByteSearchKernels& kernels = detail::selectByteSearch();
+  return kernels;
+}
+
+inline const char* findByte(const char* begin, const char* end, char c)
+{ return begin < end ? activeByteSearch().findByte(begin, end, c) : NULL; }
+
+inline const char* findCRLF(const char* begin, const char* end)
+{ return end - begin >= 2 ? activeByteSearch().findCRLF(begin, end) : NULL; }
+
+inline const char* findCRLFCRLF(const char* begin, const char* end)
+{ return end - begin >= 4 ? activeByteSearch().findCRLFCRLF(begin, end) : NULL; }
+
+inline const char* findAnyOf(const char* begin, const char* end, const char* set, size_t setSize)
+{ return begin < end && setSize > 0 ? activeByteSearch().findAnyOf(begin, end, set, setSize) : NULL; }
+
+}  // namespace buffer
+
+#endif  // MUTTY_BYTESEARCH_H
@@ -0,0 +1,310 @@
+#include "CompositeBuffer.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
+#include "Buffer.h"
+#include "ByteSearch.h"
+
+namespace buffer
+{
+  CompositeBuffer::CompositeBuffer(int maxComponents, PooledByteBufAllocator* allocator)
+  : m_readable(0),
+    m_maxComponents(maxComponents),
+    m_nextSegmentSize(kInitialSegmentSize),
+    m_allocator(allocator)
+  {
+    assert(maxComponents >= 2);
+  }
+
+  CompositeBuffer::~CompositeBuffer()
+  {
+    retrieveAll();
+  }
+
+  PooledByteBuf* CompositeBuffer::allocate(int size)
+  {
+    PooledByteBufAllocator* allocator = m_allocator != nullptr ? m_allocator : PooledByteBufAllocator::ALLOCATOR();
+    return allocator->buffer(size);
+  }
+
+  CompositeBuffer::Component& CompositeBuffer::addSegment(size_t minSize)
+  {
+    assert(minSize <= static_cast<size_t>(PooledByteBufAllocator::DEFAULT_MAX_CAPACITY));
+    int size = std::max(m_nextSegmentSize, static_cast<int>(minSize));
+    m_nextSegmentSize = std::min(m_nextSegmentSize * 2, kMaxSegmentSize);
+    // 段太多时把已有的数据和这次要写的合并到一段里
+    size_t existing = m_components.size() >= static_cast<size_t>(m_maxComponents) ? m_readable : 0;
+
+    PooledByteBuf* buf = allocate(static_cast<int>(existing + size));
+    // 规格化之后多出来的部分也能用，不需要重新分配
+    buf->capacity(buf->maxLength());
+    Component segment = { buf, buf->tmpBuf(), 0, 0, buf->capacity() };
+    if (existing > 0)
+    {
+      copyOut(0, segment.data, existing);
+      segment.writerIndex = static_cast<int>(existing);
+      while (!m_components.empty())
+        popFront();
+      m_readable = existing;
+    }
+    m_components.push_back(segment);
+    return m_components.back();
+  }
+
+  void CompositeBuffer::addComponent(PooledByteBuf* owner, const char* data, int len)
+  {
+    // 空着的最后一段夹在中间没有用
+    if (!m_components.empty() && m_components.back().readableBytes() == 0)
+    {
+      m_components.back().owner->release();
+      m_components.pop_back();
+    }
+    if (m_components.size() >= static_cast<size_t>(m_maxComponents))
+      addSegment(0);
+    Component component = { owner, const_cast<char*>(data), 0, len, len };
+    m_components.push_back(component);
+    m_readable += len;
+  }
+
+  void CompositeBuffer::addComponent(const PooledSlicedByteBuf& slice)
+  {
+    if (!slice.valid() || slice.readableBytes() == 0)
+      return;
+    slice.unwrap()->retain();
+    addComponent(slice.unwrap(), slice.peek(), slice.readableBytes());
+  }
+
+  void CompositeBuffer::addComponent(Buffer* buf)
+  {
+    addComponent(buf->readRetainedSlice(buf->readableBytes()));
+  }
+
+  void CompositeBuffer::popFront()
+  {
+    m_readable -= m_components.front().readableBytes();
+    m_components.front().owner->release();
+    m_components.pop_front();
+  }
+
+  void CompositeBuffer::append(const char* data, size_t len)
+  {
+    while (len > 0)
+    {
+      Component* tail = !m_components.empty() && m_components.back().writableBytes() > 0
+                        ? &m_components.back() : &addSegment(len);
+      size_t n = std::min(len, static_cast<size_t>(tail->writableBytes()));
+      memcpy(tail->data + tail->writerIndex, data, n);
+      tail->writerIndex += static_cast<int>(n);
+      m_readable += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  void CompositeBuffer::retrieve(size_t len)
+  {
+    assert(len <= m_readable);
+    while (len > 0)
+    {
+      Component& front = m_components.front();
+      size_t n = front.readableBytes();
+      if (len < n)
+      {
+        front.readerIndex += static_cast<int>(len);
+        m_readable -= len;
+        return;
+      }
+      len -= n;
+      front.readerIndex = front.writerIndex;
+      m_readable -= n;
+      // 最后一段留着给之后的写入
+      if (m_components.size() > 1)
+        popFront();
+    }
+    if (m_components.size() == 1 && m_components.front().readableBytes() == 0)
+    {
+      Component& last = m_components.front();
+      if (last.writableBytes() > 0)
+        last.readerIndex = last.writerIndex = 0;
+      else
+        popFront();
+    }
+  }
+
+  void CompositeBuffer::retrieveAll()
+  {
+    while (!m_components.empty())
+      popFront();
+    assert(m_readable == 0);
+    m_nextSegmentSize = kInitialSegmentSize;
+  }
+
+  std::string CompositeBuffer::retrieveAsString(size_t len)
+  {
+    assert(len <= m_readable);
+    std::string result(len, '\0');
+    copyOut(0, &result[0], len);
+    retrieve(len);
+    return result;
+  }
+
+  size_t CompositeBuffer::copyOut(size_t offset, char* dst, size_t len) const
+  {
+    size_t copied = 0;
+    for (const Component& c : m_components)
+    {
+      if (copied == len)
+        break;
+      size_t n = c.readableBytes();
+      if (offset >= n)
+      {
+        offset -= n;
+        continue;
+      }
+      size_t chunk = std::min(n - offset, len - copied);
+      memcpy(dst + copied, c.peek() + offset, chunk);
+      copied += chunk;
+      offset = 0;
+    }
+    return copied;
+  }
+
+  ssize_t CompositeBuffer::findByte(char c, size_t from) const
+  {
+    size_t base = 0;
+    for (const Component& component : m_components)
+    {
+      size_t n = component.readableBytes();
+      if (from < base + n)
+      {
+        size_t start = from > base ? from - base : 0;
+        const char* hit = buffer::findByte(component.peek() + start, component.peek() + n, c);
+        if (hit != NULL)
+          return base + (hit - component.peek());
+      }
+      base += n;
+    }
+    return -1;
+  }
+
+  // 第index段offset处开始是否是needle，可以跨到后面的段
+  bool CompositeBuffer::matchAt(size_t index, size_t offset, const char* needle, size_t len) const
+  {
+    for (; index < m_components.size() && len > 0; ++index, offset = 0)
+    {
+      const Component& c = m_components[index];
+      size_t n = std::min(static_cast<size_t>(c.readableBytes()) - offset, len);
+      if (memcmp(c.peek() + offset, needle, n) != 0)
+        return false;
+      needle += n;
+      len -= n;
+    }
+    return len == 0;
+  }
+
+  ssize_t CompositeBuffer::find(const char* needle, size_t len, size_t from) const
+  {
+    if (len == 0)
+      return from <= m_readable ? static_cast<ssize_t>(from) : -1;
+    size_t base = 0;
+    for (size_t i = 0; i < m_components.size(); ++i)
+    {
+      const Component& c = m_components[i];
+      size_t n = c.readableBytes();
+      size_t pos = from > base ? from - base : 0;
+      while (pos < n)
+      {
+        const char* hit = buffer::findByte(c.peek() + pos, c.peek() + n, needle[0]);
+        if (hit == NULL)
+          break;
+        pos = hit - c.peek();
+        if (matchAt(i, pos, needle, len))
+          return base + pos;
+        ++pos;
+      }
+      base += n;
+    }
+    return -1;
+  }
+
+  const char* CompositeBuffer::consolidate(size_t len)
+  {
+    assert(len <= m_readable);
+    if (len <= contiguousBytes())
+      return peek();
+
+    PooledByteBuf* buf = allocate(static_cast<int>(len));
+    Component merged = { buf, buf->tmpBuf(), 0, static_cast<int>(len), buf->capacity() };
+    copyOut(0, merged.data, len);
+    retrieve(len);
+    // 剩下的只有一个空段时它就没用了
+    if (m_components.size() == 1 && m_components.front().readableBytes() == 0)
+      popFront();
+    m_components.push_front(merged);
+    m_readable += len;
+    return merged.data;
+  }
+
+  ssize_t CompositeBuffer::readFd(int fd, int* savedErrno)
+  {
+    // 最后一段剩得不多就先加一段，大部分数据直接读进来
+    if (m_components.empty() || m_components.back().writableBytes() < kInitialSegmentSize / 4)
+      addSegment(0);
+    Component& tail = m_components.back();
+    char extrabuf[65536];
+    struct iovec vec[2];
+    const size_t writable = tail.writableBytes();
+    vec[0].iov_base = tail.data + tail.writerIndex;
+    vec[0].iov_len = writable;
+    vec[1].iov_base = extrabuf;
+    vec[1].iov_len = sizeof(extrabuf);
+    const ssize_t n = ::readv(fd, vec, 2);
+    if (n < 0)
+    {
+      *savedErrno = errno;
+    }
+    else if (static_cast<size_t>(n) <= writable)
+    {
+      tail.writerIndex += static_cast<int>(n);
+      m_readable += n;
+    }
+    else
+    {
+      tail.writerIndex = tail.capacity;
+      m_readable += writable;
+      append(extrabuf, n - writable);
+    }
+    if (n <= 0 && m_readable == 0)
+      retrieveAll();
+    return n;
+  }
+
+  ssize_t CompositeBuffer::writeFd(int fd, int* savedErrno)
+  {
+    struct iovec vec[64];
+    int iovcnt = 0;
+    for (const Component& c : m_components)
+    {
+      if (iovcnt == 64)
+        break;
+      if (c.readableBytes() == 0)
+        continue;
+      vec[iovcnt].iov_base = const_cast<char*>(c.peek());
+      vec[iovcnt].iov_len = c.readableBytes();
+      ++iovcnt;
+    }
+    if (iovcnt == 0)
+      return 0;
+    const ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+      *savedErrno = errno;
+    else
+      retrieve(n);
+    return n;
+  }
+
+}  // namespace buffer
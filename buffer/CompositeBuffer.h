@@ -0,0 +1,118 @@
+#ifndef MUTTY_COMPOSITEBUFFER_H
+#define MUTTY_COMPOSITEBUFFER_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <string>
+
+#include "PooledByteBuf.h"
+#include "PooledByteBufAllocator.h"
+
+namespace buffer
+{
+
+class Buffer;
+
+// 由多段PooledByteBuf串成的缓冲区，对应Netty的CompositeByteBuf。
+// 写满了就在末尾加一段(大小逐段翻倍，最多到线程缓存能缓存的大小)，已有的数据从不为了扩容而搬动；
+// readFd()直接读进最后一段，writeFd()用writev一次写出所有段。
+// find/copyOut可以跨段，需要连续内存时用consolidate(len)把前len字节合并成一段。
+//
+// 也可以把别的缓冲区的数据零拷贝地挂进来(addComponent)，比如转发收到的请求体。
+// 段数超过maxComponents时合并成一段，这是唯一会整体拷贝的情况。
+class CompositeBuffer
+{
+ public:
+  static constexpr int kInitialSegmentSize = 4096;
+  // 和Buffer::kMaxSizeHint一样不超过线程缓存能缓存的大小，
+  // 长期使用的CompositeBuffer每次readFd()都走线程缓存，不会每段占一个chunk的大块
+  static constexpr int kMaxSegmentSize = PooledByteBufAllocator::DEFAULT_MAX_CACHED_BUFFER_CAPACITY;
+
+  /// allocator为nullptr时用默认的ALLOCATOR()
+  explicit CompositeBuffer(int maxComponents = PooledByteBufAllocator::DEFAULT_MAX_COMPONENTS,
+                           PooledByteBufAllocator* allocator = nullptr);
+  ~CompositeBuffer();
+
+  /// 之后新加的段从allocator分配，已有的段不动；nullptr恢复默认
+  void setAllocator(PooledByteBufAllocator* allocator) { m_allocator = allocator; }
+  PooledByteBufAllocator* allocator() const { return m_allocator; }
+
+  CompositeBuffer(const CompositeBuffer&) = delete;
+  CompositeBuffer& operator=(const CompositeBuffer&) = delete;
+
+  size_t readableBytes() const { return m_readable; }
+  int numComponents() const { return static_cast<int>(m_components.size()); }
+
+  // 第一段的可读数据，长度是contiguousBytes()
+  const char* peek() const
+  { return m_components.empty() ? nullptr : m_components.front().peek(); }
+  size_t contiguousBytes() const
+  { return m_components.empty() ? 0 : m_components.front().readableBytes(); }
+
+  // 末尾追加，放不下时新加一段，不动已有的段
+  void append(const char* data, size_t len);
+  void append(const std::string& str) { append(str.data(), str.size()); }
+
+  // 零拷贝地把数据挂到末尾：取走buf里全部可读数据的视图
+  void addComponent(Buffer* buf);
+  void addComponent(const PooledSlicedByteBuf& slice);
+
+  void retrieve(size_t len);
+  void retrieveAll();
+  std::string retrieveAsString(size_t len);
+  std::string retrieveAllAsString() { return retrieveAsString(m_readable); }
+
+  // 从可读数据的第offset字节开始拷出len字节(不取走)，返回实际拷贝的字节数
+  size_t copyOut(size_t offset, char* dst, size_t len) const;
+  // 找不到返回-1，返回值是相对peek()的偏移，可以跨段
+  ssize_t findByte(char c, size_t from = 0) const;
+  ssize_t find(const char* needle, size_t len, size_t from = 0) const;
+  ssize_t findCRLF(size_t from = 0) const { return find("\r\n", 2, from); }
+
+  // 保证前len字节在一段连续内存里并返回其起始地址，只拷贝跨段的那部分
+  const char* consolidate(size_t len);
+  const char* consolidate() { return consolidate(m_readable); }
+
+  /// 读进最后一段，不够时多读的部分放进新的段
+  /// @return result of read(2), @c errno is saved
+  ssize_t readFd(int fd, int* savedErrno);
+  /// writev所有段，写出的部分retrieve掉
+  /// @return result of writev(2), @c errno is saved
+  ssize_t writeFd(int fd, int* savedErrno);
+
+ private:
+  // 一段：owner持有一个引用；自己分配的段尾部还可以写，挂进来的视图只读
+  struct Component
+  {
+    PooledByteBuf* owner;
+    char* data;
+    int readerIndex;
+    int writerIndex;
+    int capacity;
+
+    const char* peek() const { return data + readerIndex; }
+    int readableBytes() const { return writerIndex - readerIndex; }
+    int writableBytes() const { return capacity - writerIndex; }
+  };
+
+  // 末尾加一段至少能写minSize字节的新段
+  Component& addSegment(size_t minSize);
+  PooledByteBuf* allocate(int size);
+  void addComponent(PooledByteBuf* owner, const char* data, int len);
+  void popFront();
+  bool matchAt(size_t index, size_t offset, const char* needle, size_t len) const;
+  void consolidateIfNeeded();
+
+  std::deque<Component> m_components;
+  size_t m_readable;
+  int m_maxComponents;
+  int m_nextSegmentSize;
+  PooledByteBufAllocator* m_allocator;  // nullptr表示默认的ALLOCATOR()
+};
+
+}  // namespace buffer
+
+#endif  // MUTTY_COMPOSITEBUFFER_H
@@ -10,24 +10,26 @@ namespace buffer{
         DoubleAdder(){};
         ~DoubleAdder(){};
         void add(double x) {
-            Cell<double> ** cs; double b, v; int m; Cell<double>* c;
-            if ((cs = m_cells) != nullptr || !casBase(b + x, b = m_base.load())) {
+            CellSlot* cs; double b, v; int m; Cell<double>* c;
+            int n = nCells.load();
+            if ((cs = m_cells.load()) != nullptr || !(b = m_base.load(), casBase(b + x, b))) {
                 int index = probe;
                 bool uncontended = true;
-                if (cs == nullptr || (m = nCells - 1) < 0 ||
-                    (c = m_cells[index & m]) == nullptr ||
-                    !(uncontended = casCellValue(v + x, v = c->value.load(), c->value)))
+                if (cs == nullptr || (m = n - 1) < 0 ||
+                    (c = cs[index & m]) == nullptr ||
+                    !(uncontended = (v = c->value.load(), casCellValue(v + x, v, c->value))))
                     longAccumulate(x, uncontended, index);
             }
         }
         double sum() {
-            Cell<double> ** cs = m_cells;
+            int n = nCells.load();
+            CellSlot* cs = m_cells.load();
             Cell<double> *c;
             double sum = m_base.load();
             std::cout<<"m_base: "<<sum<<std::endl;
             if (cs != nullptr) {
                 std::cout<<"c->value.load:";
-                for(int i = 0; i < nCells; ++i){
+                for(int i = 0; i < n; ++i){
                     if((c = cs[i]) != nullptr){
                         std::cout<<c->value.load()<<" ";
                         sum += c->value.load();
@@ -18,13 +18,14 @@ namespace buffer{
         void add(long x) {
             // cs是cells引用，b获取的base值，v期望值，
             // m为cells数组的长度，c表示当前命中的cell单元格
-            Cell<long> ** cs; long b, v; int m; Cell<long>* c;
+            CellSlot* cs; long b, v; int m; Cell<long>* c;
             // 初始时cs=cells=nullptr，Thread A会调用caseBase
             // 没有并发时，会成功将base变为base+x
             // 如果线程A B C D线性执行, casBase永远不会失败，所有值都会累计到base中
             // case1已经初始化过，当前线程应该将数据写入对应cell中
             // case2未初始化，当前所有线程应该将数据写入base中
-            if ((cs = m_cells) != nullptr || !casBase(b + x, b = m_base.load())) {
+            int n = nCells.load();
+            if ((cs = m_cells.load()) != nullptr || !(b = m_base.load(), casBase(b + x, b))) {
                 int index = probe;
                 // 为true表示未发生竞争，false表示发生竞争
                 bool uncontended = true;
@@ -36,9 +37,9 @@ namespace buffer{
                 // !!!!!多线程写同一个cell发生竞争
                 // 当前线程对应cell为空、cas失败时
                 // 需要扩容的时候就进入longAccumulate
-                if (cs == nullptr || (m = nCells - 1) < 0 ||  // 成立 说明cells未初始化，是通过casBase进入的 false表示初始化了，线程找对应cell写值
-                    (c = m_cells[index & m]) == nullptr || // m=2^i-1，为true说明当前线程的下标为空，需要创建
-                    !(uncontended = casCellValue(v + x, v = c->value.load(), c->value)))
+                if (cs == nullptr || (m = n - 1) < 0 ||  // 成立 说明cells未初始化，是通过casBase进入的 false表示初始化了，线程找对应cell写值
+                    (c = cs[index & m]) == nullptr || // m=2^i-1，为true说明当前线程的下标为空，需要创建
+                    !(uncontended = (v = c->value.load(), casCellValue(v + x, v, c->value))))
                     longAccumulate(x, uncontended, index);
             }
         }
@@ -49,20 +50,17 @@ namespace buffer{
         // 在很多的并发场景中，计数操作并不是核心，这种情况下允许计数器的值出现一点偏差，此时可以使用LongAdder
         // 在必须依赖准确计数值的场景中，应该自己处理而不是使用通用的类
         long sum() {
-            Cell<long> ** cs = m_cells;
+            int n = nCells.load();
+            CellSlot* cs = m_cells.load();
             Cell<long> *c;
             long sum = m_base.load();
-            std::cout<<"m_base: "<<sum<<std::endl;
             if (cs != nullptr) {
-                std::cout<<"c->value.load:";
-                for(int i = 0; i < nCells; ++i){
+                for(int i = 0; i < n; ++i){
                     if((c = cs[i]) != nullptr){
-                        std::cout<<c->value.load()<<" ";
                         sum += c->value.load();
                     }
                 }
             }
-            std::cout<<std::endl;
             return sum;
         }
 };
@@ -28,6 +28,9 @@ namespace buffer{
     template<class T>
     class Striped64{
     public:
+        // cells数组的槽，新建的Cell挂上去和扩容拷贝时都会被并发读
+        typedef std::atomic<Cell<T>*> CellSlot;
+
         int NCPU = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
 
         // 基数，在两种情况下会使用:
@@ -38,21 +41,22 @@ namespace buffer{
         // 自旋标识，在对cells进行初始化、扩容、在nullptr位置创建新的Cell对象时，需要通过CAS操作把此
         // 标识设置为1（busy，忙标识，相当于加锁），取消busy时可以直接使用cellsBusy = 0，相当于释放锁
         std::atomic<bool> m_cellsBusy = ATOMIC_VAR_INIT(false);
-        Cell<T> ** m_cells;
-        int nCells;
+        // cells数组和它的长度，add()/sum()不加锁地读
+        // 写的一方先发布m_cells再发布nCells，读的一方先读nCells再读m_cells，
+        // 这样读到的长度不会超过读到的数组；旧数组不释放，持有旧指针的读者仍然安全
+        std::atomic<CellSlot*> m_cells;
+        std::atomic<int> nCells;
 
         Striped64()
-        :m_cells(nullptr),
-        m_base(0),
+        :m_base(0),
+        m_cells(nullptr),
         nCells(0)
         {}
 
         ~Striped64() {
-            if(nullptr != m_cells) {
-                for(int i = 0; i < nCells; i++){
-                    m_cells[i] = nullptr;
-                }
-                delete[] m_cells;
+            CellSlot* cs = m_cells.load();
+            if(nullptr != cs) {
+                delete[] cs;
                 m_cells = nullptr;
             }
         }
@@ -94,10 +98,12 @@ namespace buffer{
             }
             // 扩容意向，false一定不会扩容，true可能会扩容
             for (bool collide = false;;) {       // True if last slot nonempty
-                Cell<T>** cs; Cell<T>* c; int n; T v;
+                Cell<T>* c; T v;
+                int n = nCells.load();
+                CellSlot* cs = m_cells.load();
                 // Cell[]数组已经初始化，其他线程也进入了LongAccumulate方法
                 // 当前线程应该将数据写入到对应的cell中
-                if ((cs = m_cells) != nullptr && (n = nCells) > 0) {
+                if (cs != nullptr && n > 0) {
                     // 当前线程的hash值运算后映射得到的Cell单元为nullptr，说明该Cell没有被使用
                     // 每个线程通过对cells[threadLocalRandomProbe%cells.length] 位置上的cell元素中的value值做累加
                     // 相当于将线程绑定到数组cells中的某个cell元素对象上
@@ -113,12 +119,12 @@ namespace buffer{
                                     // j=(m-1)&index为哈希映射index=hash&mask
                                     // mask=length-1,probe为hashcode
                                     // rs表示当前cells引用，j为当前线程命中的下标，m为cells长度
-                                    Cell<T> ** rs; int m, j;
+                                    CellSlot* rs; int m, j;
                                     // 有锁的情况下，再检测一遍之前的判断
                                     // 考虑别的线程可能执行了扩容，这里重新赋值重新判断
                                     // 条件1 2 恒成立，条件3 rs[j = (m - 1) & index] == nullptr
                                     // 为了防止时间片被强占导致 cell被其他线程初始化过该位置，而再次初始化
-                                    if ((rs = m_cells) != nullptr && (m = nCells) > 0 &&
+                                    if ((m = nCells.load()) > 0 && (rs = m_cells.load()) != nullptr &&
                                         rs[j = (m - 1) & index] == nullptr) {
                                         // 将Cell单元附到Cell[]数组上
                                         rs[j] = r;
@@ -127,6 +133,7 @@ namespace buffer{
                                 m_cellsBusy = false; // 清空自旋标识，释放锁
                                 // 如果原本为null的Cell单元是由自己进行第一次累积操作，那么任务已经完成了，所以可以退出循环
                                 if(created) break; 
+                                delete r;
                                 continue;           // Slot is now non-empty 不是自己进行第一次累积操作，重头再来
                             }
                         }
@@ -146,7 +153,7 @@ namespace buffer{
                     // case1.3 当前线程rehash过，然后新命中的cell不为空
                     // 写成功就退出循环
                     // 失败，说明rehash新命中的新cell也有竞争，重试一次
-                    else if (casCellValue(v + x, v = c->value.load(), c->value))
+                    else if ((v = c->value.load(), casCellValue(v + x, v, c->value)))
                         // 成功了就完成了累积任务，退出循环
                         break;
                     // cell数组已经是最大的了，或者中途发生了扩容操作。因为NCPU不一定是2^n，所以这里用 >=
@@ -162,12 +169,13 @@ namespace buffer{
                     // case1.6 真正扩容
                     else if (!m_cellsBusy && casCellsBusy()) {
                             if (m_cells == cs){        // Expand table unless stale
-                                // 扩容一倍
-                                m_cells = new Cell<T>*[n << 1];
+                                // 扩容一倍，新的一半必须是nullptr
+                                CellSlot* rs = new CellSlot[n << 1]();
                                 for(int i = 0; i < n; ++i){
-                                    m_cells[i] = cs[i];
+                                    rs[i] = cs[i].load();
                                 }
                                 //  Arrays.copyOf(cs, n << 1);
+                                m_cells = rs;
                                 nCells = n << 1;
                             }
                             m_cellsBusy = false;
@@ -184,13 +192,12 @@ namespace buffer{
                     bool init = false;
                         // 然后，初始化Cell[]数组（初始大小为2），根据当前线程的hash值计算映射的索引
                         // 并创建对应的Cell对象，Cell单元中的初始值x就是本次要累加的值。
-                        if (m_cells == cs) {
-                            // CAS避免不了ABA问题，这里再检测一次，如果还是null，或者空数组，那么就执行初始化
-                            Cell<T> ** rs = new Cell<T>*[2];
-                            nCells = 2;
+                        if (m_cells.load() == nullptr) {
+                            // CAS避免不了ABA问题，这里再检测一次，如果还是null，那么就执行初始化
+                            CellSlot* rs = new CellSlot[2]();
                             rs[index & 1] = new Cell<T>(x); // 对其中一个单元进行累积操作，另一个不管，继续为null
                             m_cells = rs;
-                            rs = nullptr;
+                            nCells = 2;
                             init = true;
                         }
                         m_cellsBusy = false;
@@ -201,7 +208,7 @@ namespace buffer{
                 // case2:cells被其他线程初始化后m_cells!=cs
                 // 此时另一个线程也进入LongAccumulate就会进入这个分支
                 // 直接在基数base上进行累加操作
-                else if (casBase(v + x, v = m_base.load()))
+                else if ((v = m_base.load(), casBase(v + x, v)))
                     break;
             }
         }
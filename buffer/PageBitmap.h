@@ -0,0 +1,71 @@
+#ifndef BUFFER_PAGEBITMAP_H
+#define BUFFER_PAGEBITMAP_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace buffer{
+    // 两级位图：m_words的每一位是一个下标，m_summary的每一位表示对应的m_words不为0。
+    // PoolChunk用它按runOffset记录每种规格的空闲run，取最小偏移量时先在m_summary里
+    // ctz找到非0的字，再在字里ctz，一个16MB的chunk(2048页)只看一两个字。
+    class PageBitmap {
+        std::vector<uint64_t> m_words;
+        std::vector<uint64_t> m_summary;
+
+    public:
+        static const int NO_VALUE = -1;
+
+        explicit PageBitmap(int bits = 0)
+        : m_words((bits + 63) >> 6, 0),
+          m_summary((m_words.size() + 63) >> 6, 0) {}
+
+        void set(int i) {
+            m_words[i >> 6] |= 1ULL << (i & 63);
+            m_summary[i >> 12] |= 1ULL << (i >> 6 & 63);
+        }
+
+        void clear(int i) {
+            if ((m_words[i >> 6] &= ~(1ULL << (i & 63))) == 0) {
+                m_summary[i >> 12] &= ~(1ULL << (i >> 6 & 63));
+            }
+        }
+
+        bool get(int i) const {
+            return (m_words[i >> 6] >> (i & 63) & 1) != 0;
+        }
+
+        // >= from的第一个下标，没有时返回NO_VALUE
+        int next(int from) const {
+            int w = from >> 6;
+            if (w >= static_cast<int>(m_words.size())) return NO_VALUE;
+            uint64_t bits = m_words[w] & (~0ULL << (from & 63));
+            if (bits != 0) {
+                return (w << 6) + __builtin_ctzll(bits);
+            }
+            // 在后面的字里找，先跳过m_summary里为0的
+            ++w;
+            for (int s = w >> 6; s < static_cast<int>(m_summary.size()); s++) {
+                uint64_t mask = m_summary[s];
+                if (s == w >> 6) {
+                    mask &= ~0ULL << (w & 63);
+                }
+                if (mask != 0) {
+                    int word = (s << 6) + __builtin_ctzll(mask);
+                    return (word << 6) + __builtin_ctzll(m_words[word]);
+                }
+            }
+            return NO_VALUE;
+        }
+
+        int first() const { return next(0); }
+
+        bool isEmpty() const {
+            for (uint64_t s : m_summary) {
+                if (s != 0) return false;
+            }
+            return true;
+        }
+    };
+}
+
+#endif // BUFFER_PAGEBITMAP_H
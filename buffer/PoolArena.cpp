@@ -1,19 +1,26 @@
 #include "PoolArena.h"
 
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <new>
+
 namespace buffer{
     thread_local int probe = 0;
 
     PoolArena::PoolArena(PooledByteBufAllocator* parent, int pageSize,
             int pageShifts, int chunkSize)
     :SizeClasses(pageSize, pageShifts, chunkSize),
+    m_allocationsNormal(0),
     m_deallocationsSmall(0),
     m_deallocationsNormal(0),
-    m_numThreadCaches(0),
-    m_allocationsNormal(0),
+    m_releasedBytes(0),
+    m_numSmallSubpagePools(m_nSubpages),
+    m_index(0),
     m_parent(parent),
-    m_numSmallSubpagePools(m_nSubpages){
+    m_numThreadCaches(0){
         m_smallSubpagePools.assign(m_numSmallSubpagePools, nullptr);
-        for (int i = 0; i < m_smallSubpagePools.size(); i ++) {
+        for (size_t i = 0; i < m_smallSubpagePools.size(); i ++) {
             m_smallSubpagePools[i] = newSubpagePoolHead();
         }
         // 使用INT_MAX INT_MIN会int越界
@@ -243,6 +250,54 @@ namespace buffer{
         }
     }
 
+    PoolArenaMetric PoolArena::metric(){
+        PoolArenaMetric m;
+        m.index = m_index;
+        m.numThreadCaches = m_numThreadCaches.load();
+        m.allocationsSmall = m_allocationsSmall.sum();
+        m.allocationsHuge = m_allocationsHuge.sum();
+        m.deallocationsHuge = m_deallocationsHuge.sum();
+        m.activeBytesHuge = m_activeBytesHuge.sum();
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            PoolChunkList* lists[] = {qInit, q000, q025, q050, q075, q100};
+            for (PoolChunkList* list : lists) {
+                m.chunkLists.push_back(list->metric());
+            }
+            m.allocationsNormal = m_allocationsNormal;
+            m.deallocationsSmall = m_deallocationsSmall;
+            m.deallocationsNormal = m_deallocationsNormal;
+            m.releasedBytes = m_releasedBytes;
+        }
+        for (int i = 0; i < static_cast<int>(m_smallSubpagePools.size()); i++) {
+            PoolSubpage* head = m_smallSubpagePools[i];
+            PoolSubpageMetric subpage = {sizeIdx2size(i), 0, 0, 0};
+            {
+                std::lock_guard<std::mutex> lock(head->m_mtx);
+                for (PoolSubpage* s = head->next; s != head; s = s->next) {
+                    ++subpage.numSubpages;
+                    subpage.numElements += s->maxNumElements();
+                    subpage.numAvailable += s->numAvailable();
+                }
+            }
+            if (subpage.numSubpages > 0) {
+                m.smallSubpages.push_back(subpage);
+            }
+        }
+        return m;
+    }
+
+    long PoolArena::releaseChunkPages(int minPages, int advice){
+        std::lock_guard<std::mutex> lock(m_mtx);
+        long released = 0;
+        PoolChunkList* lists[] = {qInit, q000, q025, q050, q075, q100};
+        for (PoolChunkList* list : lists) {
+            released += list->releaseFreePages(minPages, advice);
+        }
+        m_releasedBytes += released;
+        return released;
+    }
+
     DefaultArena::DefaultArena(PooledByteBufAllocator* parent, int pageSize, int pageShifts, int chunkSize)
     :PoolArena(parent, pageSize, pageShifts, chunkSize)
     {}
@@ -253,7 +308,7 @@ namespace buffer{
     }
 
     PoolChunk* DefaultArena::newUnpooledChunk(int capacity){
-        return new PoolChunk(this, defaultAllocate(m_chunkSize), capacity);
+        return new PoolChunk(this, defaultAllocate(capacity), capacity);
     }
 
     // 如果分配如512字节的小内存，除了创建chunk，还有创建subpage，PoolSubpage在初始化之后，会添加到smallSubpagePools中，其实并不是直接插入到数组，而是添加到head的next节点。下次再有分配512字节的需求时，直接从smallSubpagePools获取对应的subpage进行分配。
@@ -263,6 +318,7 @@ namespace buffer{
     }   
 
     void DefaultArena::destroyChunk(PoolChunk* chunk){ 
+        delete[] chunk->m_memory;
         delete chunk;
     }
 
@@ -274,4 +330,77 @@ namespace buffer{
         if(length == 0) return ;
         std::copy(memory + srcOffset, memory + srcOffset + length, dstbuffer->memory() + dstbuffer->offset());
     }
+
+    MmapArena::MmapArena(PooledByteBufAllocator* parent, int pageSize, int pageShifts, int chunkSize,
+                         bool hugePages, bool prefault, int releaseMinPages, bool lazyFree)
+    :DefaultArena(parent, pageSize, pageShifts, chunkSize),
+    m_hugePages(hugePages),
+    m_prefault(prefault),
+    m_releaseMinPages(releaseMinPages),
+#ifdef MADV_FREE
+    m_releaseAdvice(lazyFree ? MADV_FREE : MADV_DONTNEED)
+#else
+    m_releaseAdvice(MADV_DONTNEED)
+#endif
+    {}
+
+    PoolChunk* MmapArena::newChunk(int pageSize, int maxPageIdx, int pageShifts, int chunkSize){
+        return new PoolChunk(this, map(chunkSize), pageSize, pageShifts, chunkSize, maxPageIdx);
+    }
+
+    PoolChunk* MmapArena::newUnpooledChunk(int capacity){
+        return new PoolChunk(this, map(mappedSize(capacity)), capacity);
+    }
+
+    void MmapArena::destroyChunk(PoolChunk* chunk){
+        munmap(chunk->m_memory, mappedSize(chunk->chunkSize()));
+        delete chunk;
+    }
+
+    size_t MmapArena::mappedSize(int size){
+        static const size_t osPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return (static_cast<size_t>(size) + osPageSize - 1) & ~(osPageSize - 1);
+    }
+
+    char* MmapArena::map(size_t size){
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        bool huge = m_hugePages && size >= HUGE_PAGE_SIZE;
+        if (!huge) {
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | (m_prefault ? MAP_POPULATE : 0), -1, 0);
+            if (p == MAP_FAILED) throw std::bad_alloc();
+            return static_cast<char*>(p);
+        }
+        // 多映射一个大页再裁掉两头，得到2MiB对齐的地址，THP才能整个大页地映射
+        // 先不populate：要在MADV_HUGEPAGE之后缺页才会用大页
+        size_t mapped = size + HUGE_PAGE_SIZE;
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        char* raw = static_cast<char*>(p);
+        char* aligned = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(raw) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        if (aligned != raw) {
+            munmap(raw, aligned - raw);
+        }
+        size_t tail = (raw + mapped) - (aligned + size);
+        if (tail > 0) {
+            munmap(aligned + size, tail);
+        }
+        // 内核不支持THP时失败，照常用小页
+        madvise(aligned, size, MADV_HUGEPAGE);
+        if (m_prefault) {
+#ifdef MADV_POPULATE_WRITE
+            if (madvise(aligned, size, MADV_POPULATE_WRITE) == 0) return aligned;
+#endif
+            // 老内核没有MADV_POPULATE_WRITE，每页写一次
+            for (size_t off = 0; off < size; off += mappedSize(1)) {
+                aligned[off] = 0;
+            }
+        }
+        return aligned;
+    }
+
+    long MmapArena::releaseFreePages(){
+        if (m_releaseMinPages <= 0) return 0;
+        return releaseChunkPages(m_releaseMinPages, m_releaseAdvice);
+    }
 }
@@ -10,6 +10,7 @@
 #include "SizeClasses.h"
 #include "PooledByteBuf.h"
 #include "PooledByteBufAllocator.h"
+#include "PoolMetric.h"
 #include "LongAdder/LongAdder.h"
 
 namespace buffer{
@@ -28,7 +29,8 @@ namespace buffer{
       PoolChunkList* qInit;
       PoolChunkList* q075;
       PoolChunkList* q100;
-      // ？以下变量实际并没有什么用处
+      // 以下统计由metric()取出
+      // normal和small/normal的释放在m_mtx下计数
       long m_allocationsNormal;
       // We need to use the LongCounter here as this is not guarded via synchronized block.
       LongAdder m_allocationsSmall;
@@ -38,6 +40,7 @@ namespace buffer{
       long m_deallocationsSmall;
       long m_deallocationsNormal;
       LongAdder m_deallocationsHuge;
+      long m_releasedBytes; // releaseChunkPages()累计还给系统的字节数，在m_mtx下计数
 
       std::mutex m_mtx;
 
@@ -48,6 +51,10 @@ namespace buffer{
       void allocateNormal(PooledByteBuf* buf, int reqCapacity, int sizeIdx, PoolThreadCache* threadCache);
       void allocateHuge(PooledByteBuf* buf, int reqCapacity);
 
+    protected:
+      // 对所有池化chunk调用releaseFreePages()
+      long releaseChunkPages(int minPages, int advice);
+
     public:
       PoolArena(PooledByteBufAllocator* parent, int pageSize, int pageShifts, int chunkSize);
       PooledByteBuf* allocate(PoolThreadCache* cache, int reqCapacity, int maxCapacity);
@@ -61,10 +68,16 @@ namespace buffer{
       virtual PoolChunk* newUnpooledChunk(int capacity) = 0;
       virtual PooledByteBuf* newByteBuf(int maxCapacity) = 0;
       virtual void memoryCopy(const char* src, int srcOffset, PooledByteBuf* dst, int length) = 0;
+      // 释放chunk和它的内存
       virtual void destroyChunk(PoolChunk* chunk) = 0;
+      // 把chunk里空闲的页还给系统，返回字节数；默认的堆内存不支持，返回0
+      virtual long releaseFreePages() { return 0; }
       std::vector<PoolSubpage*> newSubpagePoolArray(int size);
+      // 统计快照，会短暂持有arena的锁和各subpage链表头的锁
+      PoolArenaMetric metric();
 
       int m_numSmallSubpagePools;
+      int m_index; // 在allocator的arena数组中的下标
       PooledByteBufAllocator* m_parent;
       // 记录了当前PoolArena已经被多少个线程使用了
       // 在每一个线程申请新内存的时候，其会找到使用最少的那个
@@ -86,6 +99,31 @@ namespace buffer{
       // void destroyPoolSubPages(PoolSubpage* pages);
       // void destroyPoolChunkLists(PoolChunkList... chunkLists);
   };
+
+  // chunk的内存直接mmap，不经过malloc，释放时munmap：
+  // hugePages时按2MiB对齐并MADV_HUGEPAGE，热点buf的TLB miss更少；
+  // prefault时分配chunk就把页都缺页进来，第一次写不再缺页；
+  // releaseMinPages>0时releaseFreePages()把至少这么多页的空闲run还给系统，
+  // lazyFree用MADV_FREE(系统内存紧张时才回收)，否则MADV_DONTNEED(RSS马上下降)
+  class MmapArena:public DefaultArena{
+      PoolChunk* newChunk(int pageSize, int maxPageIdx, int pageShifts, int chunkSize);
+      PoolChunk* newUnpooledChunk(int capacity);
+      void destroyChunk(PoolChunk* chunk);
+      char* map(size_t size);
+      static size_t mappedSize(int size);
+
+      bool m_hugePages;
+      bool m_prefault;
+      int m_releaseMinPages;
+      int m_releaseAdvice;
+
+    public:
+      static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+      MmapArena(PooledByteBufAllocator* parent, int pageSize, int pageShifts, int chunkSize,
+                bool hugePages, bool prefault, int releaseMinPages, bool lazyFree);
+      long releaseFreePages();
+  };
 }
 
 #endif // BUFFER_POOLARENA_H
\ No newline at end of file
@@ -1,63 +1,53 @@
 #include "PoolChunk.h"
 
+#include <sys/mman.h>
+
 namespace buffer{  
     PoolChunk::PoolChunk(PoolArena* arena, const char* memory, int pageSize,
                         int pageShifts, int chunkSize, int maxPageIdx)
-    :m_unpooled(false),
-    m_arena(arena),
-    m_memory(const_cast<char*>(memory)),
-    m_pageSize(pageSize),
+    :m_pageSize(pageSize),
     m_pageShifts(pageShifts),
     m_chunkSize(chunkSize),
+    m_pagesDirty(false),
+    m_arena(arena),
+    m_memory(const_cast<char*>(memory)),
+    m_unpooled(false),
     prev(nullptr),
     next(nullptr),
     m_parent(nullptr) {
         m_freeBytes = chunkSize;
-        m_runsAvail = std::move(newRunsAvailqueueArray(maxPageIdx));
-        m_subpages.assign(chunkSize >> pageShifts, nullptr);
+        int pages = m_chunkSize >> m_pageShifts;
+        m_runsAvail.assign(maxPageIdx, PageBitmap(pages));
+        m_runsAvailIdx = PageBitmap(maxPageIdx);
+        m_runsAvailMap.assign(pages, -1);
+        m_subpages.assign(pages, nullptr);
 
         // 在runsAvail数组最后位置插入一个handle，该handle代表page偏移位置为0的地方可以分配16M的内存块
-        int pages = m_chunkSize >> m_pageShifts;
         long initHandle = static_cast<long>(pages) << SIZE_SHIFT;
         insertAvailRun(0, pages, initHandle);
     }
     
     PoolChunk::PoolChunk(PoolArena* arena, const char* memory, int size)
-    :m_unpooled(true),
-    m_arena(arena),
-    m_memory(const_cast<char*>(memory)),
-    m_pageSize(0),
+    :m_pageSize(0),
     m_pageShifts(0),
     m_chunkSize(size),
-    m_freeBytes(0), m_parent(nullptr), prev(nullptr), next(nullptr)
+    m_pagesDirty(false),
+    m_arena(arena),
+    m_memory(const_cast<char*>(memory)),
+    m_freeBytes(0), m_unpooled(true), prev(nullptr), next(nullptr), m_parent(nullptr)
     {}
 
     PoolChunk::~PoolChunk(){
-        if(m_memory != nullptr){
-            delete[] m_memory;
-            m_memory = nullptr;
-        }
-
-        for(LongPriorityQueue* ptr : m_runsAvail){
-            if(ptr != nullptr) delete ptr;
-        }
         for(PoolSubpage* ptr : m_subpages){
             if(ptr != nullptr) delete ptr;
         }     
 
     }
 
-    std::vector<LongPriorityQueue*> PoolChunk::newRunsAvailqueueArray(int size){
-        std::vector<LongPriorityQueue*> runsAvail(size);
-        for (int i = 0; i < size; i++) {
-            runsAvail[i] = new LongPriorityQueue();
-        }
-        return runsAvail;
-    }
-
     void PoolChunk::insertAvailRun(int runOffset, int pages, long handle){
         int pageIdxFloor = m_arena->pages2pageIdxFloor(pages);
-        m_runsAvail[pageIdxFloor]->offer(handle);
+        m_runsAvail[pageIdxFloor].set(runOffset);
+        m_runsAvailIdx.set(pageIdxFloor);
 
         //insert first page of run
         insertAvailRun0(runOffset, handle);
@@ -68,24 +58,24 @@ namespace buffer{
     }
 
     void PoolChunk::insertAvailRun0(int runOffset, long handle){
-        m_runsAvailMap.insert(std::make_pair(runOffset,handle));
+        m_runsAvailMap[runOffset] = handle;
     }
 
     void PoolChunk::removeAvailRun(long handle){
-        int pageIdxFloor = m_arena->pages2pageIdxFloor(calculateRunPages(handle));
-        removeAvailRun(m_runsAvail[pageIdxFloor], handle);
-    }
-
-    void PoolChunk::removeAvailRun(LongPriorityQueue* queue, long handle){
-        queue->remove(handle);
-
-        int m_runOffset = calculateRunOffset(handle);
+        int runOffset = calculateRunOffset(handle);
         int pages = calculateRunPages(handle);
+        int pageIdxFloor = m_arena->pages2pageIdxFloor(pages);
+        PageBitmap& runs = m_runsAvail[pageIdxFloor];
+        runs.clear(runOffset);
+        if (runs.isEmpty()) {
+            m_runsAvailIdx.clear(pageIdxFloor);
+        }
+
         //remove first page of run
-        m_runsAvailMap.erase(m_runOffset);
+        m_runsAvailMap[runOffset] = -1;
         if (pages > 1) {
             //remove last page of run
-            m_runsAvailMap.erase(lastPage(m_runOffset, pages));
+            m_runsAvailMap[lastPage(runOffset, pages)] = -1;
         }
     }
 
@@ -148,24 +138,18 @@ namespace buffer{
         if (queueIdx == -1) return -1;
 
         //get run with min offset in this queue
-        LongPriorityQueue* queue = m_runsAvail[queueIdx];
-        // 获取这个能分配到的内存块 从runsAvail中删除了这个可用内存块
-        assert(!queue->isEmpty());
-        long handle = queue->poll();
-
-        // assert(handle != LongPriorityQueue::NO_VALUE && !isUsed(handle));
-        // assert(handle != LongPriorityQueue::NO_VALUE);
-        assert(!isUsed(handle));
-        // 从runsAvailMap移除该handle信息
-        removeAvailRun(queue, handle);
-
-        if (handle != -1) {
-            // 从#3找到的handle上划分所要的内存块
-            // 将这个可用内存块分割成两部分：
-            // 一块是 pages 大小，返回给调用者使用。
-            // 一块是剩余大小，表示还能分配内存块，还需要存入 runsAvail 中
-            handle = splitLargeRun(handle, pages);
-        }
+        int runOffset = m_runsAvail[queueIdx].first();
+        assert(runOffset != PageBitmap::NO_VALUE);
+        long handle = m_runsAvailMap[runOffset];
+        assert(handle != -1 && !isUsed(handle));
+        // 从runsAvail和runsAvailMap删除这个可用内存块
+        removeAvailRun(handle);
+
+        // 从#3找到的handle上划分所要的内存块
+        // 将这个可用内存块分割成两部分：
+        // 一块是 pages 大小，返回给调用者使用。
+        // 一块是剩余大小，表示还能分配内存块，还需要存入 runsAvail 中
+        handle = splitLargeRun(handle, pages);
         // 减少可用内存字节数
         m_freeBytes -= calculateRunSize(m_pageShifts, handle);
         return handle;
@@ -207,15 +191,8 @@ namespace buffer{
             // 如果这个 PoolChunk 还没有进行分配，直接返回
             return m_arena->m_nPSizes - 1;
         }
-        // 从刚满足run规格的 pageIdx 开始，一直遍历到最大run 规格(arena.nPSizes -1)
-        // 从 PoolChunk 中寻找能分配的 run
-        for (int i = pageIdx; i < m_arena->m_nPSizes; i++) {
-            LongPriorityQueue* queue = m_runsAvail[i];
-            if (queue != nullptr && !queue->isEmpty()) {
-                return i;
-            }
-        }
-        return -1;
+        // 从刚满足run规格的 pageIdx 开始，找第一个不为空的run 规格
+        return m_runsAvailIdx.next(pageIdx);
     }
 
     long PoolChunk::splitLargeRun(long handle, int needPages){
@@ -314,6 +291,8 @@ namespace buffer{
                 // subpage分配的内存块不复用？
                 m_subpages[sIdx] = nullptr;
             }
+            // 已经移出了arena的subpage链表，不再有别处引用
+            delete subpage;
         }
         // 到这里要么是释放normal块，要么是subpage已经被释放完了，都会得到一个完整的run
         // 计算释放的page数
@@ -335,6 +314,7 @@ namespace buffer{
             // 增加当前 PoolChunk 的可用字节数
             // 虽然可能合并了一个大的可用内存块，但是被合并的内存块原来就是可用的。
             m_freeBytes += pages << m_pageShifts; // 注意，这里一定不能用 runPages(finalRun)，
+            m_pagesDirty = true;
         }
 
         if (buffer != nullptr && !m_cachedBuffers.empty() &&
@@ -343,10 +323,37 @@ namespace buffer{
         }
     }
 
+    long PoolChunk::releaseFreePages(int minPages, int advice){
+        std::lock_guard<std::mutex> lock(m_runAvailMtx);
+        // 没有新释放的run，上次已经处理过了
+        if (!m_pagesDirty) return 0;
+        m_pagesDirty = false;
+        long released = 0;
+        int runOffset = 0;
+        while (runOffset < static_cast<int>(m_runsAvailMap.size())) {
+            long handle = m_runsAvailMap[runOffset];
+            if (handle == -1) {
+                ++runOffset;
+                continue;
+            }
+            // 从首页遇到每个空闲run，处理完跳到它后面
+            assert(calculateRunOffset(handle) == runOffset && !isUsed(handle));
+            int pages = calculateRunPages(handle);
+            if (pages >= minPages) {
+                long bytes = static_cast<long>(pages) << m_pageShifts;
+                if (madvise(m_memory + (static_cast<long>(runOffset) << m_pageShifts), bytes, advice) == 0) {
+                    released += bytes;
+                }
+            }
+            runOffset += pages;
+        }
+        return released;
+    }
+
     long PoolChunk::getAvailRunByOffset(int runOffset) {
-        if(m_runsAvailMap.find(runOffset) != m_runsAvailMap.end())
-            return m_runsAvailMap[runOffset];
-        return -1;
+        if (runOffset < 0 || runOffset >= static_cast<int>(m_runsAvailMap.size()))
+            return -1;
+        return m_runsAvailMap[runOffset];
     }
 
     long PoolChunk::collapsePast(long handle){
@@ -388,7 +395,7 @@ namespace buffer{
                 return handle;
             }
 
-            int nextOffset = calculateRunPages(nextRun);
+            int nextOffset = calculateRunOffset(nextRun);
             int nextPages = calculateRunPages(nextRun);
 
             //is continuous
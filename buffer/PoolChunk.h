@@ -1,10 +1,9 @@
 #ifndef BUFFER_POOLCHUNK_H
 #define BUFFER_POOLCHUNK_H
 
-#include <unordered_map>
 #include <deque>
 #include <mutex>
-#include "LongPriorityQueue.h"
+#include "PageBitmap.h"
 #include "PoolArena.h"
 #include "PoolChunkList.h"
 #include "PoolThreadCache.h"
@@ -12,7 +11,6 @@
 #include "PooledByteBufAllocator.h"
 
 namespace buffer{
-    class LongPriorityQueue;
     class PoolArena;
     class PoolChunkList;
     class PooledByteBuf;
@@ -54,11 +52,11 @@ namespace buffer{
             static const int INUSED_BIT_LENGTH = 1;
             static const int SUBPAGE_BIT_LENGTH = 1;
             static const int BITMAP_IDX_BIT_LENGTH = 32;
-            // key:runOffset value:handle
+            // 下标:runOffset 值:handle，没有空闲run时为-1
             // 存放着所有可分配的run内存块第一个和最后一个页偏移量runOffset，以及run内存块的handle
             // 用于释放内存块时，合并相邻内存块
             // 通过insertAvailRun0赋值
-            std::unordered_map<int, long> m_runsAvailMap;
+            std::vector<long> m_runsAvailMap;
             // 1 handle:
             // long handle表示不同的run
             // oooooooo ooooooos ssssssss ssssssue bbbbbbbb bbbbbbbb bbbbbbbb bbbbbbbb
@@ -70,15 +68,16 @@ namespace buffer{
             // e：一位bit 表示这个内存块run 是否是 isSubpage。
             // b: 一共32位，表示subpage 的 bitmapIdx。内存块在subpage中的索引
 
-            // 优先级队列数组，数组长度为【pageIdx】的大小，默认为40
+            // 位图数组，数组长度为【pageIdx】的大小，默认为40
             // 【管理所有可分配的run内存块】，run根据拥有的页数不同可以分为40种
-            // runsAvail中每一个优先级队列管理一种类型run的内存块
-            // 存放的是handle（维护内存块的信息）
-            // 【排序】的是run内存块的【页偏移量runOffset】
-            // 初始时，runsAvail 在下标 39 的优先级队列中存放这个整块PoolChunk 的 run 内存块
+            // m_runsAvail[pageIdx]中置位的是这种run的【页偏移量runOffset】，handle从m_runsAvailMap取
+            // 分配时取偏移量最小的run，和原来优先级队列的顺序一样；插入删除都是O(1)
+            // 初始时，在下标 39 的位图中存放这个整块PoolChunk 的 run 内存块
             // 即 runOffset 是 0, size 是 chunkSize/pageSize。
-            // 通过insertAvailRun赋值 ->offer
-            std::vector<LongPriorityQueue*> m_runsAvail;
+            // 通过insertAvailRun赋值
+            std::vector<PageBitmap> m_runsAvail;
+            // 第pageIdx位表示m_runsAvail[pageIdx]不为空，runFirstBestFit用
+            PageBitmap m_runsAvailIdx;
             // 用于管理PoolChunk下的所有PoolSubpage
             // 对应二叉树中2048个节点
             // 每一个PoolSubPage代表了二叉树的一个叶节点
@@ -91,9 +90,9 @@ namespace buffer{
             int m_pageSize;
             int m_pageShifts;
             int m_chunkSize;
+            // 上次releaseFreePages()之后有run被释放过
+            bool m_pagesDirty;
 
-            std::vector<LongPriorityQueue*> newRunsAvailqueueArray(int size);
-            // std::vector<LongPriorityQueue*> newRunsAvailQueue(int size);
             void insertAvailRun(int runOffset, int pages, long handle);
             inline static int lastPage(int runOffset, int pages) {
                 return runOffset + pages - 1;
@@ -111,7 +110,6 @@ namespace buffer{
             long collapsePast(long handle); // 合并前面的可用内存块
             long collapseNext(long handle); // 合并后面的可用内存块
             void removeAvailRun(long handle);
-            void removeAvailRun(LongPriorityQueue* queue, long handle);
             // int runSize(int pageShifts, long handle);
             long getAvailRunByOffset(int runOffset);
 
@@ -154,11 +152,14 @@ namespace buffer{
             }
             bool allocate(PooledByteBuf* buf, int reqCapacity, int sizeIdx, PoolThreadCache* cache);
             int usage();
+            // 把至少minPages页的空闲run用madvise(advice)还给系统，返回字节数；
+            // 需要在arena的锁下调用，memory必须是页对齐的(mmap得到的)
+            long releaseFreePages(int minPages, int advice);
             // void destroy(){}
 
             
             PoolArena* m_arena; // PoolChunk所属Arena
-            // 当前申请的内存块，16M
+            // 当前申请的内存块，16M；由arena的destroyChunk()释放
             char* m_memory;
             int m_freeBytes; // 记录了当前PoolChunk中还剩余的可申请的字节数
             bool m_unpooled; // 指定当前是否使用内存池的方式进行管理
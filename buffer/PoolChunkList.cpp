@@ -138,4 +138,22 @@ namespace buffer{
     int PoolChunkList::maxUsage(){
         return std::min(m_maxUsage, 100);
     }
+
+    PoolChunkListMetric PoolChunkList::metric(){
+        PoolChunkListMetric m = {minUsage(), maxUsage(), 0, 0, 0};
+        for (PoolChunk* cur = m_head; cur != nullptr; cur = cur->next) {
+            ++m.numChunks;
+            m.usedBytes += cur->chunkSize() - cur->m_freeBytes;
+            m.freeBytes += cur->m_freeBytes;
+        }
+        return m;
+    }
+
+    long PoolChunkList::releaseFreePages(int minPages, int advice){
+        long released = 0;
+        for (PoolChunk* cur = m_head; cur != nullptr; cur = cur->next) {
+            released += cur->releaseFreePages(minPages, advice);
+        }
+        return released;
+    }
 }
\ No newline at end of file
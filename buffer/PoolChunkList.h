@@ -7,6 +7,7 @@
 #include "PoolArena.h"
 #include "PoolChunk.h"
 #include "PooledByteBuf.h"
+#include "PoolMetric.h"
 
 namespace buffer{
   class PoolArena;
@@ -49,6 +50,10 @@ namespace buffer{
       int minUsage();
       int maxUsage();
       static int minUsage0(int value) {return std::max(1, value);}
+      // 需要在arena的锁下调用
+      PoolChunkListMetric metric();
+      // 对链表里每个chunk调用releaseFreePages()，需要在arena的锁下调用
+      long releaseFreePages(int minPages, int advice);
       // void destroy(PoolArena* arena);
   };
 }
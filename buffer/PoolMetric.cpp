@@ -0,0 +1,88 @@
+#include "PoolMetric.h"
+
+#include <stdio.h>
+
+namespace buffer{
+    int PoolArenaMetric::numChunks() const {
+        int n = 0;
+        for (const PoolChunkListMetric& list : chunkLists) {
+            n += list.numChunks;
+        }
+        return n;
+    }
+
+    long PoolArenaMetric::usedBytes() const {
+        long n = 0;
+        for (const PoolChunkListMetric& list : chunkLists) {
+            n += list.usedBytes;
+        }
+        return n;
+    }
+
+    long PoolArenaMetric::freeBytes() const {
+        long n = 0;
+        for (const PoolChunkListMetric& list : chunkLists) {
+            n += list.freeBytes;
+        }
+        return n;
+    }
+
+    double PoolThreadCacheMetric::hitRate() const {
+        long total = hits() + misses();
+        return total == 0 ? 0.0 : static_cast<double>(hits()) / total;
+    }
+
+    long PooledByteBufAllocatorMetric::usedBytes() const {
+        long n = 0;
+        for (const PoolArenaMetric& arena : arenas) {
+            n += arena.usedBytes() + arena.activeBytesHuge;
+        }
+        return n;
+    }
+
+    long PooledByteBufAllocatorMetric::freeBytes() const {
+        long n = 0;
+        for (const PoolArenaMetric& arena : arenas) {
+            n += arena.freeBytes();
+        }
+        return n;
+    }
+
+    std::string PooledByteBufAllocatorMetric::toString() const {
+        static const char* const kListNames[] = {"qInit", "q000", "q025", "q050", "q075", "q100"};
+        std::string out;
+        char line[256];
+        snprintf(line, sizeof line, "allocator: %zu arena(s), %zu thread cache(s), pageSize %d, chunkSize %d, used %ld, free %ld\n",
+                 arenas.size(), threadCaches.size(), pageSize, chunkSize, usedBytes(), freeBytes());
+        out += line;
+        for (const PoolArenaMetric& arena : arenas) {
+            snprintf(line, sizeof line, "arena %d: %d thread cache(s), %d chunk(s), used %ld, free %ld, huge active %ld, released %ld\n",
+                     arena.index, arena.numThreadCaches, arena.numChunks(),
+                     arena.usedBytes(), arena.freeBytes(), arena.activeBytesHuge, arena.releasedBytes);
+            out += line;
+            snprintf(line, sizeof line, "  allocations small %ld normal %ld huge %ld, deallocations small %ld normal %ld huge %ld\n",
+                     arena.allocationsSmall, arena.allocationsNormal, arena.allocationsHuge,
+                     arena.deallocationsSmall, arena.deallocationsNormal, arena.deallocationsHuge);
+            out += line;
+            for (size_t i = 0; i < arena.chunkLists.size(); i++) {
+                const PoolChunkListMetric& list = arena.chunkLists[i];
+                snprintf(line, sizeof line, "  %-5s [%d%%, %d%%]: %d chunk(s), used %ld, free %ld\n",
+                         i < 6 ? kListNames[i] : "?", list.minUsage, list.maxUsage,
+                         list.numChunks, list.usedBytes, list.freeBytes);
+                out += line;
+            }
+            for (const PoolSubpageMetric& subpage : arena.smallSubpages) {
+                snprintf(line, sizeof line, "  subpage %6d: %d page(s), %d/%d elements available\n",
+                         subpage.elemSize, subpage.numSubpages, subpage.numAvailable, subpage.numElements);
+                out += line;
+            }
+        }
+        for (const PoolThreadCacheMetric& cache : threadCaches) {
+            snprintf(line, sizeof line, "thread cache %ld (arena %d): small %ld hit / %ld miss, normal %ld hit / %ld miss, hit rate %.1f%%, %ld remote free(s)\n",
+                     cache.threadId, cache.arenaIndex, cache.smallHits, cache.smallMisses,
+                     cache.normalHits, cache.normalMisses, cache.hitRate() * 100, cache.remoteFrees);
+            out += line;
+        }
+        return out;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef BUFFER_POOLMETRIC_H
+#define BUFFER_POOLMETRIC_H
+
+#include <string>
+#include <vector>
+
+/*
+内存池的统计快照，对应Netty的PoolArenaMetric/PoolChunkListMetric/PoolSubpageMetric/PooledByteBufAllocatorMetric。
+都是取快照那一刻拷出来的值，取完之后不再和内存池有关联，可以在任意线程读。
+每个arena在自己的锁下取，不同arena之间不是同一时刻的值。
+*/
+namespace buffer{
+    // 一个PoolChunkList里的chunk
+    struct PoolChunkListMetric{
+        int minUsage;
+        int maxUsage;
+        int numChunks;
+        long usedBytes;
+        long freeBytes;
+    };
+
+    // 一种small规格在smallSubpagePools里的subpage
+    // 已经分配满的subpage会移出链表，不在这里统计
+    struct PoolSubpageMetric{
+        int elemSize;
+        int numSubpages;
+        int numElements;  // 这些subpage一共能分出的块数
+        int numAvailable; // 其中还空着的块数
+    };
+
+    struct PoolArenaMetric{
+        int index;
+        int numThreadCaches;
+        // 依次是qInit, q000, q025, q050, q075, q100
+        std::vector<PoolChunkListMetric> chunkLists;
+        // 只列出有subpage的规格
+        std::vector<PoolSubpageMetric> smallSubpages;
+        // 线程缓存命中的分配不经过arena，不计在这里
+        long allocationsSmall;
+        long allocationsNormal;
+        long allocationsHuge;
+        long deallocationsSmall;
+        long deallocationsNormal;
+        long deallocationsHuge;
+        long activeBytesHuge;
+        long releasedBytes; // 空闲页madvise还给系统的累计字节数，只有mmapChunks时有
+
+        int numChunks() const;
+        // 池化chunk里已分配/空闲的字节数，不含huge
+        long usedBytes() const;
+        long freeBytes() const;
+        long numAllocations() const { return allocationsSmall + allocationsNormal + allocationsHuge; }
+        long numDeallocations() const { return deallocationsSmall + deallocationsNormal + deallocationsHuge; }
+    };
+
+    // 线程缓存的命中情况，只统计线程缓存能缓存的规格
+    struct PoolThreadCacheMetric{
+        int arenaIndex;
+        long threadId;
+        long smallHits;
+        long smallMisses;
+        long normalHits;
+        long normalMisses;
+        long remoteFrees; // 别的线程释放、经归还队列回到这个缓存的buf数
+
+        long hits() const { return smallHits + normalHits; }
+        long misses() const { return smallMisses + normalMisses; }
+        double hitRate() const;
+    };
+
+    struct PooledByteBufAllocatorMetric{
+        int pageSize;
+        int chunkSize;
+        std::vector<PoolArenaMetric> arenas;
+        std::vector<PoolThreadCacheMetric> threadCaches;
+
+        long usedBytes() const;
+        long freeBytes() const;
+        // 多行文本，看碎片和各arena的负载
+        std::string toString() const;
+    };
+}
+
+#endif // BUFFER_POOLMETRIC_H
@@ -51,6 +51,8 @@ namespace buffer{
       bool free(PoolSubpage* head, int bitmapIdx);
       long allocate();
       int pageSize();
+      int maxNumElements() const { return m_maxNumElems; }
+      int numAvailable() const { return m_numAvail; }
       // void destroy();
 
       PoolSubpage* prev;
@@ -1,34 +1,127 @@
 #include "PoolThreadCache.h"
 
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
 namespace buffer{
     PoolThreadCache::PoolThreadCache(PoolArena* arena, int smallCacheSize, int normalCacheSize,
-            int maxCachedBufferCapacity, int freeSweepAllocationThreshold)
-    :m_freeSweepAllocationThreshold(freeSweepAllocationThreshold),
-    m_arena(arena),
-    m_allocations(0){
+            int maxCachedBufferCapacity, int freeSweepAllocationThreshold, long trimIntervalMillis)
+    :m_allocations(0),
+    m_freeSweepAllocationThreshold(freeSweepAllocationThreshold),
+    m_trimIntervalMillis(trimIntervalMillis),
+    m_lastTrimMillis(currentMillis()),
+    m_releaseRequestsSeen(m_releaseRequests.load(std::memory_order_relaxed)),
+    m_smallHits(0),
+    m_smallMisses(0),
+    m_normalHits(0),
+    m_normalMisses(0),
+    m_remoteFrees(0),
+    m_threadId(static_cast<long>(::syscall(SYS_gettid))),
+    m_remoteFreeHead(nullptr),
+    m_remoteFreesPending(0),
+    m_arena(arena){
+        createCaches(smallCacheSize, normalCacheSize, maxCachedBufferCapacity);
+
+        // Only check if there are caches in use.
+        if ((!m_smallSubPageCaches.empty() || !m_normalCaches.empty()) && m_freeSweepAllocationThreshold < 1)
+            throw std::exception();
+    }
+
+    void PoolThreadCache::createCaches(int smallCacheSize, int normalCacheSize, int maxCachedBufferCapacity){
         assert(maxCachedBufferCapacity >= 0);
         if (m_arena != nullptr) {
-            m_smallSubPageCaches = createSubPageCaches(smallCacheSize, arena->m_numSmallSubpagePools);
-            m_normalCaches = createNormalCaches(normalCacheSize, maxCachedBufferCapacity, arena);
-            (arena->m_numThreadCaches)++;
+            m_smallSubPageCaches = createSubPageCaches(smallCacheSize, m_arena->m_numSmallSubpagePools);
+            m_normalCaches = createNormalCaches(normalCacheSize, maxCachedBufferCapacity, m_arena);
+            (m_arena->m_numThreadCaches)++;
         } else {
             m_smallSubPageCaches.clear();
             m_normalCaches.clear();
         }
+    }
 
-        // Only check if there are caches in use.
-        if ((!m_smallSubPageCaches.empty() || !m_normalCaches.empty()) && m_freeSweepAllocationThreshold < 1)
-            throw std::exception();
+    void PoolThreadCache::reopen(int smallCacheSize, int normalCacheSize, int maxCachedBufferCapacity){
+        assert(m_remoteFreeHead.load(std::memory_order_relaxed) == kRemoteFreesClosed);
+        createCaches(smallCacheSize, normalCacheSize, maxCachedBufferCapacity);
+        m_toFree = false;
+        m_allocations = 0;
+        m_lastTrimMillis = currentMillis();
+        m_releaseRequestsSeen = m_releaseRequests.load(std::memory_order_relaxed);
+        m_smallHits = 0;
+        m_smallMisses = 0;
+        m_normalHits = 0;
+        m_normalMisses = 0;
+        m_remoteFrees = 0;
+        m_threadId = static_cast<long>(::syscall(SYS_gettid));
+        // 关闭前的buf也可能在这之后还回来，它们的内存同样来自m_arena，照常收下
+        m_remoteFreesPending.store(0, std::memory_order_relaxed);
+        m_remoteFreeHead.store(nullptr, std::memory_order_release);
     }
 
     // 直接调用free(true)?
     PoolThreadCache::~PoolThreadCache() {
+        destroyCaches();
+    }
+
+    void PoolThreadCache::destroyCaches() {
         for(MemoryRegionCache* ptr : m_smallSubPageCaches){
             if(ptr != nullptr) delete ptr;
         }
         for(MemoryRegionCache* ptr : m_normalCaches){
             if(ptr != nullptr) delete ptr;
-        }     
+        }
+        m_smallSubPageCaches.clear();
+        m_normalCaches.clear();
+    }
+
+    PooledByteBuf* const PoolThreadCache::kRemoteFreesClosed = reinterpret_cast<PooledByteBuf*>(1);
+
+    bool PoolThreadCache::addRemoteFree(PooledByteBuf* buf){
+        // 只是个大概的上限，多几个没关系
+        if (m_remoteFreesPending.load(std::memory_order_relaxed) >= kMaxRemoteFrees) {
+            return false;
+        }
+        PooledByteBuf* head = m_remoteFreeHead.load(std::memory_order_relaxed);
+        do {
+            if (head == kRemoteFreesClosed) {
+                return false;
+            }
+            buf->m_nextRemoteFree = head;
+        } while (!m_remoteFreeHead.compare_exchange_weak(head, buf,
+                        std::memory_order_release, std::memory_order_relaxed));
+        m_remoteFreesPending.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 在本线程把别的线程还回来的buf放进自己的缓存，和本线程自己释放一样不加锁
+    void PoolThreadCache::drainRemoteFrees(){
+        PooledByteBuf* buf = m_remoteFreeHead.exchange(nullptr, std::memory_order_acquire);
+        long n = 0;
+        while (buf != nullptr) {
+            PooledByteBuf* next = buf->m_nextRemoteFree;
+            buf->m_nextRemoteFree = nullptr;
+            buf->freeMemory(this);
+            buf->recycle();
+            buf = next;
+            ++n;
+        }
+        m_remoteFreesPending.fetch_sub(static_cast<int>(n), std::memory_order_relaxed);
+        m_remoteFrees.store(m_remoteFrees.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void PoolThreadCache::close(){
+        PooledByteBuf* buf = m_remoteFreeHead.exchange(kRemoteFreesClosed, std::memory_order_acquire);
+        assert(buf != kRemoteFreesClosed);
+        while (buf != nullptr) {
+            PooledByteBuf* next = buf->m_nextRemoteFree;
+            buf->m_nextRemoteFree = nullptr;
+            buf->freeMemory(nullptr);
+            // 线程退出时thread_local的回收站可能已经析构了，直接delete
+            delete buf;
+            buf = next;
+        }
+        free(true);
+        destroyCaches();
     }
 
     std::vector<MemoryRegionCache*> PoolThreadCache::createSubPageCaches(
@@ -118,12 +211,59 @@ namespace buffer{
         return cache(m_normalCaches, idx);
     }
 
+    std::atomic<long> PoolThreadCache::m_releaseRequests(0);
+
+    long PoolThreadCache::currentMillis(){
+        // 精度几毫秒足够，COARSE走vDSO不进内核
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+    }
+
+    void PoolThreadCache::beforeAllocate(){
+        if (m_remoteFreeHead.load(std::memory_order_relaxed) != nullptr) {
+            drainRemoteFrees();
+        }
+        if (releaseRequested()) {
+            releaseCached();
+        } else if (m_trimIntervalMillis > 0 && (m_allocations & 63) == 0 &&
+                   currentMillis() - m_lastTrimMillis >= m_trimIntervalMillis) {
+            // 每64次分配看一次时间
+            trim();
+        }
+    }
+
     bool PoolThreadCache::allocateSmall(PoolArena* area, PooledByteBuf* buf, int reqCapacity, int sizeIdx){
-        return allocate(cacheForSmall(area, sizeIdx), buf, reqCapacity);
+        beforeAllocate();
+        MemoryRegionCache* cache = cacheForSmall(area, sizeIdx);
+        bool allocated = allocate(cache, buf, reqCapacity);
+        if (cache != nullptr) {
+            count(allocated ? m_smallHits : m_smallMisses);
+        }
+        return allocated;
     }
 
     bool PoolThreadCache::allocateNormal(PoolArena* area, PooledByteBuf* buf, int reqCapacity, int sizeIdx){
-        return allocate(cacheForNormal(area, sizeIdx), buf, reqCapacity);
+        beforeAllocate();
+        MemoryRegionCache* cache = cacheForNormal(area, sizeIdx);
+        bool allocated = allocate(cache, buf, reqCapacity);
+        // 超过maxCachedBufferCapacity的规格没有缓存，不算未命中
+        if (cache != nullptr) {
+            count(allocated ? m_normalHits : m_normalMisses);
+        }
+        return allocated;
+    }
+
+    PoolThreadCacheMetric PoolThreadCache::metric() const {
+        PoolThreadCacheMetric m;
+        m.arenaIndex = m_arena != nullptr ? m_arena->m_index : -1;
+        m.threadId = m_threadId;
+        m.smallHits = m_smallHits.load(std::memory_order_relaxed);
+        m.smallMisses = m_smallMisses.load(std::memory_order_relaxed);
+        m.normalHits = m_normalHits.load(std::memory_order_relaxed);
+        m.normalMisses = m_normalMisses.load(std::memory_order_relaxed);
+        m.remoteFrees = m_remoteFrees.load(std::memory_order_relaxed);
+        return m;
     }
 
     bool PoolThreadCache::add(PoolArena* area, PoolChunk* chunk, char* buffer, long handle,
@@ -139,21 +279,18 @@ namespace buffer{
     }
 
     // finalize:free(true)    onRemoval:free(false)
-    // 但是onRemoval未被调用？所以总是true
+    // 线程退出时由close()调用
     void PoolThreadCache::free(bool finalizer){
         bool com = false;
         // 保证只被调用一次
         if (m_toFree.compare_exchange_strong(com, true)) {
-            int numFreed = free(m_smallSubPageCaches, finalizer) +
-                    free(m_normalCaches, finalizer);
+            free(m_smallSubPageCaches, finalizer);
+            free(m_normalCaches, finalizer);
 
             if (m_arena != nullptr) {
-                (m_arena->m_numThreadCaches)++;
+                --m_arena->m_numThreadCaches;
             }
         }
-        if(m_arena != nullptr){
-            --m_arena->m_numThreadCaches;
-        }
     }
 
     int MemoryRegionCache::free(bool finalizer) {
@@ -161,10 +298,34 @@ namespace buffer{
     }
 
     void PoolThreadCache::trim(){
-        // 内存总的申请次数达到8192时遍历其所有的MemoryRegionCache
-        // 调用trim()方法进行内存释放
+        // 内存总的申请次数达到8192次、距上次trim超过trimIntervalMillis或者所在的EventLoop空闲时，
+        // 遍历其所有的MemoryRegionCache调用trim()方法进行内存释放。
+        // 先把别的线程还回来的buf收进缓存，空闲的loop不再分配，不在这里取就一直压在栈里
+        if (m_remoteFreeHead.load(std::memory_order_relaxed) != nullptr) {
+            drainRemoteFrees();
+        }
+        if (releaseRequested()) {
+            releaseCached();
+            return;
+        }
         trim(m_smallSubPageCaches);
         trim(m_normalCaches);
+        m_lastTrimMillis = currentMillis();
+    }
+
+    int PoolThreadCache::releaseCached(){
+        m_releaseRequestsSeen = m_releaseRequests.load(std::memory_order_relaxed);
+        if (m_remoteFreeHead.load(std::memory_order_relaxed) != nullptr) {
+            drainRemoteFrees();
+        }
+        int numFreed = free(m_smallSubPageCaches, false) + free(m_normalCaches, false);
+        m_allocations = 0;
+        m_lastTrimMillis = currentMillis();
+        return numFreed;
+    }
+
+    void PoolThreadCache::releaseAll(){
+        m_releaseRequests.fetch_add(1, std::memory_order_relaxed);
     }
 
     MemoryRegionCache::Entry::~Entry(){
@@ -192,14 +353,20 @@ namespace buffer{
         PoolChunk* chunk = entry->m_chunk;
         long handle = entry->handle;
         char* buffer = entry->buffer;
+        int normCapacity = entry->normCapacity;
 
         if (!finalizer) {
             // recycle now so PoolChunk can be GC'ed. This will only be done if this is not freed because of
             // a finalizer.
             entry->recycle();
+        } else {
+            // 线程退出时不再放回回收站；先清空，Entry的析构函数会释放chunk
+            entry->m_chunk = nullptr;
+            entry->buffer = nullptr;
+            delete entry;
         }
 
-        chunk->m_arena->freeChunk(chunk, handle, entry->normCapacity, m_sizeClassType, buffer, finalizer);
+        chunk->m_arena->freeChunk(chunk, handle, normCapacity, m_sizeClassType, buffer, finalizer);
     }
 
     Recycler<MemoryRegionCache::Entry>* MemoryRegionCache::Entry::m_recycler = new MemoryRegionCache::EntryBufRecycler();
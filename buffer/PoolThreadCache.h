@@ -10,6 +10,7 @@
 #include "MathUtil.h"
 #include "PoolArena.h"
 #include "PoolChunk.h"
+#include "PoolMetric.h"
 
 /*                             smallSubpagePools
                               -------------------------          queue.size=512
@@ -63,11 +64,42 @@ namespace buffer{
     std::atomic_bool m_toFree = ATOMIC_VAR_INIT(false);
     int m_allocations;
     int m_freeSweepAllocationThreshold;
+    // 按时间trim：每隔m_trimIntervalMillis毫秒至少trim一次，<=0时只按分配次数trim
+    long m_trimIntervalMillis;
+    long m_lastTrimMillis;
+    // releaseAll()的请求次数，和本缓存处理过的次数不同时把缓存全部还给arena
+    static std::atomic<long> m_releaseRequests;
+    long m_releaseRequestsSeen;
+
+    // 命中统计只有所属线程写，metric()可以在别的线程读
+    std::atomic<long> m_smallHits;
+    std::atomic<long> m_smallMisses;
+    std::atomic<long> m_normalHits;
+    std::atomic<long> m_normalMisses;
+    std::atomic<long> m_remoteFrees;
+    long m_threadId;
+
+    // 别的线程释放的、由本线程分配的buf，无锁的MPSC栈，通过PooledByteBuf::m_nextRemoteFree串起来。
+    // 别的线程只压栈，本线程一次取走整条链表，没有ABA问题；线程退出后换成kRemoteFreesClosed，不再接收
+    std::atomic<PooledByteBuf*> m_remoteFreeHead;
+    // 栈里大约有多少个buf。本线程不再分配也不trim时没人取，超过kMaxRemoteFrees就不再接收，
+    // 由释放的线程直接还给arena，免得内存一直压在栈里
+    std::atomic<int> m_remoteFreesPending;
+    static PooledByteBuf* const kRemoteFreesClosed;
+    void drainRemoteFrees();
+    void createCaches(int smallCacheSize, int normalCacheSize, int maxCachedBufferCapacity);
+    void destroyCaches();
+    // 分配前处理别的线程的归还、全局释放请求和按时间的trim
+    void beforeAllocate();
+    static long currentMillis();
+    static void count(std::atomic<long>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
     
 
     public:
       PoolThreadCache(PoolArena* arena, int smallCacheSize, int normalCacheSize,
-             int maxCachedBufferCapacity, int freeSweepAllocationThreshold);
+             int maxCachedBufferCapacity, int freeSweepAllocationThreshold, long trimIntervalMillis = 0);
       ~PoolThreadCache();
       // 在对应的内存数组中找到MemoryRegionCache对象之后，通过调用allocate()方法来申请内存
       // 申请完之后还会检查当前缓存申请次数是否达到了8192次
@@ -76,10 +108,30 @@ namespace buffer{
       bool allocateNormal(PoolArena* area, PooledByteBuf* buf, int reqCapacity, int sizeIdx);
       bool add(PoolArena* area, PoolChunk* chunk, char* buffer, long handle, int normCapacity, SizeClassType sizeClass);
       void free(bool finalizer);
+      // 先收下别的线程还回来的buf，再把分配得少的缓存还给arena；一段时间没有分配时等于全部归还。只能在本线程调用
       void trim();
-
-      inline MemoryRegionCache* cache(std::vector<MemoryRegionCache*> cache, int sizeIdx){
-        if (cache.empty() || sizeIdx > cache.size() - 1) {
+      // 把缓存的内存全部还给arena，缓存以后照常使用，返回归还的块数。只能在本线程调用
+      int releaseCached();
+      // 请求所有线程缓存全部归还：各线程在下次从缓存分配或trim()时归还
+      static void releaseAll();
+      bool releaseRequested() const {
+        return m_releaseRequestsSeen != m_releaseRequests.load(std::memory_order_relaxed);
+      }
+      PoolThreadCacheMetric metric() const;
+
+      // 在别的线程释放buf时调用，把buf交给本线程，以后在本线程归还。
+      // 本线程已经退出时返回false，调用方自己还给arena
+      bool addRemoteFree(PooledByteBuf* buf);
+      // 线程退出时在本线程调用：关闭归还队列，队列里和缓存里的内存都还给arena。
+      // 对象本身不释放，别的线程手里的buf还指着它；allocator留着给以后新建的线程reopen()
+      void close();
+      // 在新的线程里重新启用close()过的缓存，还用原来的arena，统计从0开始
+      void reopen(int smallCacheSize, int normalCacheSize, int maxCachedBufferCapacity);
+      // 归还队列里最多积压这么多buf，再多的由释放的线程直接还给arena
+      static const int kMaxRemoteFrees = 512;
+
+      inline MemoryRegionCache* cache(const std::vector<MemoryRegionCache*>& cache, int sizeIdx){
+        if (sizeIdx < 0 || static_cast<size_t>(sizeIdx) >= cache.size()) {
             return nullptr;
         }
         return cache[sizeIdx];
@@ -92,6 +144,7 @@ namespace buffer{
     // PoolThreadCache维护每一个内存块最终都是使用的一个Entry对象来进行的
     struct Entry{
       static Recycler<Entry>* m_recycler;
+      Recycler<Entry>::Handle m_recyclerHandle;
       // 记录当前内存块是从哪一个PoolChunk中申请得来的
       PoolChunk* m_chunk;
       // 如果是直接内存，该属性记录了当前内存块所在的ByteBuffer对象
@@ -4,7 +4,7 @@
 
 namespace buffer{
     PooledByteBuf::PooledByteBuf(int maxCapacity)
-    : m_allocator(nullptr), m_maxCapacity(maxCapacity), m_chunk(nullptr), m_handle(0), m_memory(nullptr), m_offset(0), 
+    : m_allocator(nullptr), m_maxCapacity(maxCapacity), m_refCnt(1), m_nextRemoteFree(nullptr), m_chunk(nullptr), m_handle(0), m_memory(nullptr), m_offset(0), 
       m_length(0), m_maxLength(0), m_cache(nullptr), m_tmpBuf(nullptr), m_readerIndex(0), m_writerIndex(0)
     {
         assert(maxCapacity >= 0);
@@ -31,19 +31,53 @@ namespace buffer{
     // PooledByteBuf
     void PooledByteBuf::deallocate(){
         if (m_handle >= 0) {
-            // 清除对象相关属性
-            long handle = m_handle;
-            m_handle = -1;
-            m_memory = nullptr;
-            // 释放PoolChunk中申请的内存空间 注意是handle，而不是m_handle
-            m_chunk->m_arena->free(m_chunk, m_tmpBuf, handle, m_maxLength, m_cache);
-            m_tmpBuf = nullptr;
-            m_chunk = nullptr;
+            // 线程缓存不是线程安全的。别的线程分配的buf交给分配线程的归还队列，
+            // 由那个线程下次分配或trim时放回自己的缓存，这里不碰arena的锁；
+            // 分配线程已经退出(队列关闭)或者队列里积压太多时，才直接还给arena
+            PoolThreadCache* current = m_allocator->currentThreadCache();
+            if (m_cache != current && m_cache != nullptr && m_cache->addRemoteFree(this)) {
+                return;
+            }
+            freeMemory(m_cache == current ? m_cache : nullptr);
             // 回收这个PooledByteBuf
             recycle();
         }
     }
 
+    void PooledByteBuf::freeMemory(PoolThreadCache* cache){
+        assert(m_handle >= 0);
+        // 清除对象相关属性
+        long handle = m_handle;
+        m_handle = -1;
+        m_memory = nullptr;
+        // 释放PoolChunk中申请的内存空间 注意是handle，而不是m_handle
+        m_chunk->m_arena->free(m_chunk, m_tmpBuf, handle, m_maxLength, cache);
+        m_tmpBuf = nullptr;
+        m_chunk = nullptr;
+        m_cache = nullptr;
+    }
+
+    bool PooledByteBuf::release(){
+        // 只有一个引用时不会有别的线程同时改它，省掉一次原子的读改写
+        if (m_refCnt.load(std::memory_order_acquire) == 1 ||
+            m_refCnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            deallocate();
+            return true;
+        }
+        return false;
+    }
+
+    PooledSlicedByteBuf PooledByteBuf::retainedSlice(int index, int length){
+        assert(index >= 0 && length >= 0 && index + length <= m_length);
+        retain();
+        return PooledSlicedByteBuf(this, m_memory + idx(index), length, 0, length);
+    }
+
+    PooledSlicedByteBuf PooledByteBuf::retainedDuplicate(){
+        retain();
+        return PooledSlicedByteBuf(this, m_memory + m_offset, m_length, m_readerIndex, m_writerIndex);
+    }
+
     void PooledByteBuf::recycle(){
         m_recycler->recycle(this);
     }
@@ -84,6 +118,7 @@ namespace buffer{
 
     void PooledByteBuf::reuse(int maxCapacity){
         setMaxCapacity(maxCapacity);
+        m_refCnt.store(1, std::memory_order_relaxed);
         setIndex0(0, 0);
     }
 
@@ -148,6 +183,11 @@ namespace buffer{
     }
 
     void PooledByteBuf::retrieveAll(){
+        // 有视图时不回到开头，否则之后的写入会覆盖视图里的数据
+        if (shared()) {
+            m_readerIndex = m_writerIndex;
+            return;
+        }
         m_readerIndex = 0;
         m_writerIndex = 0;
     }
@@ -282,6 +322,8 @@ namespace buffer{
         //}
 
         // Reallocation required.
+        // 旧内存会被释放，有视图时不能重新分配(Buffer在写之前会先换一块新的)
+        assert(!shared());
         m_chunk->m_arena->reallocate(this, newCapacity, true);
         return this;
     }
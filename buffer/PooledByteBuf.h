@@ -3,8 +3,10 @@
 
 #include "math.h"
 #include <algorithm>
+#include <atomic>
 #include "PoolChunk.h"
 #include "Recycler.h"
+#include "PooledSlicedByteBuf.h"
 // https://zhuanlan.zhihu.com/p/269847729 read and write
 namespace buffer{
     class PoolArena;
@@ -14,14 +16,26 @@ namespace buffer{
     // 池化缓存区
     // PooledByteBuf:AbstrateReferenceCountedByteBuf:AbstrateByteBuf:ByteBuf:ReferenceCounted
     class PooledByteBuf{
+        friend class PoolThreadCache;
+        friend class Recycler<PooledByteBuf>;
+
         void init0(PoolChunk* chunk, const char* buffer, long handle, int offset, int length, int maxLength, PoolThreadCache* cache);
         void setIndex0(int readerIndex, int writerIndex);
 
         PooledByteBufAllocator* m_allocator;
         int m_maxCapacity;
+        // 引用计数，AbstractReferenceCountedByteBuf.refCnt：
+        // 分配时为1，每个retainedSlice()/retainedDuplicate()视图各持有一个
+        std::atomic<int> m_refCnt;
         // m_recycler是PoolByteBuf的回收站，第一次创建PoolByteBuf时需要New一片区域，后面释放该PoolByteBuf后会进入回收站，
         // 当再次申请PoolByteBuf时会从该回收站直接返回，避免再次new一片新区域，减少new系统调用次数
         static Recycler<PooledByteBuf> * m_recycler;
+        Recycler<PooledByteBuf>::Handle m_recyclerHandle;
+        // 在别的线程释放时，挂在分配线程的PoolThreadCache的归还队列上
+        PooledByteBuf* m_nextRemoteFree;
+
+        // 把内存还给arena，cache不为nullptr时先尝试放进线程缓存
+        void freeMemory(PoolThreadCache* cache);
 
     protected:
         //m_chunk指向申请该PoolByteBuf的chunk，用于该PoolByteBuf的内存分配
@@ -59,7 +73,7 @@ namespace buffer{
         int m_writerIndex;
 
         explicit PooledByteBuf(int maxCapacity);
-        // 析构为AbstractReferenceCountedByteBuf.release()，调用PoolThreadCache.deallocate()
+        // 析构时直接释放，不看引用计数；正常应当通过release()释放
         ~PooledByteBuf(){
             deallocate();
         }
@@ -81,6 +95,28 @@ namespace buffer{
 
         void recycle();
 
+        inline int refCnt() const {
+            return m_refCnt.load(std::memory_order_acquire);
+        }
+
+        // 有派生视图时为true，这时内存不能被覆盖或重新分配
+        inline bool shared() const {
+            return refCnt() > 1;
+        }
+
+        inline PooledByteBuf* retain() {
+            m_refCnt.fetch_add(1, std::memory_order_relaxed);
+            return this;
+        }
+
+        // 引用计数减一，减到0时deallocate()，返回是否释放了。可以在任意线程调用
+        bool release();
+
+        // 共享[index, index + length)这段内存的视图，下标从capacity开始算，不是从readerIndex
+        PooledSlicedByteBuf retainedSlice(int index, int length);
+        // 共享整个缓冲区、读写下标和当前相同的视图
+        PooledSlicedByteBuf retainedDuplicate();
+
         char* duplicateInternalBuffer(int index, int length);
 
         char* internalBuffer(int index, int length);
@@ -1,52 +1,191 @@
 #include "PooledByteBufAllocator.h"
 
+#include <algorithm>
+
 namespace buffer{
-    PooledByteBufAllocator::PooledByteBufAllocator(){
-        assert(DEFAULT_NUM_ARENA > 0);
-        PooledByteBufAllocatorInit(DEFAULT_NUM_ARENA, DEFAULT_PAGE_SIZE, DEFAULT_MAX_ORDER,
-                                  DEFAULT_SMALL_CACHE_SIZE, DEFAULT_NORMAL_CACHE_SIZE);
+    namespace {
+        typedef std::vector<std::pair<PooledByteBufAllocator*, PoolThreadCache*>> ThreadCacheList;
+
+        // 本线程在各个allocator上的缓存，通常只有一两个；
+        // 用平凡的thread_local保存，别的thread_local析构时释放buf仍然可以安全地查找
+        thread_local ThreadCacheList* t_threadCaches = nullptr;
+        // 上一次用到的，大多数线程只用一个allocator
+        thread_local PooledByteBufAllocator* t_lastAllocator = nullptr;
+        thread_local PoolThreadCache* t_lastCache = nullptr;
+
+        // 线程退出时关闭这个线程的PoolThreadCache，
+        // 之后别的线程释放这个线程分配的buf时直接还给arena
+        struct ThreadCacheCloser{
+            bool active = false;
+            ~ThreadCacheCloser(){
+                if (active) {
+                    PooledByteBufAllocator::releaseThreadCache();
+                }
+            }
+        };
+        thread_local ThreadCacheCloser t_cacheCloser;
     }
-    PooledByteBufAllocator* PooledByteBufAllocator::DEFAULT_ALLOC = nullptr;
 
-    int PooledByteBufAllocator::m_smallCacheSize = 0;
-    int PooledByteBufAllocator::m_normalCacheSize = 0;
-    int PooledByteBufAllocator::m_chunkSize = 0;
-    std::vector<PoolArena *> PooledByteBufAllocator::m_arenas;
-    std::mutex PooledByteBufAllocator::m_lockSingleton;
-    std::mutex PooledByteBufAllocator::m_lockThreadcache;
+    PooledByteBufAllocator::PooledByteBufAllocator(const Builder& builder)
+    : m_smallCacheSize(builder.m_smallCacheSize),
+      m_normalCacheSize(builder.m_normalCacheSize),
+      m_maxCachedBufferCapacity(builder.m_maxCachedBufferCapacity),
+      m_cacheTrimInterval(builder.m_cacheTrimInterval),
+      m_cacheTrimIntervalMillis(builder.m_cacheTrimIntervalMillis),
+      m_pageSize(builder.m_pageSize){
+        int pageShifts = validateAndCalculatePageShifts(m_pageSize);
+        int maxOrder = builder.m_maxOrder;
+        if (builder.m_chunkSize > 0) {
+            // chunkSize必须是pageSize乘以2的幂
+            if (builder.m_chunkSize % m_pageSize != 0) throw std::exception();
+            int pages = builder.m_chunkSize / m_pageSize;
+            if ((pages & (pages - 1)) != 0) throw std::exception();
+            maxOrder = MathUtil::log2(pages);
+        }
+        if (maxOrder < 0 || maxOrder >= 14) throw std::exception();
+        m_chunkSize = validateAndCalculateChunkSize(m_pageSize, maxOrder);
+
+        m_arenas = newArenaArray(builder.m_numArenas);
+        int releaseMinPages = builder.m_releaseFreePagesMinBytes <= 0 ? 0 :
+            std::max(1, builder.m_releaseFreePagesMinBytes / m_pageSize);
+        for (size_t i = 0; i < m_arenas.size(); i ++) {
+            PoolArena* arena;
+            if (builder.m_mmapChunks) {
+                arena = new MmapArena(this, m_pageSize, pageShifts, m_chunkSize, builder.m_hugePages,
+                                      builder.m_prefault, releaseMinPages, builder.m_lazyFree);
+            } else {
+                arena = new DefaultArena(this, m_pageSize, pageShifts, m_chunkSize);
+            }
+            arena->m_index = static_cast<int>(i);
+            m_arenas[i] = arena;
+        }
+    }
+
+    PooledByteBufAllocator* PooledByteBufAllocator::Builder::build() const {
+        if (m_numArenas <= 0 || m_smallCacheSize < 0 || m_normalCacheSize < 0 ||
+            m_maxCachedBufferCapacity < 0 || m_cacheTrimInterval < 1) {
+            throw std::exception();
+        }
+        return new PooledByteBufAllocator(*this);
+    }
 
-    thread_local PoolThreadCache* PooledByteBufAllocator::m_pooledTheadCache(nullptr);
     int  PooledByteBufAllocator::DEFAULT_NUM_ARENA = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
 
     PooledByteBufAllocator* PooledByteBufAllocator::ALLOCATOR(){
-        // LazySingleton
-        if(DEFAULT_ALLOC == nullptr){
-            std::lock_guard<std::mutex> lock(m_lockSingleton);
-            if(DEFAULT_ALLOC == nullptr){
-                // 双重加锁检查
-                DEFAULT_ALLOC = new PooledByteBufAllocator();
+        // 局部静态变量的初始化是线程安全的
+        static PooledByteBufAllocator* alloc = Builder().build();
+        return alloc;
+    }
+
+    PoolThreadCache* PooledByteBufAllocator::initialValue(){
+        PoolThreadCache* cache;
+        {
+            std::lock_guard<std::mutex> lock(m_lockThreadcache);
+            if (!m_closedThreadCaches.empty()) {
+                // 先用退出的线程留下的缓存，缓存对象不会比同时存在的线程多；挑所在arena线程最少的
+                auto it = std::min_element(m_closedThreadCaches.begin(), m_closedThreadCaches.end(),
+                    [](PoolThreadCache* a, PoolThreadCache* b) {
+                        return a->m_arena->m_numThreadCaches.load() < b->m_arena->m_numThreadCaches.load();
+                    });
+                cache = *it;
+                m_closedThreadCaches.erase(it);
+                cache->reopen(m_smallCacheSize, m_normalCacheSize, m_maxCachedBufferCapacity);
+            } else {
+                PoolArena* leastArena = leastUsedArena(m_arenas);
+                cache = new PoolThreadCache(leastArena, m_smallCacheSize, m_normalCacheSize,
+                                m_maxCachedBufferCapacity, m_cacheTrimInterval, m_cacheTrimIntervalMillis);
             }
+            m_threadCaches.push_back(cache);
         }
-        if(m_pooledTheadCache == nullptr){
-            m_pooledTheadCache = initialValue();
+        if (t_threadCaches == nullptr) {
+            t_threadCaches = new ThreadCacheList();
         }
-        return DEFAULT_ALLOC;
+        t_threadCaches->emplace_back(this, cache);
+        t_cacheCloser.active = true;
+        return cache;
     }
 
-    PoolThreadCache* PooledByteBufAllocator::initialValue(){
-        PoolArena* leastArena;
+    PoolThreadCache* PooledByteBufAllocator::threadCache(){
+        // Buffer可能在别的线程创建、在本线程扩容，此时本线程还没有用过这个allocator
+        PoolThreadCache* cache = currentThreadCache();
+        if (cache == nullptr) {
+            cache = initialValue();
+        }
+        t_lastAllocator = this;
+        t_lastCache = cache;
+        return cache;
+    }
+
+    PoolThreadCache* PooledByteBufAllocator::currentThreadCache() const {
+        if (t_lastAllocator == this) {
+            return t_lastCache;
+        }
+        if (t_threadCaches != nullptr) {
+            for (const auto& entry : *t_threadCaches) {
+                if (entry.first == this) return entry.second;
+            }
+        }
+        return nullptr;
+    }
+
+    void PooledByteBufAllocator::removeThreadCache(PoolThreadCache* cache){
         {
             std::lock_guard<std::mutex> lock(m_lockThreadcache);
-            leastArena = leastUsedArena(m_arenas);
+            m_threadCaches.erase(std::find(m_threadCaches.begin(), m_threadCaches.end(), cache));
+        }
+        cache->close();
+        // 别的线程手里的buf还指着它，不能delete，留给以后新建的线程
+        std::lock_guard<std::mutex> lock(m_lockThreadcache);
+        m_closedThreadCaches.push_back(cache);
+    }
+
+    void PooledByteBufAllocator::releaseThreadCache(){
+        ThreadCacheList* caches = t_threadCaches;
+        if (caches == nullptr) return;
+        t_threadCaches = nullptr;
+        t_lastAllocator = nullptr;
+        t_lastCache = nullptr;
+        for (const auto& entry : *caches) {
+            entry.first->removeThreadCache(entry.second);
+        }
+        delete caches;
+    }
+
+    bool PooledByteBufAllocator::trimCurrentThreadCache(){
+        if (t_threadCaches == nullptr || t_threadCaches->empty()) return false;
+        for (const auto& entry : *t_threadCaches) {
+            entry.second->trim();
+        }
+        // trim还回arena的run合并之后再还给系统
+        for (const auto& entry : *t_threadCaches) {
+            entry.first->releaseFreePages();
+        }
+        return true;
+    }
+
+    void PooledByteBufAllocator::releaseCachedMemory(){
+        PoolThreadCache::releaseAll();
+        if (t_threadCaches == nullptr) return;
+        for (const auto& entry : *t_threadCaches) {
+            entry.second->releaseCached();
+        }
+        for (const auto& entry : *t_threadCaches) {
+            entry.first->releaseFreePages();
         }
-        return new PoolThreadCache(leastArena, m_smallCacheSize, m_normalCacheSize,
-                        DEFAULT_MAX_CACHED_BUFFER_CAPACITY, DEFAULT_CACHE_TRIM_INTERVAL);
+    }
+
+    long PooledByteBufAllocator::releaseFreePages(){
+        long released = 0;
+        for (PoolArena* arena : m_arenas) {
+            released += arena->releaseFreePages();
+        }
+        return released;
     }
 
     PoolArena* PooledByteBufAllocator::leastUsedArena(std::vector<PoolArena *>& arenas){
         if (arenas.empty()) return nullptr;
         PoolArena* minArena = arenas[0];
-        for (int i = 1; i < arenas.size(); i++) {
+        for (size_t i = 1; i < arenas.size(); i++) {
             PoolArena* arena = arenas[i];
             if (arena->m_numThreadCaches.load() < minArena->m_numThreadCaches.load()) {
                 minArena = arena;
@@ -56,27 +195,6 @@ namespace buffer{
         return minArena;
     }
 
-    void PooledByteBufAllocator::PooledByteBufAllocatorInit(int nArena, int pageSize, int maxOrder,
-                                int smallCacheSize, int normalCacheSize){
-        // threadCache = new PoolThreadLocalCache(false);
-        // directMemoryCacheAlignment = 0;
-        m_smallCacheSize = smallCacheSize;
-        m_normalCacheSize = normalCacheSize;
-        m_chunkSize = validateAndCalculateChunkSize(pageSize, maxOrder);
-        int pageShifts = validateAndCalculatePageShifts(pageSize);
-
-        if (nArena > 0) {
-            m_arenas = newArenaArray(nArena);
-            // List<PoolArenaMetric> metrics = new ArrayList<PoolArenaMetric>(directArenas.length);
-            for (int i = 0; i < m_arenas.size(); i ++) {
-                PoolArena* arena = new DefaultArena(this, pageSize, pageShifts, m_chunkSize);
-                m_arenas[i] = arena;
-                // metrics.add(arena);
-            }
-            // directArenaMetrics = Collections.unmodifiableList(metrics);
-        }
-    }
-
     std::vector<PoolArena*> PooledByteBufAllocator::newArenaArray(int size){
         std::vector<PoolArena*> pooledArenaArray(size, nullptr);
         return pooledArenaArray;
@@ -84,7 +202,7 @@ namespace buffer{
 
     int PooledByteBufAllocator::validateAndCalculatePageShifts(int pageSize){
         if (pageSize < MIN_PAGE_SIZE) throw std::exception();
-        if ((pageSize & pageSize - 1) != 0) throw std::exception();
+        if ((pageSize & (pageSize - 1)) != 0) throw std::exception();
         return MathUtil::log2(pageSize);
     }
     
@@ -127,17 +245,28 @@ namespace buffer{
 
     PooledByteBuf* PooledByteBufAllocator::newPoolBuffer(int initialCapacity, int maxCapacity){
         // 从当前线程缓存中获取对应内存池PoolArena
-        PoolArena* defaultArena = m_pooledTheadCache->m_arena;
+        PoolThreadCache* cache = threadCache();
+        PoolArena* defaultArena = cache->m_arena;
         PooledByteBuf* buf = nullptr;
         if (defaultArena != nullptr) {
             // 在当前线程内存池上分配内存
-            buf = defaultArena->allocate(m_pooledTheadCache, initialCapacity, maxCapacity);
+            buf = defaultArena->allocate(cache, initialCapacity, maxCapacity);
         } else throw std::exception();
         return buf;  
     }
-    PoolThreadCache* PooledByteBufAllocator::threadCache(){
-        assert(m_pooledTheadCache != nullptr);
-        return m_pooledTheadCache;
+
+    PooledByteBufAllocatorMetric PooledByteBufAllocator::metric(){
+        PooledByteBufAllocatorMetric m;
+        m.pageSize = m_pageSize;
+        m.chunkSize = m_chunkSize;
+        for (PoolArena* arena : m_arenas) {
+            m.arenas.push_back(arena->metric());
+        }
+        std::lock_guard<std::mutex> lock(m_lockThreadcache);
+        for (PoolThreadCache* cache : m_threadCaches) {
+            m.threadCaches.push_back(cache->metric());
+        }
+        return m;
     }
 
     int PooledByteBufAllocator::calculateNewCapacity(int minNewCapacity, int maxCapacity){
@@ -8,6 +8,7 @@
 #include "MathUtil.h"
 #include "PoolThreadCache.h"
 #include "PooledByteBuf.h"
+#include "PoolMetric.h"
 /*
 PooledByteBufAllocator中主要维护了三个属性
 
@@ -23,24 +24,36 @@ namespace buffer{
     class PooledByteBuf;
     class PooledByteBufAllocator
     {
-        void PooledByteBufAllocatorInit(int nArena, int pageSize, int maxOrder, int smallCacheSize, int normalCacheSize);
+    public:
+        class Builder;
+
+    private:
+        explicit PooledByteBufAllocator(const Builder& builder);
+        // 不能销毁：arena里的内存和各线程的缓存都可能还在用，实例和进程同寿命
+        ~PooledByteBufAllocator() = delete;
         static std::vector<PoolArena*> newArenaArray(int size);
         static int validateAndCalculatePageShifts(int pageSize);
         static int validateAndCalculateChunkSize(int pageSize, int maxOrder);
         static void validate(int initialCapacity, int maxCapacity);
         PooledByteBuf* newPoolBuffer(int initialCapacity, int maxCapacity);        
         static PoolArena* leastUsedArena(std::vector<PoolArena *>& arenas);
-        PooledByteBufAllocator();
+        PoolThreadCache* initialValue();
+        // 关闭退出线程的缓存，放进m_closedThreadCaches
+        void removeThreadCache(PoolThreadCache* cache);
 
-        static thread_local PoolThreadCache * m_pooledTheadCache;
-        static std::vector<PoolArena *> m_arenas;
-        static int m_smallCacheSize;
-        static int m_normalCacheSize;
-        static int m_chunkSize;
-
-        static PooledByteBufAllocator* DEFAULT_ALLOC;
-        static std::mutex m_lockSingleton;
-        static std::mutex m_lockThreadcache;
+        std::vector<PoolArena *> m_arenas;
+        int m_smallCacheSize;
+        int m_normalCacheSize;
+        int m_maxCachedBufferCapacity;
+        int m_cacheTrimInterval;
+        long m_cacheTrimIntervalMillis;
+        int m_chunkSize;
+        int m_pageSize;
+        // 还在使用的线程缓存，metric()用
+        std::vector<PoolThreadCache *> m_threadCaches;
+        // 线程退出时关闭的缓存，新线程的缓存优先从这里取
+        std::vector<PoolThreadCache *> m_closedThreadCaches;
+        std::mutex m_lockThreadcache;
     public:
         static int DEFAULT_NUM_ARENA;
         // 必须>4KB chunksize=pagesize*(2^max_order)
@@ -51,7 +64,8 @@ namespace buffer{
         static const int DEFAULT_NORMAL_CACHE_SIZE = 64;
         static const int DEFAULT_MAX_CACHED_BUFFER_CAPACITY = 32 * 1024;
         static const int DEFAULT_CACHE_TRIM_INTERVAL = 8192;
-        // static const long DEFAULT_CACHE_TRIM_INTERVAL_MILLIS = 0L;
+        // 0表示不按时间trim，只按分配次数和EventLoop空闲时trim
+        static const long DEFAULT_CACHE_TRIM_INTERVAL_MILLIS = 0L;
         static const int DEFAULT_MAX_CACHED_BYTEBUFFERS_PER_CHUNK = 1023;
         static const int MIN_PAGE_SIZE = 4096;
         static const int MAX_CHUNK_SIZE = (int) (((long) INT_MAX + 1) / 2);
@@ -59,18 +73,93 @@ namespace buffer{
         static const int DEFAULT_MAX_CAPACITY = INT_MAX;
         static const int DEFAULT_MAX_COMPONENTS = 16;
         static const int CALCULATE_THRESHOLD = 1048576 * 4; // 4 MiB page
+        // mmapChunks时，至少这么大的空闲run才还给系统
+        static const int DEFAULT_RELEASE_FREE_PAGES_MIN_BYTES = 1024 * 1024;
+
+        // 独立的allocator实例，有自己的arena、线程缓存和统计，和别的实例互不影响：
+        //   PooledByteBufAllocator* bulk = PooledByteBufAllocator::Builder()
+        //       .numArenas(2).chunkSize(64 << 20).normalCacheSize(0).build();
+        // 没有设置的参数取DEFAULT_*，参数不合法时build()抛std::exception。
+        // 实例只能活到进程结束，没有销毁的办法：启动时每种配置建一个，
+        // 在各个server之间共用，不要在每次新建TcpServer时build()
+        class Builder{
+        public:
+            Builder& numArenas(int n) { m_numArenas = n; return *this; }
+            Builder& pageSize(int size) { m_pageSize = size; return *this; }
+            // chunkSize = pageSize << maxOrder
+            Builder& maxOrder(int order) { m_maxOrder = order; m_chunkSize = 0; return *this; }
+            // 必须是pageSize乘以2的幂，设置后覆盖maxOrder
+            Builder& chunkSize(int size) { m_chunkSize = size; return *this; }
+            Builder& smallCacheSize(int n) { m_smallCacheSize = n; return *this; }
+            Builder& normalCacheSize(int n) { m_normalCacheSize = n; return *this; }
+            Builder& maxCachedBufferCapacity(int size) { m_maxCachedBufferCapacity = size; return *this; }
+            // 线程缓存每分配多少次trim一次
+            Builder& cacheTrimInterval(int allocations) { m_cacheTrimInterval = allocations; return *this; }
+            // 线程缓存至少每隔多少毫秒trim一次，<=0只按分配次数
+            Builder& cacheTrimIntervalMillis(long millis) { m_cacheTrimIntervalMillis = millis; return *this; }
+            // chunk的内存直接mmap，默认是new char[]
+            Builder& mmapChunks(bool on) { m_mmapChunks = on; return *this; }
+            // mmapChunks时chunk按2MiB对齐并MADV_HUGEPAGE，默认开
+            Builder& hugePages(bool on) { m_hugePages = on; return *this; }
+            // mmapChunks时新chunk预先缺页(MAP_POPULATE)，默认关
+            Builder& prefault(bool on) { m_prefault = on; return *this; }
+            // mmapChunks时，EventLoop空闲和releaseCachedMemory()把chunk里至少minBytes的空闲run还给系统，
+            // <=0不还；lazy用MADV_FREE，否则MADV_DONTNEED
+            Builder& releaseFreePages(int minBytes, bool lazy = false)
+            { m_releaseFreePagesMinBytes = minBytes; m_lazyFree = lazy; return *this; }
+            PooledByteBufAllocator* build() const;
+
+        private:
+            friend class PooledByteBufAllocator;
+            int m_numArenas = DEFAULT_NUM_ARENA;
+            int m_pageSize = DEFAULT_PAGE_SIZE;
+            int m_maxOrder = DEFAULT_MAX_ORDER;
+            int m_chunkSize = 0;
+            int m_smallCacheSize = DEFAULT_SMALL_CACHE_SIZE;
+            int m_normalCacheSize = DEFAULT_NORMAL_CACHE_SIZE;
+            int m_maxCachedBufferCapacity = DEFAULT_MAX_CACHED_BUFFER_CAPACITY;
+            int m_cacheTrimInterval = DEFAULT_CACHE_TRIM_INTERVAL;
+            long m_cacheTrimIntervalMillis = DEFAULT_CACHE_TRIM_INTERVAL_MILLIS;
+            bool m_mmapChunks = false;
+            bool m_hugePages = true;
+            bool m_prefault = false;
+            int m_releaseFreePagesMinBytes = DEFAULT_RELEASE_FREE_PAGES_MIN_BYTES;
+            bool m_lazyFree = false;
+        };
 
         PooledByteBufAllocator(const PooledByteBufAllocator&) = delete;
 
         PooledByteBuf* buffer();
         PooledByteBuf* buffer(int initialCapacity);
         PooledByteBuf* buffer(int initialCapacity, int maxCapacity);
+        // 默认参数的全局实例，Buffer没有指定allocator时用它
         static PooledByteBufAllocator* ALLOCATOR();
 
-        static PoolThreadCache* initialValue();
+        // 关闭本线程在各个allocator上的缓存，把缓存的内存还给arena。线程退出时自动调用
+        static void releaseThreadCache();
+        // 本线程在这个allocator上的缓存，没有就创建
         PoolThreadCache* threadCache();
+        // 本线程在这个allocator上的缓存，还没有创建时为nullptr
+        PoolThreadCache* currentThreadCache() const;
+        // trim当前线程在各个allocator上的缓存，EventLoop空闲时调用；当前线程没有缓存时返回false。
+        // 之后对这些allocator调用releaseFreePages()
+        static bool trimCurrentThreadCache();
+        // 内存紧张时调用：当前线程的缓存马上全部归还，别的线程在下次分配或trim时归还。
+        // EventLoop::releaseCachedMemory()还会唤醒空闲的loop线程去归还
+        static void releaseCachedMemory();
+        // 把mmap的chunk里的空闲run还给系统，返回字节数；不是mmapChunks时返回0
+        long releaseFreePages();
         int calculateNewCapacity(int minNewCapacity, int maxCapacity);
 
+        int pageSize() const { return m_pageSize; }
+        int chunkSize() const { return m_chunkSize; }
+        int numArenas() const { return static_cast<int>(m_arenas.size()); }
+
+        // 各arena的chunk占用、subpage、分配释放次数，以及各线程缓存的命中率
+        PooledByteBufAllocatorMetric metric();
+        // metric()的文本形式
+        std::string dumpStats() { return metric().toString(); }
+
     };
 }
 
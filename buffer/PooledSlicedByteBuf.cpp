@@ -0,0 +1,46 @@
+#include "PooledSlicedByteBuf.h"
+
+#include <algorithm>
+
+#include "PooledByteBuf.h"
+
+namespace buffer{
+    PooledSlicedByteBuf::PooledSlicedByteBuf(const PooledSlicedByteBuf& rhs)
+    : m_parent(rhs.m_parent), m_memory(rhs.m_memory), m_length(rhs.m_length),
+      m_readerIndex(rhs.m_readerIndex), m_writerIndex(rhs.m_writerIndex)
+    {
+        if (m_parent != nullptr)
+            m_parent->retain();
+    }
+
+    void PooledSlicedByteBuf::swap(PooledSlicedByteBuf& rhs) noexcept {
+        std::swap(m_parent, rhs.m_parent);
+        std::swap(m_memory, rhs.m_memory);
+        std::swap(m_length, rhs.m_length);
+        std::swap(m_readerIndex, rhs.m_readerIndex);
+        std::swap(m_writerIndex, rhs.m_writerIndex);
+    }
+
+    void PooledSlicedByteBuf::release(){
+        if (m_parent != nullptr) {
+            PooledByteBuf* parent = m_parent;
+            m_parent = nullptr;
+            m_memory = nullptr;
+            m_length = m_readerIndex = m_writerIndex = 0;
+            parent->release();
+        }
+    }
+
+    PooledSlicedByteBuf PooledSlicedByteBuf::retainedSlice(int index, int length) const {
+        assert(valid());
+        assert(index >= 0 && length >= 0 && index + length <= m_length);
+        m_parent->retain();
+        return PooledSlicedByteBuf(m_parent, m_memory + index, length, 0, length);
+    }
+
+    PooledSlicedByteBuf PooledSlicedByteBuf::retainedDuplicate() const {
+        assert(valid());
+        m_parent->retain();
+        return PooledSlicedByteBuf(m_parent, m_memory, m_length, m_readerIndex, m_writerIndex);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef BUFFER_POOLEDSLICEDBYTEBUF_H
+#define BUFFER_POOLEDSLICEDBYTEBUF_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <string>
+
+namespace buffer{
+    class PooledByteBuf;
+    // PooledByteBuf::retainedSlice()/retainedDuplicate()返回的派生视图，对应Netty的
+    // PooledSlicedByteBuf/PooledDuplicatedByteBuf。
+    // 和parent共享同一块内存，有自己的读写下标，不拷贝数据；持有parent的一个引用，
+    // 析构或release()时归还，最后一个引用释放时内存才回到PoolArena。
+    // 视图是只读的。可以拷贝(再retain一次)、移动，也可以交给别的线程析构。
+    class PooledSlicedByteBuf{
+        friend class PooledByteBuf;
+
+        // 接管调用方已经retain过的那个引用
+        PooledSlicedByteBuf(PooledByteBuf* parent, const char* memory, int length,
+                            int readerIndex, int writerIndex)
+        : m_parent(parent), m_memory(memory), m_length(length),
+          m_readerIndex(readerIndex), m_writerIndex(writerIndex)
+        {
+            assert(0 <= readerIndex && readerIndex <= writerIndex && writerIndex <= length);
+        }
+
+        PooledByteBuf* m_parent;
+        // 视图下标0的位置
+        const char* m_memory;
+        int m_length;
+        int m_readerIndex;
+        int m_writerIndex;
+
+    public:
+        PooledSlicedByteBuf()
+        : m_parent(nullptr), m_memory(nullptr), m_length(0), m_readerIndex(0), m_writerIndex(0)
+        {}
+
+        PooledSlicedByteBuf(const PooledSlicedByteBuf& rhs);
+        PooledSlicedByteBuf(PooledSlicedByteBuf&& rhs) noexcept
+        : m_parent(rhs.m_parent), m_memory(rhs.m_memory), m_length(rhs.m_length),
+          m_readerIndex(rhs.m_readerIndex), m_writerIndex(rhs.m_writerIndex)
+        {
+            rhs.m_parent = nullptr;
+            rhs.m_memory = nullptr;
+            rhs.m_length = rhs.m_readerIndex = rhs.m_writerIndex = 0;
+        }
+
+        PooledSlicedByteBuf& operator=(PooledSlicedByteBuf rhs) noexcept {
+            swap(rhs);
+            return *this;
+        }
+
+        ~PooledSlicedByteBuf() {
+            release();
+        }
+
+        void swap(PooledSlicedByteBuf& rhs) noexcept;
+
+        // 提前归还引用，之后视图为空
+        void release();
+
+        inline bool valid() const { return m_parent != nullptr; }
+        inline PooledByteBuf* unwrap() const { return m_parent; }
+
+        inline int capacity() const { return m_length; }
+        inline int readableBytes() const { return m_writerIndex - m_readerIndex; }
+        inline const char* data() const { return m_memory; }
+        inline const char* peek() const { return m_memory + m_readerIndex; }
+
+        void retrieve(size_t len) {
+            assert(len <= static_cast<size_t>(readableBytes()));
+            m_readerIndex += static_cast<int>(len);
+        }
+        void retrieveAll() { m_readerIndex = m_writerIndex; }
+        std::string retrieveAsString(size_t len) {
+            std::string result(peek(), len);
+            retrieve(len);
+            return result;
+        }
+        std::string retrieveAllAsString() { return retrieveAsString(readableBytes()); }
+        std::string toString() const { return std::string(peek(), readableBytes()); }
+
+        // 在这个视图上再切，下标相对于视图
+        PooledSlicedByteBuf retainedSlice(int index, int length) const;
+        PooledSlicedByteBuf retainedDuplicate() const;
+    };
+}
+
+#endif // BUFFER_POOLEDSLICEDBYTEBUF_H
@@ -2,227 +2,504 @@
 #define BUFFER_RECYCLER_H
 
 #include <assert.h>
-#include <stack>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace buffer{
-    // 对象池的实现难点在于线程安全。
-    // Recycler中将主线程和非主线程回收对象划分到不同的存储空间中（stack#elements和WeakOrderQueue.Link#elements）
-    // 并且对于WeakOrderQueue.Link#elements，存取操作划分到两端进行（非主线程从尾端存入，主线程从首部开始读取），
-    // 从而减少同步操作，并保证线程安全。
-
+    // 对象池，对应Netty的Recycler。
+    // 每个线程有自己的Stack，get()只从本线程的Stack取对象。对象记住创建它的线程的Stack(Handle)，
+    // 在创建线程recycle()直接放回Stack；在别的线程recycle()时放进这个线程专属于该Stack的WeakOrderQueue，
+    // WeakOrderQueue由若干Link(每个LINK_CAPACITY个元素)串成，别的线程从尾部写，创建线程Stack空了时从头部取回。
+    //
+    // 和Netty不同，没有GC：丢弃的对象直接delete。
+    //   - 每个线程的Stack最多maxCapacityPerThread个对象，满了就丢弃；
+    //   - 所有别的线程为一个Stack暂存的对象最多maxCapacityPerThread / maxSharedCapacityFactor个；
+    //   - 从没回收过的对象每ratio个只留一个，其中在别的线程回收的还要先按delayedQueueRatio每几个留一个，
+    //     避免池无限制地增长；回收过的对象说明池里确实需要它，不再按比例丢弃；
+    //   - 一个线程最多为maxDelayedQueuesPerThread个别的线程的Stack暂存对象。
+    // 线程退出时删除Stack里和各WeakOrderQueue里的对象；之后才回收的对象直接delete。
+    //
+    // T需要有一个可以被Recycler访问的成员 Recycler<T>::Handle m_recyclerHandle。
+    // 每种T只应有一个Recycler实例：线程局部的Stack按T区分，用第一次调用get()的那个Recycler的参数创建。
     template<typename T>
     class Recycler{
         typedef T value_type;
+        class Stack;
+        class WeakOrderQueue;
+
+    public:
+        static const int DEFAULT_MAX_CAPACITY_PER_THREAD = 4096;
+        static const int DEFAULT_MAX_SHARED_CAPACITY_FACTOR = 2;
+        static const int DEFAULT_RATIO = 8;
+        static const int DEFAULT_DELAYED_QUEUE_RATIO = 8;
+        static const int LINK_CAPACITY = 16;
+
+        // 嵌在对象里，记录对象属于哪个线程的Stack；对象析构时释放对Stack的引用
+        class Handle{
+            friend class Recycler;
+            Stack* m_stack;
+            bool m_hasBeenRecycled; // 回收过一次之后不再按ratio丢弃
+        public:
+            Handle() : m_stack(nullptr), m_hasBeenRecycled(false) {}
+            Handle(const Handle&) = delete;
+            Handle& operator=(const Handle&) = delete;
+            ~Handle() {
+                if (m_stack != nullptr) m_stack->release();
+            }
+        };
+
+        // maxDelayedQueuesPerThread <= 0 时取CPU核数的两倍
+        explicit Recycler(int maxCapacityPerThread = DEFAULT_MAX_CAPACITY_PER_THREAD,
+                          int maxSharedCapacityFactor = DEFAULT_MAX_SHARED_CAPACITY_FACTOR,
+                          int ratio = DEFAULT_RATIO,
+                          int maxDelayedQueuesPerThread = 0,
+                          int delayedQueueRatio = DEFAULT_DELAYED_QUEUE_RATIO)
+        : m_maxCapacityPerThread(std::max(0, maxCapacityPerThread)),
+          m_maxSharedCapacityFactor(std::max(1, maxSharedCapacityFactor)),
+          m_interval(std::max(0, ratio - 1)),
+          m_maxDelayedQueuesPerThread(maxDelayedQueuesPerThread > 0 ? maxDelayedQueuesPerThread
+                                      : 2 * static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN))),
+          m_delayedQueueInterval(std::max(0, delayedQueueRatio - 1))
+        {}
+        Recycler(const Recycler & ) = delete;
+        virtual ~Recycler() {};
+        virtual value_type * newObject() = 0;
 
-        // static const int INITIAL_CAPACITY = 256;
+        // 从本线程的Stack取一个对象，Stack空了先从别的线程回收的对象里取，都没有才newObject()
+        value_type * get(){
+            Stack* stack = localStack();
+            if (stack == nullptr) {
+                return newObject();
+            }
+            value_type* object = stack->pop();
+            if (object == nullptr) {
+                object = newObject();
+                object->m_recyclerHandle.m_stack = stack;
+                stack->retain();
+            }
+            return object;
+        }
+
+        // 可以在任意线程调用；对象被丢弃时直接delete，返回false
+        bool recycle(value_type* object) {
+            assert(object != nullptr);
+            Stack* stack = object->m_recyclerHandle.m_stack;
+            if (stack == nullptr || t_exited) {
+                delete object;
+                return false;
+            }
+            if (stack == t_stack) {
+                return stack->pushNow(object);
+            }
+            return pushLater(stack, object);
+        }
+
+        // 本线程Stack里的对象数，测试用
+        int threadLocalSize() const {
+            return t_stack != nullptr ? t_stack->size() : 0;
+        }
 
-        static thread_local std::stack<void *> tStack; 
+    private:
+        struct Link{
+            value_type* elements[LINK_CAPACITY];
+            int readIndex;
+            std::atomic<int> writeIndex;
+            std::atomic<Link*> next;
+            Link() : readIndex(0), writeIndex(0), next(nullptr) {}
+        };
 
+        // 一个别的线程为某个Stack暂存的对象：那个线程写尾部，Stack所属线程读头部，各自只有一个线程
+        class WeakOrderQueue{
+            Link* m_head;   // 读端
+            Link* m_tail;   // 写端
+            Stack* m_stack;
+            int m_handleRecycleCount;
+            int m_interval;
         public:
-            Recycler(){}
-            Recycler(const Recycler & ) = delete;
-            virtual ~Recycler() {};
-            virtual value_type * newObject() = 0;
-            // Recycler#threadLocal中存放了每个线程对应的Stack。
-            // Recycler#get中首先获取属于当前线程的Stack，再从该Stack中获取对象，也就是，每个线程只能从自己的Stack中获取对象。
-            inline value_type * get(){
-                if(tStack.empty()){
-                    return newObject();
-                }
-                value_type* objectItem = static_cast<value_type *> (tStack.top());
-                tStack.pop();
-                return objectItem;
-            }
-            inline bool recycle(value_type* object) {
-                assert(object != nullptr);
-                // assert(tStack.size() <= INITIAL_CAPACITY);
-                tStack.push(object);
+            WeakOrderQueue* m_next;              // Stack的队列链表，新队列插在头部
+            std::atomic<bool> m_writerAlive;     // 写的线程退出后，读完就可以从链表里删掉
+
+            WeakOrderQueue(Stack* stack, Link* link, int interval)
+            : m_head(link), m_tail(link), m_stack(stack),
+              m_handleRecycleCount(interval), m_interval(interval), // 第一个回收的对象总是留下
+              m_next(nullptr), m_writerAlive(true)
+            {}
+
+            ~WeakOrderQueue() {
+                // 剩下的对象和所有Link，读完的Link在transfer()里已经还了
+                deleteAll();
+                Link* link = m_head;
+                while (link != nullptr) {
+                    Link* next = link->next.load(std::memory_order_acquire);
+                    m_stack->freeLink(link);
+                    link = next;
+                }
+            }
+
+            // 写端调用，被丢弃时返回false，由调用方delete
+            bool add(value_type* object) {
+                // 和Netty一样只丢从没回收过的对象，回收过的一直在池里周转
+                if (!object->m_recyclerHandle.m_hasBeenRecycled) {
+                    if (m_handleRecycleCount < m_interval) {
+                        ++m_handleRecycleCount;
+                        return false;
+                    }
+                    m_handleRecycleCount = 0;
+                }
+                Link* tail = m_tail;
+                int writeIndex = tail->writeIndex.load(std::memory_order_relaxed);
+                if (writeIndex == LINK_CAPACITY) {
+                    Link* link = m_stack->newLink();
+                    if (link == nullptr) {
+                        return false;
+                    }
+                    tail->next.store(link, std::memory_order_release);
+                    m_tail = tail = link;
+                    writeIndex = 0;
+                }
+                tail->elements[writeIndex] = object;
+                // 先写元素再发布下标，读端按下标读到的元素一定已经可见
+                tail->writeIndex.store(writeIndex + 1, std::memory_order_release);
                 return true;
             }
-    };
-    template<typename T>
-    thread_local std::stack<void *> Recycler<T>::tStack = std::stack<void *>();
-
-    /*
-    class WeakOrderQueue{
-        // Head#link指向Link链表首对象
-        Head head;  
-        // 指向Link链表尾对象
-        Link tail;
-        // 指向WeakOrderQueue链表下一对象
-        WeakOrderQueue next;
-        // 所属线程
-        WeakReference<Thread> owner;
-      public:
-        void add(DefaultHandle<?> handle) {
-            handle.lastRecycledId = id;
-
-            // 控制回收频率，避免WeakOrderQueue增长过快。
-            // 每8个对象都会抛弃7个，回收一个
-            if (handleRecycleCount < interval) {
-                handleRecycleCount++;
-                return;
-            }
-            handleRecycleCount = 0;
-
-
-            Link tail = this.tail;
-            int writeIndex;
-            // 当前Link#elements已全部使用，创建一个新的Link
-            if ((writeIndex = tail.get()) == LINK_CAPACITY) {
-                Link link = head.newLink();
-                if (link == null) {
-                    return;
+
+            // 读端调用：把头部Link里已写好的对象移到dst，返回是否移动了对象
+            bool transfer(Stack* dst) {
+                Link* head = m_head;
+                if (head->readIndex == LINK_CAPACITY) {
+                    Link* next = head->next.load(std::memory_order_acquire);
+                    if (next == nullptr) {
+                        return false;
+                    }
+                    // 读完的Link还给共享容量
+                    m_stack->freeLink(head);
+                    m_head = head = next;
                 }
-                this.tail = tail = tail.next = link;
-                writeIndex = tail.get();
-            }
-            // 存入缓存对象
-            tail.elements[writeIndex] = handle;
-            handle.stack = null;
-            // 延迟设置Link#elements的最新索引（Link继承了AtomicInteger）
-            // 这样在该stack主线程通过该索引获取elements缓存对象时，保证elements中元素已经可见。
-            tail.lazySet(writeIndex + 1);
-            // 把WeakOrderQueue中的对象迁移到Stack中。
-            // stack.pop()调用
-            bool transfer(Stack<?> dst) {
-                Link head = this.head.link;
-                if (head == null) {
+                int srcStart = head->readIndex;
+                int srcEnd = head->writeIndex.load(std::memory_order_acquire);
+                if (srcStart == srcEnd) {
                     return false;
                 }
-                // head.readIndex 标志现在已迁移对象下标
-                // head.readIndex == LINK_CAPACITY，表示当前Link已全部移动，查找下一个Link
-                if (head.readIndex == LINK_CAPACITY) {
-                    if (head.next == null) {
-                        return false;
+                int before = dst->size();
+                for (int i = srcStart; i < srcEnd; i++) {
+                    dst->pushTransferred(head->elements[i]);
+                    head->elements[i] = nullptr;
+                }
+                head->readIndex = srcEnd;
+                return dst->size() != before;
+            }
+
+            // 读端调用：删除所有已写好的对象，Stack所属线程退出后用
+            void deleteAll() {
+                for (Link* link = m_head; link != nullptr; link = link->next.load(std::memory_order_acquire)) {
+                    int end = link->writeIndex.load(std::memory_order_acquire);
+                    for (int i = link->readIndex; i < end; i++) {
+                        delete link->elements[i];
+                        link->elements[i] = nullptr;
                     }
-                    head = head.next;
-                    this.head.relink(head);
-                }
-                // 计算待迁移对象数量
-                // !Link继承了AtomicInteger
-                final int srcStart = head.readIndex;
-                int srcEnd = head.get();
-                final int srcSize = srcEnd - srcStart;
-                if (srcSize == 0) {
+                    link->readIndex = end;
+                }
+            }
+        };
+
+        class Stack{
+            Recycler* m_parent;
+            std::vector<value_type*> m_elements;
+            int m_maxCapacity;
+            int m_interval;
+            int m_handleRecycleCount;
+            std::atomic<int> m_availableSharedCapacity;
+            std::atomic<int> m_refs;       // 所属线程 + 它创建的还活着的对象 + 为它暂存对象的别的线程
+            std::atomic<bool> m_ownerAlive;
+            std::mutex m_queueMtx;         // 插入新队列、所属线程退出后清理队列
+            std::atomic<WeakOrderQueue*> m_queueHead;
+            WeakOrderQueue* m_cursor;      // 以下两个只有所属线程用
+            WeakOrderQueue* m_prev;
+
+        public:
+            explicit Stack(Recycler* parent)
+            : m_parent(parent),
+              m_maxCapacity(parent->m_maxCapacityPerThread),
+              m_interval(parent->m_interval),
+              m_handleRecycleCount(parent->m_interval), // 第一个回收的对象总是留下
+              m_availableSharedCapacity(std::max(parent->m_maxCapacityPerThread / parent->m_maxSharedCapacityFactor,
+                                                 static_cast<int>(LINK_CAPACITY))),
+              m_refs(1),
+              m_ownerAlive(true),
+              m_queueHead(nullptr),
+              m_cursor(nullptr),
+              m_prev(nullptr)
+            {
+                m_elements.reserve(std::min(256, m_maxCapacity));
+            }
+
+            ~Stack() {
+                WeakOrderQueue* q = m_queueHead.load(std::memory_order_acquire);
+                while (q != nullptr) {
+                    WeakOrderQueue* next = q->m_next;
+                    delete q;
+                    q = next;
+                }
+            }
+
+            Recycler* parent() const { return m_parent; }
+            int size() const { return static_cast<int>(m_elements.size()); }
+            bool ownerAlive() const { return m_ownerAlive.load(std::memory_order_relaxed); }
+
+            void retain() { m_refs.fetch_add(1, std::memory_order_relaxed); }
+            void release() {
+                if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    delete this;
+                }
+            }
+
+            value_type* pop() {
+                if (m_elements.empty() && !scavenge()) {
+                    return nullptr;
+                }
+                value_type* object = m_elements.back();
+                m_elements.pop_back();
+                return object;
+            }
+
+            // 所属线程回收
+            bool pushNow(value_type* object) {
+                if (static_cast<int>(m_elements.size()) >= m_maxCapacity || dropHandle(object)) {
+                    delete object;
                     return false;
                 }
-                //  计算Stack#elements数组长度，不够则扩容
-                final int dstSize = dst.size;
-                final int expectedCapacity = dstSize + srcSize;
-
-                if (expectedCapacity > dst.elements.length) {
-                    final int actualCapacity = dst.increaseCapacity(expectedCapacity);
-                    srcEnd = min(srcStart + actualCapacity - dstSize, srcEnd);
-                }
-
-                if (srcStart != srcEnd) {
-                    final DefaultHandle[] srcElems = head.elements;
-                    final DefaultHandle[] dstElems = dst.elements;
-                    int newDstSize = dstSize;
-                    //  计算Stack#elements数组长度，不够则扩容
-                    for (int i = srcStart; i < srcEnd; i++) {
-                        DefaultHandle<?> element = srcElems[i];
-                        ...
-                        srcElems[i] = null;
-                        // 控制回收频率
-                        if (dst.dropHandle(element)) {
-                            continue;
-                        }
-                        element.stack = dst;
-                        dstElems[newDstSize ++] = element;
+                m_elements.push_back(object);
+                return true;
+            }
+
+            // 从WeakOrderQueue取回的对象
+            void pushTransferred(value_type* object) {
+                if (static_cast<int>(m_elements.size()) >= m_maxCapacity || dropHandle(object)) {
+                    delete object;
+                    return;
+                }
+                m_elements.push_back(object);
+            }
+
+            Link* newLink() {
+                int available = m_availableSharedCapacity.load(std::memory_order_relaxed);
+                do {
+                    if (available < LINK_CAPACITY) {
+                        return nullptr;
                     }
-                    // 当前Link对象已全部移动，修改WeakOrderQueue#head的link属性，指向下一Link，这样前面的Link就可以被垃圾回收了。
-                    if (srcEnd == LINK_CAPACITY && head.next != null) {
-                        this.head.relink(head.next);
+                } while (!m_availableSharedCapacity.compare_exchange_weak(available, available - LINK_CAPACITY,
+                                                                          std::memory_order_relaxed));
+                return new Link();
+            }
+
+            void freeLink(Link* link) {
+                if (link == nullptr) return;
+                delete link;
+                m_availableSharedCapacity.fetch_add(LINK_CAPACITY, std::memory_order_relaxed);
+            }
+
+            // 别的线程第一次为这个Stack回收对象时调用
+            WeakOrderQueue* newQueue() {
+                Link* link = newLink();
+                if (link == nullptr) {
+                    return nullptr;
+                }
+                WeakOrderQueue* queue = new WeakOrderQueue(this, link, m_parent->m_delayedQueueInterval);
+                std::lock_guard<std::mutex> lock(m_queueMtx);
+                queue->m_next = m_queueHead.load(std::memory_order_relaxed);
+                m_queueHead.store(queue, std::memory_order_release);
+                return queue;
+            }
+
+            // 所属线程退出：删掉自己的对象和所有队列里的对象，之后的回收直接delete
+            void close() {
+                m_ownerAlive.store(false, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                // 对象析构会释放引用，先留一个引用到清理完
+                retain();
+                for (value_type* object : m_elements) {
+                    delete object;
+                }
+                m_elements.clear();
+                m_elements.shrink_to_fit();
+                drainOrphans();
+                release();  // 上面临时加的
+                release();  // 所属线程的
+            }
+
+            // 所属线程退出后，别的线程可能刚好又往队列里放了对象，由放的线程调用这里删除
+            void drainOrphans() {
+                retain();
+                {
+                    std::lock_guard<std::mutex> lock(m_queueMtx);
+                    for (WeakOrderQueue* q = m_queueHead.load(std::memory_order_acquire); q != nullptr; q = q->m_next) {
+                        q->deleteAll();
                     }
+                }
+                release();
+            }
 
-                    head.readIndex = srcEnd;
-                    // dst.size == newDstSize 表示并没有对象移动，返回false
-                    // 否则更新dst.size
-                    if (dst.size == newDstSize) {
-                        return false;
+        private:
+            bool dropHandle(value_type* object) {
+                Handle& handle = object->m_recyclerHandle;
+                if (!handle.m_hasBeenRecycled) {
+                    if (m_handleRecycleCount < m_interval) {
+                        ++m_handleRecycleCount;
+                        return true;
                     }
-                    dst.size = newDstSize;
+                    m_handleRecycleCount = 0;
+                    handle.m_hasBeenRecycled = true;
+                }
+                return false;
+            }
+
+            // 从各WeakOrderQueue取回对象，取到一批就返回
+            bool scavenge() {
+                if (scavengeSome()) {
                     return true;
-                } else {
-                    // The destination stack is full already.
-                    return false;
                 }
+                m_prev = nullptr;
+                m_cursor = m_queueHead.load(std::memory_order_acquire);
+                return false;
             }
-    };
 
+            bool scavengeSome() {
+                WeakOrderQueue* prev;
+                WeakOrderQueue* cursor = m_cursor;
+                if (cursor == nullptr) {
+                    prev = nullptr;
+                    cursor = m_queueHead.load(std::memory_order_acquire);
+                    if (cursor == nullptr) {
+                        return false;
+                    }
+                } else {
+                    prev = m_prev;
+                }
 
-    template<typename T>
-    class Stack{
-        typedef T value_type;
-        Recycler<T>* m_recycler;
-        shared_ptr<Thread> threadRef;
-        // 主线程回收的对象
-        vector<value_type> elements;
-        // elements最大长度
-        int maxCapacity;
-        // elements索引
-        int size;
-        // 非主线程回收的对象
-        volatile WeakOrderQueue head;   
-        void push(value_type* object) {
-            Thread currentThread = Thread.currentThread();
-            if (threadRef.get() == currentThread) {
-                pushNow(object); // 当前线程是主线程，直接将对象加入到Stack#elements中
+                bool success = false;
+                do {
+                    if (cursor->transfer(this)) {
+                        success = true;
+                        break;
+                    }
+                    WeakOrderQueue* next = cursor->m_next;
+                    if (!cursor->m_writerAlive.load(std::memory_order_acquire)) {
+                        // 写的线程已经退出，把剩下的都取回来再从链表里删掉；头节点可能正在被插入，留着
+                        while (cursor->transfer(this)) {
+                            success = true;
+                        }
+                        if (prev != nullptr) {
+                            prev->m_next = next;
+                            delete cursor;
+                        } else {
+                            prev = cursor;
+                        }
+                    } else {
+                        prev = cursor;
+                    }
+                    cursor = next;
+                } while (cursor != nullptr && !success);
+
+                m_prev = prev;
+                m_cursor = cursor;
+                return success;
+            }
+        };
+
+        // 本线程回收别的线程的对象：放进为那个Stack准备的WeakOrderQueue
+        bool pushLater(Stack* stack, value_type* object) {
+            if (!stack->ownerAlive()) {
+                delete object;
+                return false;
+            }
+            std::unordered_map<Stack*, WeakOrderQueue*>& delayed = delayedQueues();
+            typename std::unordered_map<Stack*, WeakOrderQueue*>::iterator it = delayed.find(stack);
+            WeakOrderQueue* queue;
+            if (it == delayed.end()) {
+                // nullptr表示不为这个Stack暂存(队列数超过上限或共享容量用完)
+                queue = static_cast<int>(delayed.size()) < m_maxDelayedQueuesPerThread ? stack->newQueue() : nullptr;
+                stack->retain();
+                delayed.emplace(stack, queue);
             } else {
-                pushLater(object, currentThread); // 当前线程非主线程，需要将对象放到对应的WeakOrderQueue中
+                queue = it->second;
             }
+            if (queue == nullptr || !queue->add(object)) {
+                delete object;
+                return false;
+            }
+            // 和Stack::close()配对：要么所属线程清理时看得到这个对象，要么这里看得到它已经退出
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!stack->ownerAlive()) {
+                stack->drainOrphans();
+            }
+            return true;
         }
-        void pushLater(value_type* item, Thread thread) {
-            ...
-            // DELAYED_RECYCLED是一个FastThreadLocal，可以理解为Netty中的ThreadLocal优化类。
-            // 它为每个线程维护了一个Map，存储每个Stack和对应WeakOrderQueue。
-            // 这里获取的delayedRecycled变量是仅用于当前线程的。
-            // delayedRecycled.get获取的WeakOrderQueue，是以Thread + Stack作为维度区分的，只能是一个线程操作。
-            Map<Stack<?>, WeakOrderQueue> delayedRecycled = DELAYED_RECYCLED.get();
-            WeakOrderQueue queue = delayedRecycled.get(this);
-            if (queue == null) {
-                // 当前WeakOrderQueue数量超出限制，添加WeakOrderQueue.DUMMY作为标记
-                if (delayedRecycled.size() >= maxDelayedQueues) {
-                    delayedRecycled.put(this, WeakOrderQueue.DUMMY);
-                    return;
-                }
-                // 构造一个WeakOrderQueue，加入到Stack#head指向的WeakOrderQueue链表中，并放入DELAYED_RECYCLED。这时是需要一下同步操作的。
-                if ((queue = newWeakOrderQueue(thread)) == null) {
-                    return;
-                }
-                delayedRecycled.put(this, queue);
-            } else if (queue == WeakOrderQueue.DUMMY) {
-                // 遇到WeakOrderQueue.DUMMY标记对象，直接抛弃对象
-                return;
+
+        Stack* localStack() {
+            if (t_stack == nullptr && !t_exited && m_maxCapacityPerThread > 0) {
+                t_stack = new Stack(this);
+                t_cleaner.active = true;
             }
-            // 将缓存对象添加到WeakOrderQueue中。
-            queue.add(item);
+            return t_stack;
         }
-        value_type* pop() {
-            int size = this.size;
-            if (size == 0) {
-                // elements没有可用对象时，将WeakOrderQueue中的对象迁移到elements
-                if (!scavenge()) {
-                    return null;
-                }
-                size = this.size;
-                if (size <= 0) {
-                    return null;
-                }
-            }
-            // 从elements中取出一个缓存对象
-            size --;
-            value_type* ret = elements[size];
-            elements[size] = null;
-            this.size = size;
-
-            ...
-            return ret;
+
+        std::unordered_map<Stack*, WeakOrderQueue*>& delayedQueues() {
+            if (t_delayed == nullptr) {
+                t_delayed = new std::unordered_map<Stack*, WeakOrderQueue*>();
+                t_cleaner.active = true;
+            }
+            return *t_delayed;
         }
+
+        // 线程退出时关闭本线程的Stack，并告诉各WeakOrderQueue不会再有写入
+        struct ThreadCleaner{
+            bool active = false;
+            ~ThreadCleaner() {
+                if (!active) return;
+                t_exited = true;
+                if (t_delayed != nullptr) {
+                    for (auto& entry : *t_delayed) {
+                        if (entry.second != nullptr) {
+                            entry.second->m_writerAlive.store(false, std::memory_order_release);
+                        }
+                        entry.first->release();
+                    }
+                    delete t_delayed;
+                    t_delayed = nullptr;
+                }
+                if (t_stack != nullptr) {
+                    Stack* stack = t_stack;
+                    t_stack = nullptr;
+                    stack->close();
+                }
+            }
+        };
+
+        // 用平凡的thread_local保存状态，别的thread_local析构时仍然可以安全地访问
+        static thread_local Stack* t_stack;
+        static thread_local std::unordered_map<Stack*, WeakOrderQueue*>* t_delayed;
+        static thread_local bool t_exited;
+        static thread_local ThreadCleaner t_cleaner;
+
+        const int m_maxCapacityPerThread;
+        const int m_maxSharedCapacityFactor;
+        const int m_interval;
+        const int m_maxDelayedQueuesPerThread;
+        const int m_delayedQueueInterval;
     };
-    */
 
+    template<typename T>
+    thread_local typename Recycler<T>::Stack* Recycler<T>::t_stack = nullptr;
+    template<typename T>
+    thread_local std::unordered_map<typename Recycler<T>::Stack*, typename Recycler<T>::WeakOrderQueue*>*
+        Recycler<T>::t_delayed = nullptr;
+    template<typename T>
+    thread_local bool Recycler<T>::t_exited = false;
+    template<typename T>
+    thread_local typename Recycler<T>::ThreadCleaner Recycler<T>::t_cleaner;
 }
-#endif // BUFFER_RECYCLER_H
\ No newline at end of file
+#endif // BUFFER_RECYCLER_H
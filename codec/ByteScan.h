@@ -0,0 +1,41 @@
+#ifndef MUTTY_CODEC_BYTESCAN_H
+#define MUTTY_CODEC_BYTESCAN_H
+
+#include <string.h>
+
+#include "../buffer/ByteSearch.h"
+
+namespace mutty {
+  namespace codec {
+
+    /// 在[begin, end)里找第一个c，找不到返回NULL。
+    /// 用buffer/ByteSearch.h里按CPU选出的SSE2/AVX2实现。
+    inline const char* findByte(const char* begin, const char* end, char c)
+    {
+      return buffer::findByte(begin, end, c);
+    }
+
+    /// 在[begin, end)里找第一个delim，用findByte找首字节再比较剩下的
+    inline const char* findDelimiter(const char* begin, const char* end,
+                                     const char* delim, size_t delimLen)
+    {
+      if (delimLen == 1)
+        return findByte(begin, end, delim[0]);
+      const char* last = end - delimLen + 1;
+      const char* p = begin;
+      while (p < last)
+      {
+        p = findByte(p, last, delim[0]);
+        if (p == NULL)
+          return NULL;
+        if (::memcmp(p + 1, delim + 1, delimLen - 1) == 0)
+          return p;
+        ++p;
+      }
+      return NULL;
+    }
+
+  } // namespace codec
+} // namespace mutty
+
+#endif  // MUTTY_CODEC_BYTESCAN_H
@@ -0,0 +1,73 @@
+#include "DelimiterFrameDecoder.h"
+
+#include <assert.h>
+
+#include "ByteScan.h"
+
+namespace mutty {
+  namespace codec {
+
+    DelimiterFrameDecoder::DelimiterFrameDecoder(const std::string& delimiter,
+                                                 size_t maxFrameLength,
+                                                 bool stripDelimiter)
+      : delimiter_(delimiter),
+        maxFrameLength_(maxFrameLength),
+        stripDelimiter_(stripDelimiter)
+    {
+      assert(!delimiter.empty());
+    }
+
+    ssize_t DelimiterFrameDecoder::decodeFrame(const char* data, size_t len,
+                                               FrameView* frame, const char** error) const
+    {
+      // 超过maxFrameLength + 分隔符长度的部分不用找
+      size_t limit = maxFrameLength_ + delimiter_.size();
+      size_t scan = len < limit ? len : limit;
+      const char* delim = findDelimiter(data, data + scan, delimiter_.data(), delimiter_.size());
+      if (delim == NULL)
+      {
+        if (len >= limit)
+        {
+          *error = "frame length exceeds maxFrameLength";
+          return -1;
+        }
+        return 0;
+      }
+
+      size_t frameLength = delim - data;
+      frame->data = data;
+      frame->size = stripDelimiter_ ? frameLength : frameLength + delimiter_.size();
+      return frameLength + delimiter_.size();
+    }
+
+    ssize_t LineFrameDecoder::decodeFrame(const char* data, size_t len,
+                                          FrameView* frame, const char** error) const
+    {
+      // 行尾最长是"\r\n"
+      size_t limit = maxLength_ + 2;
+      size_t scan = len < limit ? len : limit;
+      const char* eol = findByte(data, data + scan, '\n');
+      if (eol == NULL)
+      {
+        if (len >= limit)
+        {
+          *error = "line length exceeds maxLength";
+          return -1;
+        }
+        return 0;
+      }
+
+      size_t delimLength = eol > data && eol[-1] == '\r' ? 2 : 1;
+      size_t lineLength = eol + 1 - data - delimLength;
+      if (lineLength > maxLength_)
+      {
+        *error = "line length exceeds maxLength";
+        return -1;
+      }
+      frame->data = data;
+      frame->size = stripDelimiter_ ? lineLength : lineLength + delimLength;
+      return eol + 1 - data;
+    }
+
+  } // namespace codec
+} // namespace mutty
@@ -0,0 +1,49 @@
+#ifndef MUTTY_CODEC_DELIMITERFRAMEDECODER_H
+#define MUTTY_CODEC_DELIMITERFRAMEDECODER_H
+
+#include <string>
+
+#include "FrameDecoder.h"
+
+namespace mutty {
+  namespace codec {
+
+    /// 按分隔符分帧。帧内容(不含分隔符)超过maxFrameLength算出错，
+    /// 还没收到分隔符但已经不可能不超长时也立即出错，不用等到分隔符。
+    class DelimiterFrameDecoder final : public FrameDecoder
+    {
+    public:
+      DelimiterFrameDecoder(const std::string& delimiter, size_t maxFrameLength,
+                            bool stripDelimiter = true);
+
+      ssize_t decodeFrame(const char* data, size_t len,
+                          FrameView* frame, const char** error) const override;
+
+    private:
+      const std::string delimiter_;
+      const size_t maxFrameLength_;
+      const bool stripDelimiter_;
+    };
+
+    /// 按行分帧，"\n"和"\r\n"都算行尾。stripDelimiter时交出的行不带行尾。
+    class LineFrameDecoder final : public FrameDecoder
+    {
+    public:
+      explicit LineFrameDecoder(size_t maxLength, bool stripDelimiter = true)
+        : maxLength_(maxLength),
+          stripDelimiter_(stripDelimiter)
+      {
+      }
+
+      ssize_t decodeFrame(const char* data, size_t len,
+                          FrameView* frame, const char** error) const override;
+
+    private:
+      const size_t maxLength_;
+      const bool stripDelimiter_;
+    };
+
+  } // namespace codec
+} // namespace mutty
+
+#endif  // MUTTY_CODEC_DELIMITERFRAMEDECODER_H
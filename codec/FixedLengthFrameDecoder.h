@@ -0,0 +1,38 @@
+#ifndef MUTTY_CODEC_FIXEDLENGTHFRAMEDECODER_H
+#define MUTTY_CODEC_FIXEDLENGTHFRAMEDECODER_H
+
+#include <assert.h>
+
+#include "FrameDecoder.h"
+
+namespace mutty {
+  namespace codec {
+
+    /// 每frameLength字节一帧
+    class FixedLengthFrameDecoder final : public FrameDecoder
+    {
+    public:
+      explicit FixedLengthFrameDecoder(size_t frameLength)
+        : frameLength_(frameLength)
+      {
+        assert(frameLength > 0);
+      }
+
+      ssize_t decodeFrame(const char* data, size_t len,
+                          FrameView* frame, const char** error) const override
+      {
+        if (len < frameLength_)
+          return 0;
+        frame->data = data;
+        frame->size = frameLength_;
+        return frameLength_;
+      }
+
+    private:
+      const size_t frameLength_;
+    };
+
+  } // namespace codec
+} // namespace mutty
+
+#endif  // MUTTY_CODEC_FIXEDLENGTHFRAMEDECODER_H
@@ -0,0 +1,62 @@
+#include "FrameDecoder.h"
+
+#include "../TcpConnection.h"
+#include "../base/Logging.h"
+
+namespace mutty {
+  namespace codec {
+
+    void FrameDecoder::onMessage(const TcpConnectionRef& conn, buffer::Buffer* buf)
+    {
+      FrameView frames[kMaxBatch];
+      const char* data = buf->peek();
+      size_t len = buf->readableBytes();
+      size_t consumed = 0;
+      size_t n = 0;
+
+      while (conn->connected())
+      {
+        const char* error = NULL;
+        ssize_t used = decodeFrame(data + consumed, len - consumed, &frames[n], &error);
+        if (used == 0)
+        {
+          break;
+        }
+        if (used < 0)
+        {
+          // 出错之前解出来的帧照常交出去
+          if (n > 0 && frameCallback_)
+            frameCallback_(conn, frames, n);
+          buf->retrieve(consumed);
+          handleError(conn, error);
+          return;
+        }
+        consumed += used;
+        if (++n == kMaxBatch)
+        {
+          if (frameCallback_)
+            frameCallback_(conn, frames, n);
+          n = 0;
+        }
+      }
+
+      if (n > 0 && frameCallback_)
+        frameCallback_(conn, frames, n);
+      buf->retrieve(consumed);
+    }
+
+    void FrameDecoder::handleError(const TcpConnectionRef& conn, const char* reason)
+    {
+      if (errorCallback_)
+      {
+        errorCallback_(conn, reason);
+      }
+      else
+      {
+        LOG_ERROR << "FrameDecoder [" << conn->name() << "] " << reason << ", force close";
+        conn->forceClose();
+      }
+    }
+
+  } // namespace codec
+} // namespace mutty
@@ -0,0 +1,72 @@
+#ifndef MUTTY_CODEC_FRAMEDECODER_H
+#define MUTTY_CODEC_FRAMEDECODER_H
+
+#include <functional>
+#include <string>
+#include <sys/types.h>
+
+#include "../Callbacks.h"
+#include "../base/noncopyable.h"
+
+namespace mutty {
+  namespace codec {
+
+    /// 指向inputBuffer内一帧的视图，不拷贝数据。
+    /// 只在FrameCallback返回前有效，要留下来自己拷贝(toString())。
+    struct FrameView
+    {
+      const char* data;
+      size_t size;
+
+      std::string toString() const { return std::string(data, size); }
+    };
+
+    ///
+    /// 分帧解码器的公共部分：把一次读到的数据切成完整的帧，成批交给FrameCallback，
+    /// 然后一次retrieve掉。不完整的帧留在inputBuffer里等下次。
+    ///
+    /// 解码器本身无状态，一个实例可以给所有连接共用：
+    ///
+    ///   LengthFieldFrameDecoder decoder(65536, 0, 4);
+    ///   decoder.setFrameCallback(onFrames);
+    ///   server.setMessageCallback(std::bind(&FrameDecoder::onMessage, &decoder, _1, _2));
+    class FrameDecoder : noncopyable
+    {
+    public:
+      typedef std::function<void (const TcpConnectionRef&, const FrameView* frames, size_t n)> FrameCallback;
+      typedef std::function<void (const TcpConnectionRef&, const char* reason)> ErrorCallback;
+
+      /// 一次FrameCallback最多带这么多帧，超过的分几批回调
+      static const size_t kMaxBatch = 64;
+
+      virtual ~FrameDecoder() {}
+
+      void setFrameCallback(const FrameCallback& cb)
+      { frameCallback_ = cb; }
+
+      /// 默认记日志并forceClose()
+      void setErrorCallback(const ErrorCallback& cb)
+      { errorCallback_ = cb; }
+
+      /// 可以直接作为MessageCallback
+      void onMessage(const TcpConnectionRef& conn, buffer::Buffer* buf);
+
+      /// 从data开始解一帧。返回这一帧在输入里占的字节数(>0)，数据不够返回0，
+      /// 出错返回-1并在*error里给出原因。
+      virtual ssize_t decodeFrame(const char* data, size_t len,
+                                  FrameView* frame, const char** error) const = 0;
+
+    protected:
+      FrameDecoder() {}
+
+    private:
+      void handleError(const TcpConnectionRef& conn, const char* reason);
+
+      FrameCallback frameCallback_;
+      ErrorCallback errorCallback_;
+    };
+
+  } // namespace codec
+} // namespace mutty
+
+#endif  // MUTTY_CODEC_FRAMEDECODER_H
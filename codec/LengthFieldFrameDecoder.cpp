@@ -0,0 +1,97 @@
+#include "LengthFieldFrameDecoder.h"
+
+#include <assert.h>
+#include <endian.h>
+#include <string.h>
+
+namespace mutty {
+  namespace codec {
+
+    LengthFieldFrameDecoder::LengthFieldFrameDecoder(size_t maxFrameLength,
+                                                     int lengthFieldOffset,
+                                                     int lengthFieldLength,
+                                                     int lengthAdjustment,
+                                                     int initialBytesToStrip,
+                                                     ByteOrder byteOrder)
+      : maxFrameLength_(maxFrameLength),
+        lengthFieldOffset_(lengthFieldOffset),
+        lengthFieldLength_(lengthFieldLength),
+        lengthFieldEnd_(lengthFieldOffset + lengthFieldLength),
+        lengthAdjustment_(lengthAdjustment),
+        initialBytesToStrip_(initialBytesToStrip),
+        byteOrder_(byteOrder)
+    {
+      assert(lengthFieldLength == 1 || lengthFieldLength == 2 ||
+             lengthFieldLength == 4 || lengthFieldLength == 8);
+      assert(lengthFieldOffset >= 0);
+      assert(initialBytesToStrip >= 0);
+      assert(static_cast<size_t>(lengthFieldEnd_) <= maxFrameLength);
+    }
+
+    uint64_t LengthFieldFrameDecoder::readLength(const char* p) const
+    {
+      bool big = byteOrder_ == kBigEndian;
+      switch (lengthFieldLength_)
+      {
+        case 1:
+          return static_cast<uint8_t>(*p);
+        case 2:
+        {
+          uint16_t v;
+          memcpy(&v, p, sizeof v);
+          return big ? be16toh(v) : le16toh(v);
+        }
+        case 4:
+        {
+          uint32_t v;
+          memcpy(&v, p, sizeof v);
+          return big ? be32toh(v) : le32toh(v);
+        }
+        default:
+        {
+          uint64_t v;
+          memcpy(&v, p, sizeof v);
+          return big ? be64toh(v) : le64toh(v);
+        }
+      }
+    }
+
+    ssize_t LengthFieldFrameDecoder::decodeFrame(const char* data, size_t len,
+                                                 FrameView* frame, const char** error) const
+    {
+      if (len < static_cast<size_t>(lengthFieldEnd_))
+        return 0;
+
+      uint64_t length = readLength(data + lengthFieldOffset_);
+      // 先和maxFrameLength比，避免8字节长度加上adjustment溢出
+      if (length > maxFrameLength_)
+      {
+        *error = "frame length exceeds maxFrameLength";
+        return -1;
+      }
+      int64_t frameLength = static_cast<int64_t>(length) + lengthFieldEnd_ + lengthAdjustment_;
+      if (frameLength < lengthFieldEnd_)
+      {
+        *error = "frame length less than lengthFieldEnd";
+        return -1;
+      }
+      if (static_cast<uint64_t>(frameLength) > maxFrameLength_)
+      {
+        *error = "frame length exceeds maxFrameLength";
+        return -1;
+      }
+      if (frameLength < initialBytesToStrip_)
+      {
+        *error = "frame length less than initialBytesToStrip";
+        return -1;
+      }
+      if (len < static_cast<size_t>(frameLength))
+        return 0;
+
+      frame->data = data + initialBytesToStrip_;
+      frame->size = frameLength - initialBytesToStrip_;
+      return frameLength;
+    }
+
+  } // namespace codec
+} // namespace mutty
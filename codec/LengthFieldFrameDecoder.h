@@ -0,0 +1,59 @@
+#ifndef MUTTY_CODEC_LENGTHFIELDFRAMEDECODER_H
+#define MUTTY_CODEC_LENGTHFIELDFRAMEDECODER_H
+
+#include <stdint.h>
+
+#include "FrameDecoder.h"
+
+namespace mutty {
+  namespace codec {
+
+    ///
+    /// 按长度字段分帧，参数含义同Netty的LengthFieldBasedFrameDecoder：
+    ///
+    ///   帧长 = lengthFieldOffset + lengthFieldLength + 长度字段的值 + lengthAdjustment
+    ///
+    /// 交出去的帧去掉开头的initialBytesToStrip字节。常见的几种：
+    ///
+    ///   // | len(4) | body |，len只算body，交出body
+    ///   LengthFieldFrameDecoder(max, 0, 4, 0, 4);
+    ///   // | len(2) | body |，len包括自己，交出整帧
+    ///   LengthFieldFrameDecoder(max, 0, 2, -2, 0);
+    ///   // | magic(2) | len(4) | body |，交出整帧
+    ///   LengthFieldFrameDecoder(max, 2, 4);
+    class LengthFieldFrameDecoder final : public FrameDecoder
+    {
+    public:
+      enum ByteOrder
+      {
+        kBigEndian,
+        kLittleEndian,
+      };
+
+      /// lengthFieldLength只能是1/2/4/8；帧长超过maxFrameLength算出错
+      LengthFieldFrameDecoder(size_t maxFrameLength,
+                              int lengthFieldOffset,
+                              int lengthFieldLength,
+                              int lengthAdjustment = 0,
+                              int initialBytesToStrip = 0,
+                              ByteOrder byteOrder = kBigEndian);
+
+      ssize_t decodeFrame(const char* data, size_t len,
+                          FrameView* frame, const char** error) const override;
+
+    private:
+      uint64_t readLength(const char* p) const;
+
+      const size_t maxFrameLength_;
+      const int lengthFieldOffset_;
+      const int lengthFieldLength_;
+      const int lengthFieldEnd_;
+      const int lengthAdjustment_;
+      const int initialBytesToStrip_;
+      const ByteOrder byteOrder_;
+    };
+
+  } // namespace codec
+} // namespace mutty
+
+#endif  // MUTTY_CODEC_LENGTHFIELDFRAMEDECODER_H
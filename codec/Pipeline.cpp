@@ -0,0 +1,51 @@
+#include "Pipeline.h"
+
+#include <assert.h>
+#include <endian.h>
+
+namespace mutty {
+  namespace codec {
+
+    LengthFieldPrepender::LengthFieldPrepender(int lengthFieldLength)
+      : lengthFieldLength_(lengthFieldLength)
+    {
+      assert(lengthFieldLength == 1 || lengthFieldLength == 2 ||
+             lengthFieldLength == 4 || lengthFieldLength == 8);
+    }
+
+    void LengthFieldPrepender::encode(const char* data, size_t len, buffer::Buffer* buf) const
+    {
+      char header[8];
+      switch (lengthFieldLength_)
+      {
+        case 1:
+          assert(len <= UINT8_MAX);
+          header[0] = static_cast<char>(len);
+          break;
+        case 2:
+        {
+          assert(len <= UINT16_MAX);
+          uint16_t v = htobe16(static_cast<uint16_t>(len));
+          memcpy(header, &v, sizeof v);
+          break;
+        }
+        case 4:
+        {
+          assert(len <= UINT32_MAX);
+          uint32_t v = htobe32(static_cast<uint32_t>(len));
+          memcpy(header, &v, sizeof v);
+          break;
+        }
+        default:
+        {
+          uint64_t v = htobe64(static_cast<uint64_t>(len));
+          memcpy(header, &v, sizeof v);
+          break;
+        }
+      }
+      buf->writeBytes(header, lengthFieldLength_);
+      buf->writeBytes(data, static_cast<int>(len));
+    }
+
+  } // namespace codec
+} // namespace mutty
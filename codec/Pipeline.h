@@ -0,0 +1,271 @@
+#ifndef MUTTY_CODEC_PIPELINE_H
+#define MUTTY_CODEC_PIPELINE_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "FrameDecoder.h"
+#include "../EventLoop.h"
+#include "../TcpConnection.h"
+#include "../base/Logging.h"
+#include "../base/noncopyable.h"
+
+namespace mutty {
+  namespace codec {
+
+    // 编译期组合的处理器链，ChannelPipeline的静态版本：
+    //
+    //   struct Echo
+    //   {
+    //     template <typename Ctx>
+    //     void onRead(Ctx& ctx, const FrameView& frame) { ctx.write(frame); }
+    //   };
+    //
+    //   LengthFieldFrameDecoder g_decoder(65536, 0, 4, 0, 4);
+    //
+    //   void onConnection(const TcpConnectionPtr& conn)
+    //   {
+    //     if (conn->connected())
+    //       installPipeline(conn, decodeWith(g_decoder), LengthFieldPrepender(4), Echo());
+    //   }
+    //
+    // 处理器是普通的类，按需提供两个(可以是模板的)成员函数：
+    //   onRead(ctx, msg)   入站，从前往后，ctx.fireRead(x)交给下一个处理器
+    //   onWrite(ctx, msg)  出站，从后往前，ctx.write(x)交给前一个处理器
+    // 没有对应函数(或不接受这种消息)的处理器直接跳过。每一级的消息类型可以
+    // 不同，调用全部在编译期确定，没有虚函数，也没有any_cast。
+    //
+    // 入站的第一条消息是inputBuffer(buffer::Buffer*)；出站越过第一个处理器
+    // 的消息交给TcpConnection::send，可以是buffer::Buffer*(发送后清空)、
+    // std::string或FrameView。
+    //
+    // 每个连接一个Pipeline，处理器可以有自己的状态；只能在连接的loop线程里用。
+
+    template <typename Pipeline, size_t I>
+    class PipelineContext
+    {
+    public:
+      explicit PipelineContext(Pipeline* pipeline) : pipeline_(pipeline) {}
+
+      /// 交给下一个处理器的onRead，最后一个处理器再往后则丢弃
+      template <typename M>
+      void fireRead(M&& msg)
+      { pipeline_->template readAt<I + 1>(std::forward<M>(msg)); }
+
+      /// 交给前一个处理器的onWrite，第一个处理器再往前则发送出去
+      template <typename M>
+      void write(M&& msg)
+      { pipeline_->template writeBelow<I>(std::forward<M>(msg)); }
+
+      TcpConnection* connection() const { return pipeline_->connection(); }
+      Pipeline* pipeline() const { return pipeline_; }
+
+    private:
+      Pipeline* pipeline_;
+    };
+
+    namespace detail {
+
+      template <typename H, typename C, typename M, typename = void>
+      struct HasOnRead : std::false_type {};
+
+      template <typename H, typename C, typename M>
+      struct HasOnRead<H, C, M,
+          std::void_t<decltype(std::declval<H&>().onRead(std::declval<C&>(), std::declval<M>()))>>
+        : std::true_type {};
+
+      template <typename H, typename C, typename M, typename = void>
+      struct HasOnWrite : std::false_type {};
+
+      template <typename H, typename C, typename M>
+      struct HasOnWrite<H, C, M,
+          std::void_t<decltype(std::declval<H&>().onWrite(std::declval<C&>(), std::declval<M>()))>>
+        : std::true_type {};
+
+    } // namespace detail
+
+    template <typename... Handlers>
+    class Pipeline : noncopyable
+    {
+    public:
+      static const size_t kSize = sizeof...(Handlers);
+
+      template <size_t I>
+      using Context = PipelineContext<Pipeline, I>;
+
+      template <typename... Args>
+      explicit Pipeline(TcpConnection* conn, Args&&... handlers)
+        : conn_(conn),
+          handlers_(std::forward<Args>(handlers)...)
+      {
+      }
+
+      /// 作为连接的MessageCallback
+      void onMessage(const TcpConnectionRef&, buffer::Buffer* buf)
+      { readAt<0>(buf); }
+
+      /// 从最后一个处理器开始出站
+      template <typename M>
+      void write(M&& msg)
+      {
+        conn_->getLoop()->assertInLoopThread();
+        writeBelow<kSize>(std::forward<M>(msg));
+      }
+
+      template <size_t I>
+      typename std::tuple_element<I, std::tuple<Handlers...>>::type& handler()
+      { return std::get<I>(handlers_); }
+
+      TcpConnection* connection() const { return conn_; }
+
+      // 以下由PipelineContext调用
+      template <size_t I, typename M>
+      void readAt(M&& msg)
+      {
+        if constexpr (I < kSize)
+        {
+          typedef typename std::tuple_element<I, std::tuple<Handlers...>>::type Handler;
+          if constexpr (detail::HasOnRead<Handler, Context<I>, M&&>::value)
+          {
+            Context<I> ctx(this);
+            std::get<I>(handlers_).onRead(ctx, std::forward<M>(msg));
+          }
+          else
+          {
+            readAt<I + 1>(std::forward<M>(msg));
+          }
+        }
+      }
+
+      /// 交给第I个处理器之前的那个
+      template <size_t I, typename M>
+      void writeBelow(M&& msg)
+      {
+        if constexpr (I == 0)
+        {
+          send(std::forward<M>(msg));
+        }
+        else
+        {
+          typedef typename std::tuple_element<I - 1, std::tuple<Handlers...>>::type Handler;
+          if constexpr (detail::HasOnWrite<Handler, Context<I - 1>, M&&>::value)
+          {
+            Context<I - 1> ctx(this);
+            std::get<I - 1>(handlers_).onWrite(ctx, std::forward<M>(msg));
+          }
+          else
+          {
+            writeBelow<I - 1>(std::forward<M>(msg));
+          }
+        }
+      }
+
+    private:
+      void send(buffer::Buffer* buf) { conn_->send(buf); }
+      void send(const std::string& message) { conn_->send(message); }
+      void send(const FrameView& frame) { conn_->send(frame.data, static_cast<int>(frame.size)); }
+
+      TcpConnection* conn_;  // Pipeline由连接的MessageCallback持有，不会比连接活得久
+      std::tuple<Handlers...> handlers_;
+    };
+
+    /// 给连接装上Pipeline，替换它的MessageCallback。在ConnectionCallback里调用。
+    /// 返回的指针在连接销毁前有效。
+    template <typename... Handlers>
+    Pipeline<typename std::decay<Handlers>::type...>*
+    installPipeline(const TcpConnectionPtr& conn, Handlers&&... handlers)
+    {
+      typedef Pipeline<typename std::decay<Handlers>::type...> PipelineType;
+      std::shared_ptr<PipelineType> pipeline =
+        std::make_shared<PipelineType>(conn.get(), std::forward<Handlers>(handlers)...);
+      conn->setMessageCallback(
+          std::bind(&PipelineType::onMessage, pipeline, std::placeholders::_1, std::placeholders::_2));
+      return pipeline.get();
+    }
+
+    ///
+    /// 把FrameDecoder放进Pipeline：每个完整的帧作为FrameView往后传，
+    /// 直接调用具体解码器的decodeFrame(都是final类)，不经过虚函数。
+    /// 解码器无状态，所有连接共用一个，须比连接活得久。出错时关闭连接。
+    template <typename Decoder>
+    class DecoderHandler
+    {
+    public:
+      explicit DecoderHandler(const Decoder* decoder)
+        : decoder_(decoder)
+      {
+      }
+
+      template <typename Ctx>
+      void onRead(Ctx& ctx, buffer::Buffer* buf)
+      {
+        TcpConnection* conn = ctx.connection();
+        const char* data = buf->peek();
+        size_t len = buf->readableBytes();
+        size_t consumed = 0;
+        while (conn->connected())
+        {
+          FrameView frame;
+          const char* error = NULL;
+          ssize_t used = decoder_->decodeFrame(data + consumed, len - consumed, &frame, &error);
+          if (used <= 0)
+          {
+            if (used < 0)
+            {
+              LOG_ERROR << "DecoderHandler [" << conn->name() << "] " << error << ", force close";
+              conn->forceClose();
+            }
+            break;
+          }
+          consumed += used;
+          ctx.fireRead(frame);
+        }
+        buf->retrieve(consumed);
+      }
+
+    private:
+      const Decoder* decoder_;
+    };
+
+    template <typename Decoder>
+    DecoderHandler<Decoder> decodeWith(const Decoder& decoder)
+    { return DecoderHandler<Decoder>(&decoder); }
+
+    ///
+    /// 出站时在消息前加上长度字段(大端，只算消息本身)，与
+    /// LengthFieldFrameDecoder(max, 0, n, 0, n)配对。
+    /// 长度字段和消息写进同一个池化Buffer，再整个交给前一级。
+    class LengthFieldPrepender
+    {
+    public:
+      /// lengthFieldLength只能是1/2/4/8
+      explicit LengthFieldPrepender(int lengthFieldLength);
+
+      template <typename Ctx>
+      void onWrite(Ctx& ctx, const FrameView& msg)
+      {
+        buffer::Buffer buf(static_cast<int>(lengthFieldLength_ + msg.size));
+        encode(msg.data, msg.size, &buf);
+        ctx.write(&buf);
+      }
+
+      template <typename Ctx>
+      void onWrite(Ctx& ctx, const std::string& msg)
+      {
+        onWrite(ctx, FrameView{ msg.data(), msg.size() });
+      }
+
+    private:
+      void encode(const char* data, size_t len, buffer::Buffer* buf) const;
+
+      int lengthFieldLength_;
+    };
+
+  } // namespace codec
+} // namespace mutty
+
+#endif  // MUTTY_CODEC_PIPELINE_H
@@ -42,7 +42,7 @@ namespace mutty {
       bool hasMore = true;
       while (hasMore) {
         if (state_ == kExpectRequestLine) {
-          const char* crlf = buf->findCRLF();
+          const char* crlf = buf->findCRLF(&scanned_);
           if (crlf) {
             ok = processRequestLine(buf->peek(), crlf);
             if (ok) {
@@ -58,7 +58,7 @@ namespace mutty {
           }
         }
         else if (state_ == kExpectHeaders) {
-          const char* crlf = buf->findCRLF();
+          const char* crlf = buf->findCRLF(&scanned_);
           if (crlf) {
             const char* colon = std::find(buf->peek(), crlf, ':');
             if (colon != crlf) {
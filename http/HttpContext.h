@@ -18,7 +18,8 @@ namespace mutty {
       };
 
       HttpContext()
-        : state_(kExpectRequestLine) {
+        : state_(kExpectRequestLine),
+          scanned_(0) {
       }
 
       // default copy-ctor, dtor and assignment are fine
@@ -30,6 +31,7 @@ namespace mutty {
 
       void reset() {
         state_ = kExpectRequestLine;
+        scanned_ = 0;
         HttpRequest dummy;
         request_.swap(dummy);
       }
@@ -42,6 +44,9 @@ namespace mutty {
       bool processRequestLine(const char* begin, const char* end);
 
       HttpRequestParseState state_;
+      // 半行数据已经扫过的长度，下次从这里接着找"\r\n"
+      // 用uint32_t放进state_后面的填充里，HttpContext要能内联存放在连接里
+      uint32_t scanned_;
       HttpRequest request_;
     };
   } // namespace http
@@ -27,6 +27,8 @@ namespace mutty {
 
       void setStatusCode(HttpStatusCode code) { statusCode_ = code; }
 
+      HttpStatusCode statusCode() const { return statusCode_; }
+
       void setStatusMessage(const std::string& message) { statusMessage_ = message; }
 
       void setCloseConnection(bool on) { closeConnection_ = on; }
@@ -40,6 +42,8 @@ namespace mutty {
 
       void setBody(const std::string& body) { body_ = body; }
 
+      size_t bodySize() const { return body_.size(); }
+
       void appendToBuffer(Buffer* output) const;
 
     private:
@@ -1,4 +1,5 @@
-#include <iostream>
+#include <sys/time.h>
+#include <time.h>
 
 #include "HttpServer.h"
 #include "HttpContext.h"
@@ -6,6 +7,8 @@
 #include "HttpResponse.h"
 #include "../EventLoop.h"
 #include "../InetAddress.h"
+#include "../base/AsyncLogging.h"
+#include "../base/Logging.h"
 
 using namespace std::placeholders;
 
@@ -17,13 +20,38 @@ namespace mutty {
       resp->setCloseConnection(true);
     }
 
+    namespace {
+      thread_local time_t t_accessSecond;
+      thread_local char t_accessTime[32];
+
+      // 127.0.0.1 - - [19/Oct/2026:10:49:01 +0800] "GET /hello HTTP/1.1" 200 14
+      void logAccess(AsyncLogging* accessLog, const TcpConnectionRef& conn,
+                     const HttpRequest& req, const HttpResponse& resp) {
+        time_t now = ::time(NULL);
+        if (now != t_accessSecond) {
+          t_accessSecond = now;
+          struct tm tm_time;
+          ::localtime_r(&now, &tm_time);
+          ::strftime(t_accessTime, sizeof t_accessTime, "%d/%b/%Y:%H:%M:%S %z", &tm_time);
+        }
+        LogStream line;
+        line << conn->peerAddress().toIp() << " - - [" << t_accessTime << "] \""
+             << req.methodString() << ' ' << req.path()
+             << (req.getVersion() == HttpRequest::kHttp10 ? " HTTP/1.0\" " : " HTTP/1.1\" ")
+             << static_cast<int>(resp.statusCode()) << ' ' << resp.bodySize() << '\n';
+        accessLog->append(line.data(), line.length());
+      }
+    }
+
 
     HttpServer::HttpServer(EventLoop* loop,
                           const InetAddress& listenAddr,
                           const string& name,
                           bool reusePort)
       : server_(loop, listenAddr, name, reusePort),
-        httpCallback_(defaultHttpCallback) {
+        httpCallback_(defaultHttpCallback),
+        accessLog_(nullptr),
+        requestTimeout_(0) {
       server_.setConnectionCallback(
           std::bind(&HttpServer::onConnection, this, _1));
       server_.setMessageCallback(
@@ -31,39 +59,57 @@ namespace mutty {
     }
 
     void HttpServer::start() {
-      std::cout << "HttpServer[" << server_.name()
-        << "] starts listening on " << server_.ipPort() << std::endl;
+      LOG_INFO << "HttpServer[" << server_.name()
+        << "] starts listening on " << server_.ipPort();
       server_.start();
     }
 
     void HttpServer::onConnection(const TcpConnectionPtr& conn) {
       if (conn->connected())
       {
-        conn->setContext(HttpContext());
+        // 每个连接都有一个，必须内联存放，不能变成一次堆分配
+        static_assert(ConnectionContext::fitsInline<HttpContext>(),
+                      "HttpContext must fit in MUTTY_CONTEXT_INLINE_SIZE");
+        conn->emplaceContext<HttpContext>();
+        if (requestTimeout_ > 0) {
+          conn->startRequestTimeout(requestTimeout_);
+        }
       }
     }
 
-    void HttpServer::onMessage(const TcpConnectionPtr& conn, Buffer* buf) {
-      HttpContext* context = any_cast<HttpContext>(conn->getMutableContext());
+    void HttpServer::onMessage(const TcpConnectionRef& conn, Buffer* buf) {
+      HttpContext* context = conn->context<HttpContext>();
 
-      if (!context->parseRequest(buf)) {
-        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-        conn->shutdown();
-      }
+      // 一次读到的多个pipelined请求都在这里处理，batched模式下应答合并成一次写
+      while (conn->connected()) {
+        if (!context->parseRequest(buf)) {
+          conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+          conn->shutdown();
+          break;
+        }
 
-      if (context->gotAll()) {
+        if (!context->gotAll()) {
+          break;
+        }
         onRequest(conn, context->request());
         context->reset();
+        // 下一个请求重新计时
+        if (requestTimeout_ > 0) {
+          conn->startRequestTimeout(requestTimeout_);
+        }
       }
     }
 
-    void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req) {
+    void HttpServer::onRequest(const TcpConnectionRef& conn, const HttpRequest& req) {
       const string& connection = req.getHeader("Connection");
       bool close = connection == "close" ||
         (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
       HttpResponse response(close);
       httpCallback_(req, &response);
-      Buffer buf(16384);
+      if (accessLog_) {
+        logAccess(accessLog_, conn, req, response);
+      }
+      Buffer buf(16384, conn->allocator());
       response.appendToBuffer(&buf);
       conn->send(&buf);
       if (response.closeConnection()) {
@@ -3,12 +3,13 @@
 
 #include "../TcpServer.h"
 #include "../base/noncopyable.h"
-#include "../base/any.h"
 
 using namespace buffer;
 using namespace base;
 
 namespace mutty {
+  class AsyncLogging;
+
   namespace http{
     class HttpRequest;
     class HttpResponse;
@@ -36,16 +37,45 @@ namespace mutty {
         server_.setIoLoopNum(numThreads);
       }
 
+      /// Pipelined requests on one connection are answered with one write.
+      void setBatchedFlush(bool on)
+      {
+        server_.setBatchedFlush(on);
+      }
+
+      /// Close connections whose next request is not complete within seconds
+      /// of connecting or of the previous request, which also bounds idle
+      /// keep-alive. 0 disables (default).
+      void setRequestTimeout(int seconds)
+      {
+        requestTimeout_ = seconds;
+      }
+
+      /// Close connections that make no write progress for seconds.
+      void setWriteTimeout(int seconds)
+      {
+        server_.setWriteTimeout(seconds);
+      }
+
+      /// Access log in common log format, one line per request.
+      /// The sink is not owned and must outlive the server. nullptr disables it.
+      void setAccessLog(AsyncLogging* accessLog)
+      {
+        accessLog_ = accessLog;
+      }
+
       void start();
 
     private:
       void onConnection(const TcpConnectionPtr& conn);
-      void onMessage(const TcpConnectionPtr& conn,
+      void onMessage(const TcpConnectionRef& conn,
                     Buffer* buf);
-      void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+      void onRequest(const TcpConnectionRef&, const HttpRequest&);
 
       TcpServer server_;
       HttpCallback httpCallback_;
+      AsyncLogging* accessLog_;
+      int requestTimeout_;
     };
   } // namespace http
 }  // namespace mutty
@@ -0,0 +1,148 @@
+// Buffer的retainedSlice/readRetainedSlice视图的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../buffer/Buffer.h"
+#include "../buffer/PooledByteBufAllocator.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+
+using namespace buffer;
+
+namespace
+{
+
+// 线程缓存不缓存任何规格、只有一个arena，内存一回池就计进deallocationsSmall。
+// 实例不能销毁，放在静态指针里
+PooledByteBufAllocator* newAllocator()
+{
+  return PooledByteBufAllocator::Builder()
+      .numArenas(1).smallCacheSize(0).normalCacheSize(0).build();
+}
+
+long arenaSmallFrees(PooledByteBufAllocator* alloc)
+{
+  return alloc->metric().arenas[0].deallocationsSmall;
+}
+
+// Buffer自己和各种视图(readRetainedSlice、retainedSlice、视图上再切、拷贝)都释放之后内存才回arena
+void testMemoryReturnsWithLastView()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  PooledSlicedByteBuf nested;
+  {
+    Buffer buf(Buffer::kInitialSize, alloc);
+    buf.writeBytes("hello world");
+    PooledSlicedByteBuf hello = buf.readRetainedSlice(5);
+    PooledSlicedByteBuf world = buf.retainedSlice(buf.peek() + 1, 5);
+    PooledSlicedByteBuf copy = world;
+    nested = hello.retainedSlice(1, 3);
+    PooledByteBuf* memory = hello.unwrap();
+    assert(memory == world.unwrap() && memory == nested.unwrap());
+    // Buffer、hello、world、copy、nested
+    assert(memory->refCnt() == 5);
+
+    // 移动不多占引用，被移走的那个析构时不再归还
+    PooledSlicedByteBuf moved = std::move(copy);
+    assert(!copy.valid());
+    assert(memory->refCnt() == 5);
+
+    buf.retrieveAll();
+    assert(buf.release());
+    assert(arenaSmallFrees(alloc) == 0);
+    assert(hello.toString() == "hello");
+    assert(world.toString() == "world");
+
+    hello.release();
+    assert(!hello.valid());
+    assert(memory->refCnt() == 3);
+    assert(arenaSmallFrees(alloc) == 0);
+  }
+  // world和moved析构了，只剩nested
+  assert(arenaSmallFrees(alloc) == 0);
+  assert(nested.unwrap()->refCnt() == 1);
+  assert(nested.toString() == "ell");
+  nested.release();
+  assert(arenaSmallFrees(alloc) == 1);
+}
+
+// 有视图时写入先换一块内存，只搬没读的部分；视图看到的还是原来的数据
+void testWriteWithLiveSliceUnshares()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  Buffer buf(Buffer::kInitialSize, alloc);
+  buf.writeBytes("abcdef");
+  const char* original = buf.begin();
+  PooledSlicedByteBuf abc = buf.readRetainedSlice(3);
+
+  buf.writeBytes("XYZ");
+  assert(buf.begin() != original);
+  assert(abc.data() >= original && abc.data() < original + Buffer::kInitialSize);
+  assert(abc.toString() == "abc");
+  assert(buf.readableBytes() == 6);
+  assert(std::string(buf.peek(), 6) == "defXYZ");
+  // 原来那块还被视图拿着
+  assert(abc.unwrap()->refCnt() == 1);
+  assert(arenaSmallFrees(alloc) == 0);
+  abc.release();
+  assert(arenaSmallFrees(alloc) == 1);
+
+  // 视图都释放了，再写不换内存
+  const char* current = buf.begin();
+  PooledSlicedByteBuf def = buf.readRetainedSlice(3);
+  def.release();
+  buf.writeBytes("123");
+  assert(buf.begin() == current);
+  assert(buf.retrieveAllAsString() == "XYZ123");
+  assert(arenaSmallFrees(alloc) == 1);
+}
+
+// readFd()写入前同样先换内存，TcpConnection::read()交出去的视图不会被下一次读覆盖
+void testReadFdWithLiveSlice()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  int fds[2];
+  int rc = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  assert(rc == 0);
+  (void)rc;
+
+  Buffer buf(Buffer::kInitialSize, alloc);
+  int savedErrno = 0;
+  const std::string first = "first message";
+  ssize_t n = ::write(fds[1], first.data(), first.size());
+  assert(n == static_cast<ssize_t>(first.size()));
+  n = buf.readFd(fds[0], &savedErrno);
+  assert(n == static_cast<ssize_t>(first.size()));
+  PooledSlicedByteBuf view = buf.readRetainedSlice(static_cast<int>(n));
+
+  const std::string second(first.size(), '#');
+  n = ::write(fds[1], second.data(), second.size());
+  assert(n == static_cast<ssize_t>(second.size()));
+  n = buf.readFd(fds[0], &savedErrno);
+  assert(n == static_cast<ssize_t>(second.size()));
+  assert(view.toString() == first);
+  assert(buf.retrieveAllAsString() == second);
+
+  view.release();
+  assert(arenaSmallFrees(alloc) == 1);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+}  // namespace
+
+int main()
+{
+  testMemoryReturnsWithLastView();
+  testWriteWithLiveSliceUnshares();
+  testReadFdWithLiveSlice();
+  printf("ok\n");
+}
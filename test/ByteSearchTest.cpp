@@ -0,0 +1,230 @@
+// ByteSearch各套实现和std::search/std::find结果一致的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../buffer/ByteSearch.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace buffer;
+
+namespace
+{
+
+// SIMD一块64字节，"\r\n"每块前进63、"\r\n\r\n"前进61，300字节里有好几个块边界
+const size_t kMaxLen = 300;
+
+const char kCRLF[] = "\r\n";
+const char kCRLFCRLF[] = "\r\n\r\n";
+
+std::vector<const ByteSearchKernels*> availableKernels()
+{
+  std::vector<const ByteSearchKernels*> kernels;
+  const char* names[] = { "scalar", "sse2", "avx2" };
+  for (const char* name : names)
+  {
+    const ByteSearchKernels* k = byteSearchKernels(name);
+    if (k != NULL)
+      kernels.push_back(k);
+  }
+  assert(!kernels.empty());
+  return kernels;
+}
+
+const char* expectSearch(const char* begin, const char* end, const char* needle, size_t n)
+{
+  const char* hit = std::search(begin, end, needle, needle + n);
+  return hit == end ? NULL : hit;
+}
+
+const char* expectFind(const char* begin, const char* end, char c)
+{
+  const char* hit = std::find(begin, end, c);
+  return hit == end ? NULL : hit;
+}
+
+const char* expectFindAnyOf(const char* begin, const char* end, const std::string& set)
+{
+  const char* hit = std::find_first_of(begin, end, set.begin(), set.end());
+  return hit == end ? NULL : hit;
+}
+
+enum Entry
+{
+  kFindCRLF = 1,
+  kFindByte = 2,
+  kFindAnyOf = 4,
+  kAllEntries = 7,
+};
+
+// 每套实现的entries几个入口都和参考实现比一遍，findCRLF包括findCRLFCRLF。
+// 数据放在正好len字节的堆内存里，ASan下读过界会报错
+void check(const std::vector<const ByteSearchKernels*>& kernels, const std::string& data,
+           int entries = kAllEntries)
+{
+  std::unique_ptr<char[]> owned(new char[data.size()]);
+  char* begin = owned.get();
+  ::memcpy(begin, data.data(), data.size());
+  const char* end = begin + data.size();
+
+  const std::string sets[] = {
+    "\r\n",
+    "; ",
+    "0123456789abcdef",    // 16个，SIMD能处理的最多
+    "0123456789abcdef;",   // 17个，查表
+  };
+
+  if (entries & kFindCRLF)
+  {
+    const char* crlf = expectSearch(begin, end, kCRLF, 2);
+    const char* crlfcrlf = expectSearch(begin, end, kCRLFCRLF, 4);
+    for (const ByteSearchKernels* k : kernels)
+    {
+      // 和内联入口一样，长度不够时不调用
+      if (data.size() >= 2)
+        assert(k->findCRLF(begin, end) == crlf);
+      if (data.size() >= 4)
+        assert(k->findCRLFCRLF(begin, end) == crlfcrlf);
+    }
+    assert(findCRLF(begin, end) == crlf);
+    assert(findCRLFCRLF(begin, end) == crlfcrlf);
+  }
+  if (entries & kFindByte)
+  {
+    const char* lf = expectFind(begin, end, '\n');
+    const char* semi = expectFind(begin, end, ';');
+    for (const ByteSearchKernels* k : kernels)
+    {
+      if (!data.empty())
+      {
+        assert(k->findByte(begin, end, '\n') == lf);
+        assert(k->findByte(begin, end, ';') == semi);
+      }
+    }
+    assert(findByte(begin, end, '\n') == lf);
+  }
+  if (entries & kFindAnyOf)
+  {
+    for (const std::string& set : sets)
+    {
+      const char* want = expectFindAnyOf(begin, end, set);
+      for (const ByteSearchKernels* k : kernels)
+      {
+        if (!data.empty())
+          assert(k->findAnyOf(begin, end, set.data(), set.size()) == want);
+      }
+      assert(findAnyOf(begin, end, set.data(), set.size()) == want);
+    }
+  }
+}
+
+// 每个长度、每个位置放一个完整的或只有前半截的模式，块边界上的都覆盖到
+void testEveryPosition()
+{
+  std::vector<const ByteSearchKernels*> kernels = availableKernels();
+  struct Pattern
+  {
+    const char* bytes;
+    int entries;
+  };
+  const Pattern patterns[] = {
+    { "\r\n", kFindCRLF | kFindAnyOf },
+    { "\r\n\r\n", kFindCRLF },
+    { "\r", kFindCRLF },         // 差一个字节才匹配
+    { "\r\n\r", kFindCRLF },
+    { "\n\r\n", kFindCRLF },
+    { ";", kFindByte | kFindAnyOf },
+    { "f", kFindAnyOf },
+  };
+  for (size_t len = 0; len <= kMaxLen; ++len)
+  {
+    const std::string filler(len, 'x');
+    check(kernels, filler);
+    for (const Pattern& pattern : patterns)
+    {
+      size_t n = ::strlen(pattern.bytes);
+      for (size_t pos = 0; pos + n <= len; ++pos)
+      {
+        std::string data = filler;
+        data.replace(pos, n, pattern.bytes);
+        check(kernels, data, pattern.entries);
+      }
+      // 截在末尾，只有前几个字节
+      for (size_t cut = 1; cut < n && cut <= len; ++cut)
+      {
+        std::string data = filler;
+        data.replace(len - cut, cut, pattern.bytes, cut);
+        check(kernels, data, pattern.entries);
+      }
+    }
+  }
+}
+
+// 故意卡在块边界上：'\r'是一块的最后一个有效位，'\n'在下一块
+void testBlockEdges()
+{
+  std::vector<const ByteSearchKernels*> kernels = availableKernels();
+  const size_t strides[] = { 61, 63, 64 };
+  for (size_t stride : strides)
+  {
+    for (size_t block = 1; block * stride + 4 <= kMaxLen; ++block)
+    {
+      size_t edge = block * stride;
+      for (size_t pos = edge - 4; pos <= edge + 1; ++pos)
+      {
+        std::string data(kMaxLen, 'x');
+        // 前面放个差一点的，要跳过它
+        data.replace(pos - 3, 3, "\r\n\r");
+        data.replace(pos, 4, kCRLFCRLF);
+        check(kernels, data, kFindCRLF);
+        data.resize(pos + 3);
+        check(kernels, data, kFindCRLF);
+      }
+    }
+  }
+}
+
+// 随机数据里'\r'/'\n'很密，互相干扰
+void testRandomDense()
+{
+  std::vector<const ByteSearchKernels*> kernels = availableKernels();
+  std::mt19937 rng(43);
+  const char alphabet[] = "\r\n\r\n\r\nx;f ";
+  for (size_t len = 0; len <= kMaxLen; ++len)
+  {
+    for (int round = 0; round < 20; ++round)
+    {
+      std::string data(len, '\0');
+      for (size_t i = 0; i < len; ++i)
+        data[i] = alphabet[rng() % (sizeof alphabet - 1)];
+      // 前面大段没有'\r'，匹配落在后面的块里
+      size_t quiet = len > 0 ? rng() % len : 0;
+      for (size_t i = 0; i < quiet; ++i)
+      {
+        if (data[i] == '\r')
+          data[i] = 'x';
+      }
+      check(kernels, data);
+    }
+  }
+}
+
+}  // namespace
+
+int main()
+{
+  testEveryPosition();
+  testBlockEdges();
+  testRandomDense();
+  printf("ok\n");
+}
@@ -0,0 +1,241 @@
+// CompositeBuffer跨段查找、合并、readFd/writeFd的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../buffer/Buffer.h"
+#include "../buffer/CompositeBuffer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace buffer;
+
+namespace
+{
+
+// 一段只读的视图，内存来自池里的一个Buffer
+PooledSlicedByteBuf view(const std::string& data)
+{
+  Buffer buf;
+  buf.writeBytes(data);
+  return buf.readRetainedSlice(static_cast<int>(data.size()));
+}
+
+std::string contents(const CompositeBuffer& buf)
+{
+  std::string result(buf.readableBytes(), '\0');
+  size_t n = buf.copyOut(0, &result[0], result.size());
+  assert(n == result.size());
+  return result;
+}
+
+// 视图和自己的段交替，把text随机切成很多段
+void fillSplit(CompositeBuffer* buf, const std::string& text, std::mt19937* rng)
+{
+  size_t pos = 0;
+  bool asView = false;
+  while (pos < text.size())
+  {
+    size_t n = std::min(text.size() - pos, static_cast<size_t>(1 + (*rng)() % 5));
+    if (asView)
+      buf->addComponent(view(text.substr(pos, n)));
+    else
+      buf->append(text.data() + pos, n);
+    asView = !asView;
+    pos += n;
+  }
+}
+
+// 跨段的find/findByte/findCRLF和std::string::find一致，只匹配到一半的不算
+void testFindAcrossSegments()
+{
+  const std::string text = "GET /index HTTP/1.1\r\nHost: a\r\n\r\nbody\r\nab\rabcab";
+  std::mt19937 rng(42);
+  for (int round = 0; round < 20; ++round)
+  {
+    CompositeBuffer buf(64);
+    fillSplit(&buf, text, &rng);
+    assert(buf.numComponents() > 10);
+    assert(contents(buf) == text);
+
+    const char* needles[] = { "\r\n", "\r\n\r\n", "HTTP/1.1", "ab\rab", "abcab", "cabX", "b\r", "\n\r\n" };
+    for (const char* needle : needles)
+    {
+      std::string n(needle);
+      for (size_t from = 0; from <= text.size(); ++from)
+      {
+        size_t want = text.find(n, from);
+        ssize_t got = buf.find(n.data(), n.size(), from);
+        assert(got == (want == std::string::npos ? -1 : static_cast<ssize_t>(want)));
+      }
+    }
+    for (size_t from = 0; from <= text.size(); ++from)
+    {
+      size_t want = text.find('\r', from);
+      assert(buf.findByte('\r', from) == (want == std::string::npos ? -1 : static_cast<ssize_t>(want)));
+      want = text.find("\r\n", from);
+      assert(buf.findCRLF(from) == (want == std::string::npos ? -1 : static_cast<ssize_t>(want)));
+    }
+  }
+}
+
+// consolidate(len)合并自己的段和挂进来的视图，len落在视图中间时剩下的部分留在原来的段里
+void testConsolidateSpansViewsAndSegments()
+{
+  CompositeBuffer buf;
+  buf.append("hello ");
+  buf.addComponent(view("wor"));
+  buf.addComponent(view("ld!"));
+  buf.append("tail");
+  assert(buf.numComponents() == 4);
+  assert(buf.contiguousBytes() == 6);
+
+  const char* p = buf.consolidate(10);
+  assert(p == buf.peek());
+  assert(buf.contiguousBytes() == 10);
+  assert(std::string(p, 10) == "hello worl");
+  assert(buf.readableBytes() == 16);
+  assert(contents(buf) == "hello world!tail");
+  // 合并出的一段加上"d!"和"tail"
+  assert(buf.numComponents() == 3);
+
+  // 已经连续时不拷贝
+  assert(buf.consolidate(4) == p);
+
+  p = buf.consolidate();
+  assert(buf.numComponents() == 1);
+  assert(std::string(p, buf.readableBytes()) == "hello world!tail");
+  buf.append("+");
+  assert(buf.retrieveAllAsString() == "hello world!tail+");
+}
+
+// 段数到maxComponents时，再加视图或追加都先把已有的数据合并成一段
+void testMaxComponentsConsolidates()
+{
+  const int kMax = 4;
+  CompositeBuffer buf(kMax);
+  std::string expected;
+  for (int i = 0; i < kMax; ++i)
+  {
+    std::string part(3, static_cast<char>('a' + i));
+    buf.addComponent(view(part));
+    expected += part;
+  }
+  assert(buf.numComponents() == kMax);
+
+  buf.addComponent(view("eee"));
+  expected += "eee";
+  assert(buf.numComponents() == 2);
+  assert(contents(buf) == expected);
+
+  CompositeBuffer appended(kMax);
+  expected.clear();
+  for (int i = 0; i < kMax; ++i)
+  {
+    std::string part(2, static_cast<char>('k' + i));
+    appended.addComponent(view(part));
+    expected += part;
+  }
+  appended.append("xyz");
+  expected += "xyz";
+  // 合并的那一段放得下这次追加的数据
+  assert(appended.numComponents() == 1);
+  assert(appended.retrieveAllAsString() == expected);
+}
+
+std::string pattern(size_t n, int seed)
+{
+  std::string data(n, '\0');
+  for (size_t i = 0; i < n; ++i)
+    data[i] = static_cast<char>((i * 7 + seed) % 251);
+  return data;
+}
+
+// 一次读到的比最后一段能放的多时，多出来的从栈上的extrabuf追加成新的段
+void testReadFdSpillsIntoExtrabuf()
+{
+  int fds[2];
+  int rc = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  assert(rc == 0);
+  (void)rc;
+  const std::string data = pattern(100000, 3);
+  ssize_t written = ::write(fds[1], data.data(), data.size());
+  assert(written == static_cast<ssize_t>(data.size()));
+
+  CompositeBuffer buf;
+  int savedErrno = 0;
+  ssize_t n = buf.readFd(fds[0], &savedErrno);
+  assert(n > CompositeBuffer::kInitialSegmentSize);
+  assert(buf.numComponents() >= 2);
+  assert(buf.readableBytes() == static_cast<size_t>(n));
+  while (buf.readableBytes() < data.size())
+  {
+    n = buf.readFd(fds[0], &savedErrno);
+    assert(n > 0);
+  }
+  assert(contents(buf) == data);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// writev一次最多64段，剩下的留到下次
+void testWriteFdMoreThan64Segments()
+{
+  int fds[2];
+  int rc = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  assert(rc == 0);
+  (void)rc;
+  const int kSegments = 100;
+  const size_t kSegmentSize = 10;
+  CompositeBuffer buf(kSegments + 1);
+  std::string expected;
+  for (int i = 0; i < kSegments; ++i)
+  {
+    std::string part = pattern(kSegmentSize, i);
+    buf.addComponent(view(part));
+    expected += part;
+  }
+  assert(buf.numComponents() == kSegments);
+
+  int savedErrno = 0;
+  ssize_t n = buf.writeFd(fds[1], &savedErrno);
+  assert(n == static_cast<ssize_t>(64 * kSegmentSize));
+  assert(buf.readableBytes() == (kSegments - 64) * kSegmentSize);
+  assert(buf.numComponents() == kSegments - 64);
+  n = buf.writeFd(fds[1], &savedErrno);
+  assert(n == static_cast<ssize_t>((kSegments - 64) * kSegmentSize));
+  assert(buf.readableBytes() == 0);
+  assert(buf.writeFd(fds[1], &savedErrno) == 0);
+
+  std::string received(expected.size(), '\0');
+  size_t got = 0;
+  while (got < received.size())
+  {
+    ssize_t r = ::read(fds[0], &received[got], received.size() - got);
+    assert(r > 0);
+    got += static_cast<size_t>(r);
+  }
+  assert(received == expected);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+}  // namespace
+
+int main()
+{
+  testFindAcrossSegments();
+  testConsolidateSpansViewsAndSegments();
+  testMaxComponentsConsolidates();
+  testReadFdSpillsIntoExtrabuf();
+  testWriteFdMoreThan64Segments();
+  printf("ok\n");
+}
@@ -0,0 +1,118 @@
+// ComputePool的功能和并发测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../ComputePool.h"
+#include "../EventLoop.h"
+#include "../EventLoopThread.h"
+#include "TestUtil.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace mutty;
+using testutil::CountDownLatch;
+
+namespace
+{
+
+// stop()之后再提交的都被拒绝，之前提交的都执行完
+void testRunAll()
+{
+  ComputePool pool(4, 64);
+  pool.start();
+  std::atomic<int> done(0);
+  int accepted = 0;
+  for (int i = 0; i < 10000; ++i)
+  {
+    if (pool.submit([&done] { done.fetch_add(1); }))
+      ++accepted;
+  }
+  pool.stop();
+  assert(done.load() == accepted);
+  assert(accepted + static_cast<int>(pool.rejected()) == 10000);
+  assert(!pool.submit([] {}));
+}
+
+// 结果在loop线程里交给回调，只能移动的类型也可以
+void testResultToLoop()
+{
+  EventLoopThread loopThread;
+  loopThread.run();
+  EventLoop* loop = loopThread.getLoop();
+  ComputePool pool(2);
+  pool.start();
+
+  CountDownLatch latch(2);
+  std::atomic<bool> inLoop(false);
+  bool ok = pool.submit(loop, [] { return std::unique_ptr<std::string>(new std::string("gz")); },
+                        [&](std::unique_ptr<std::string> s) {
+                          inLoop = loop->isInLoopThread() && *s == "gz";
+                          latch.countDown();
+                        });
+  assert(ok);
+  ok = pool.submit(loop, [] {}, [&] { latch.countDown(); });
+  assert(ok);
+  latch.wait();
+  assert(inLoop);
+  pool.stop();
+}
+
+// 队列满时kCallerRuns在提交的线程里执行
+void testCallerRuns()
+{
+  ComputePool pool(1, 2, ComputePool::kCallerRuns);
+  pool.start();
+  CountDownLatch blocked(1);
+  CountDownLatch release(1);
+  pool.submit([&] { blocked.countDown(); release.wait(); });
+  blocked.wait();
+  std::thread::id ranOn;
+  for (int i = 0; i < 4; ++i)
+    pool.submit([&ranOn] { ranOn = std::this_thread::get_id(); });
+  assert(ranOn == std::this_thread::get_id());
+  assert(pool.rejected() > 0);
+  release.countDown();
+  pool.stop();
+}
+
+// 和stop()同时提交：返回true的任务一定执行
+void testSubmitRacingStop()
+{
+  for (int round = 0; round < 200; ++round)
+  {
+    ComputePool pool(2, 16);
+    pool.start();
+    std::atomic<int> accepted(0);
+    std::atomic<int> done(0);
+    std::thread submitter([&] {
+      for (int i = 0; i < 2000; ++i)
+      {
+        if (pool.submit([&done] { done.fetch_add(1); }))
+          accepted.fetch_add(1);
+      }
+    });
+    std::this_thread::yield();
+    pool.stop();
+    submitter.join();
+    assert(done.load() == accepted.load());
+  }
+}
+
+}  // namespace
+
+int main()
+{
+  testRunAll();
+  testResultToLoop();
+  testCallerRuns();
+  testSubmitRacingStop();
+  printf("ok\n");
+}
@@ -0,0 +1,136 @@
+// ConnectionContext和ContextPool的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../ConnectionContext.h"
+#include "../EventLoop.h"
+#include "../EventLoopThread.h"
+#include "../InetAddress.h"
+#include "../TcpConnection.h"
+#include "../TcpServer.h"
+#include "TestUtil.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace mutty;
+using testutil::CountDownLatch;
+
+namespace
+{
+
+// 放不下内联存储，只能放堆上或者从池里取
+struct Session
+{
+  Session() : requests(0), resets(0) {}
+  void reset()
+  {
+    requests = 0;
+    ++resets;
+  }
+
+  char scratch[512];
+  int requests;
+  int resets;
+};
+
+static_assert(!ConnectionContext::fitsInline<Session>(), "Session must not fit inline");
+
+struct Counted
+{
+  explicit Counted(int* live) : live_(live) { ++*live_; }
+  ~Counted() { --*live_; }
+  int* live_;
+};
+
+// 小的对象构造在连接里，换成别的类型或reset()时析构
+void testEmplace()
+{
+  int live = 0;
+  {
+    ConnectionContext ctx;
+    assert(ctx.empty());
+    Counted* c = ctx.emplace<Counted>(&live);
+    assert(live == 1);
+    assert(ctx.get<Counted>() == c);
+    assert(!ctx.pooled());
+    ctx.emplace<Counted>(&live);
+    assert(live == 1);
+    ctx.reset();
+    assert(live == 0 && ctx.empty());
+    ctx.emplace<Counted>(&live);
+  }
+  assert(live == 0);
+}
+
+// 同一个loop上先后两个连接用的是池里同一个Session，第二次用之前reset()过
+void testPoolReusedAcrossConnections()
+{
+  EventLoopThread loopThread;
+  loopThread.run();
+  EventLoop* loop = loopThread.getLoop();
+  uint16_t port = testutil::freePort();
+
+  std::mutex mutex;
+  std::vector<Session*> sessions;
+  std::vector<int> resetsSeen;
+  std::unique_ptr<TcpServer> server;
+  testutil::runInLoopAndWait(loop, [&] {
+    server.reset(new TcpServer(loop, InetAddress(port, true), "ContextPoolTest"));
+    server->setConnectionCallback([&](const TcpConnectionPtr& conn) {
+      if (!conn->connected())
+        return;
+      Session* session = conn->acquireContext<Session>();
+      assert(conn->context<Session>() == session);
+      std::lock_guard<std::mutex> lock(mutex);
+      resetsSeen.push_back(session->resets);
+      assert(session->requests == 0);
+      ++session->requests;
+      sessions.push_back(session);
+    });
+    server->start();
+  });
+
+  size_t idle = 0;
+  auto poolIdle = [&] {
+    testutil::runInLoopAndWait(loop, [&] { idle = ContextPool<Session>::local()->idle(); });
+    return idle;
+  };
+  assert(poolIdle() == 0);
+
+  for (int i = 0; i < 2; ++i)
+  {
+    int fd = testutil::connectTo(port);
+    assert(fd >= 0);
+    assert(testutil::waitFor([&] {
+      std::lock_guard<std::mutex> lock(mutex);
+      return static_cast<int>(sessions.size()) == i + 1;
+    }));
+    ::close(fd);
+    // 连接销毁后Session回到这个loop的池里
+    assert(testutil::waitFor([&] { return poolIdle() == 1; }));
+  }
+
+  assert(sessions.size() == 2);
+  assert(sessions[0] == sessions[1]);
+  assert(resetsSeen[0] == 0);
+  assert(resetsSeen[1] == 1);
+
+  testutil::runInLoopAndWait(loop, [&] { server.reset(); });
+}
+
+}  // namespace
+
+int main()
+{
+  testEmplace();
+  testPoolReusedAcrossConnections();
+  printf("ok\n");
+}
@@ -0,0 +1,144 @@
+// Coroutine.h的测试，按C++20编译，用一个真实的连接跑read/readUntil/drain/sleep，
+// 用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../Coroutine.h"
+#include "../EventLoop.h"
+#include "../EventLoopThread.h"
+#include "../InetAddress.h"
+#include "../TcpConnection.h"
+#include "../TcpServer.h"
+#include "TestUtil.h"
+
+#ifndef MUTTY_HAS_COROUTINES
+#error "CoroutineTest must be built with -std=c++20"
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+using namespace mutty;
+using testutil::CountDownLatch;
+
+namespace
+{
+
+const size_t kReplySize = 4 * 1024 * 1024;  // 远大于socket发送缓冲，drain()要真的挂起
+
+// 在loop线程里写，latch之后主线程读
+struct Results
+{
+  std::string head;
+  std::string line1;
+  std::string line2;
+  std::string custom;
+  bool lineSurvivesNextRead = false;
+  bool allInLoop = true;
+  long sleptMs = 0;
+  bool drained = false;
+  bool emptyOnClose = false;
+};
+
+Task session(TcpConnectionPtr conn, Results* r, CountDownLatch* done)
+{
+  EventLoop* loop = conn->getLoop();
+
+  buffer::PooledSlicedByteBuf head = co_await conn->read(4);
+  r->allInLoop &= loop->isInLoopThread();
+  r->head = head.toString();
+
+  // 客户端先发"hello\r"，过一会儿才发"\n"：分隔符跨两次读入
+  buffer::PooledSlicedByteBuf line1 = co_await conn->readUntil("\r\n");
+  r->allInLoop &= loop->isInLoopThread();
+  r->line1 = line1.toString();
+
+  buffer::PooledSlicedByteBuf line2 = co_await conn->readUntil("\r\n");
+  r->line2 = line2.toString();
+  // 视图不拷贝，后面的读入也不会覆盖它
+  r->lineSurvivesNextRead = line1.toString() == r->line1;
+
+  buffer::PooledSlicedByteBuf custom = co_await conn->readUntil("||");
+  r->custom = custom.toString();
+
+  auto start = std::chrono::steady_clock::now();
+  co_await loop->sleep(std::chrono::milliseconds(50));
+  r->allInLoop &= loop->isInLoopThread();
+  r->sleptMs = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count());
+
+  conn->send(std::string(kReplySize, 'x'));
+  assert(conn->outputBuffer()->readableBytes() > 0);
+  co_await conn->drain();
+  r->allInLoop &= loop->isInLoopThread();
+  r->drained = conn->outputBuffer()->readableBytes() == 0;
+  conn->send("done");
+
+  // 客户端关闭后挂起的read恢复，返回空的视图
+  buffer::PooledSlicedByteBuf rest = co_await conn->read(1);
+  r->emptyOnClose = !rest.valid() && !conn->connected();
+  done->countDown();
+}
+
+void testSessionOverRealConnection()
+{
+  EventLoopThread loopThread;
+  loopThread.run();
+  EventLoop* loop = loopThread.getLoop();
+  uint16_t port = testutil::freePort();
+
+  Results results;
+  CountDownLatch done(1);
+  std::unique_ptr<TcpServer> server;
+  testutil::runInLoopAndWait(loop, [&] {
+    server.reset(new TcpServer(loop, InetAddress(port, true), "CoroutineTest"));
+    server->setMessageCallback(MessageCallback());
+    server->setConnectionCallback([&](const TcpConnectionPtr& conn) {
+      if (conn->connected())
+        session(conn, &results, &done);
+    });
+    server->start();
+  });
+
+  int fd = testutil::connectTo(port);
+  assert(fd >= 0);
+  testutil::writeAll(fd, "PINGhello\r");
+  usleep(20 * 1000);
+  testutil::writeAll(fd, "\nworld\r\n");
+  usleep(20 * 1000);
+  testutil::writeAll(fd, "a|b||");
+  // 先不读，让服务端的drain()挂起一会儿
+  usleep(100 * 1000);
+  std::string reply = testutil::readN(fd, kReplySize + 4);
+  assert(reply.size() == kReplySize + 4);
+  assert(reply.compare(kReplySize, 4, "done") == 0);
+  ::close(fd);
+  done.wait();
+
+  assert(results.head == "PING");
+  assert(results.line1 == "hello");
+  assert(results.line2 == "world");
+  assert(results.lineSurvivesNextRead);
+  assert(results.custom == "a|b");
+  assert(results.allInLoop);
+  assert(results.sleptMs >= 45);
+  assert(results.drained);
+  assert(results.emptyOnClose);
+
+  testutil::runInLoopAndWait(loop, [&] { server.reset(); });
+}
+
+}  // namespace
+
+int main()
+{
+  testSessionOverRealConnection();
+  printf("ok\n");
+}
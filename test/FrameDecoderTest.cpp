@@ -0,0 +1,318 @@
+// codec/下各分帧解码器的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../EventLoop.h"
+#include "../EventLoopThread.h"
+#include "../InetAddress.h"
+#include "../TcpConnection.h"
+#include "../TcpServer.h"
+#include "../codec/DelimiterFrameDecoder.h"
+#include "../codec/FixedLengthFrameDecoder.h"
+#include "../codec/LengthFieldFrameDecoder.h"
+#include "TestUtil.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace mutty;
+using namespace mutty::codec;
+
+namespace
+{
+
+// 返回used，frame/error写到出参里；出错时frame不动
+ssize_t decode(const FrameDecoder& decoder, const std::string& input,
+               std::string* frame, const char** error = NULL)
+{
+  FrameView view = { NULL, 0 };
+  const char* reason = NULL;
+  ssize_t used = decoder.decodeFrame(input.data(), input.size(), &view, &reason);
+  if (used > 0)
+    *frame = view.toString();
+  if (error != NULL)
+    *error = reason;
+  assert((used < 0) == (reason != NULL));
+  return used;
+}
+
+std::string encodeLength(uint64_t value, int width, LengthFieldFrameDecoder::ByteOrder order)
+{
+  std::string bytes(width, '\0');
+  for (int i = 0; i < width; ++i)
+  {
+    int shift = order == LengthFieldFrameDecoder::kBigEndian ? (width - 1 - i) * 8 : i * 8;
+    bytes[i] = static_cast<char>(value >> shift & 0xff);
+  }
+  return bytes;
+}
+
+// 1/2/4/8字节的长度字段、两种字节序，前面还有两个字节的magic
+void testLengthFieldWidthsAndOrders()
+{
+  const int widths[] = { 1, 2, 4, 8 };
+  const LengthFieldFrameDecoder::ByteOrder orders[] = {
+    LengthFieldFrameDecoder::kBigEndian, LengthFieldFrameDecoder::kLittleEndian };
+  const std::string body(200, 'b');  // 长度>127，1字节时也要按无符号读
+  for (int width : widths)
+  {
+    for (LengthFieldFrameDecoder::ByteOrder order : orders)
+    {
+      // | magic(2) | len | body |，len只算body，交出body
+      LengthFieldFrameDecoder decoder(1024, 2, width, 0, 2 + width, order);
+      std::string input = "MG" + encodeLength(body.size(), width, order) + body + "next";
+      size_t frameLength = 2 + width + body.size();
+      std::string frame;
+      // 长度字段不完整、帧不完整时都等更多数据
+      assert(decode(decoder, input.substr(0, 2 + width - 1), &frame) == 0);
+      assert(decode(decoder, input.substr(0, frameLength - 1), &frame) == 0);
+      assert(decode(decoder, input, &frame) == static_cast<ssize_t>(frameLength));
+      assert(frame == body);
+
+      // 同一个值按另一种字节序读出来不一样(1字节除外)
+      if (width > 1)
+      {
+        LengthFieldFrameDecoder other(1 << 20, 2, width, 0, 2 + width,
+            order == LengthFieldFrameDecoder::kBigEndian ? LengthFieldFrameDecoder::kLittleEndian
+                                                         : LengthFieldFrameDecoder::kBigEndian);
+        ssize_t used = decode(other, input, &frame);
+        assert(used != static_cast<ssize_t>(frameLength));
+      }
+    }
+  }
+}
+
+// 长度包括自己时用负的lengthAdjustment；initialBytesToStrip决定交出整帧还是只交body
+void testLengthAdjustmentAndStrip()
+{
+  const std::string body = "payload";
+  std::string input = encodeLength(2 + body.size(), 2, LengthFieldFrameDecoder::kBigEndian) + body;
+  std::string frame;
+
+  LengthFieldFrameDecoder whole(64, 0, 2, -2, 0);
+  assert(decode(whole, input, &frame) == static_cast<ssize_t>(input.size()));
+  assert(frame == input);
+
+  LengthFieldFrameDecoder stripped(64, 0, 2, -2, 2);
+  assert(decode(stripped, input, &frame) == static_cast<ssize_t>(input.size()));
+  assert(frame == body);
+
+  // | len(4) | flags(2) | body |，len只算body，flags靠正的lengthAdjustment带上
+  std::string withFlags = encodeLength(body.size(), 4, LengthFieldFrameDecoder::kBigEndian) + "FL" + body;
+  LengthFieldFrameDecoder flags(64, 0, 4, 2, 4);
+  assert(decode(flags, withFlags, &frame) == static_cast<ssize_t>(withFlags.size()));
+  assert(frame == "FL" + body);
+
+  // 长度比自己还短：帧长小于长度字段结束的位置
+  const char* error = NULL;
+  std::string tooShort = encodeLength(1, 2, LengthFieldFrameDecoder::kBigEndian) + body;
+  assert(decode(whole, tooShort, &frame, &error) == -1);
+  assert(std::string(error) == "frame length less than lengthFieldEnd");
+
+  // 要去掉的字节比整帧还多
+  LengthFieldFrameDecoder overStrip(64, 0, 1, 0, 8);
+  assert(decode(overStrip, std::string("\x02") + "ab", &frame, &error) == -1);
+  assert(std::string(error) == "frame length less than initialBytesToStrip");
+}
+
+// 超长的帧只看长度字段就出错，不等body到齐；正好maxFrameLength的可以
+void testLengthFieldOverLimit()
+{
+  LengthFieldFrameDecoder decoder(16, 0, 4, 0, 0);
+  std::string frame;
+  const char* error = NULL;
+
+  std::string atLimit = encodeLength(12, 4, LengthFieldFrameDecoder::kBigEndian) + std::string(12, 'x');
+  assert(decode(decoder, atLimit, &frame) == 16);
+
+  std::string overLimit = encodeLength(13, 4, LengthFieldFrameDecoder::kBigEndian);
+  assert(decode(decoder, overLimit, &frame, &error) == -1);
+  assert(std::string(error) == "frame length exceeds maxFrameLength");
+
+  // 8字节的最大值加上adjustment不能溢出成合法的长度
+  LengthFieldFrameDecoder wide(1 << 20, 0, 8, -8, 0);
+  std::string huge = encodeLength(UINT64_MAX, 8, LengthFieldFrameDecoder::kLittleEndian);
+  assert(decode(wide, huge, &frame, &error) == -1);
+  assert(std::string(error) == "frame length exceeds maxFrameLength");
+}
+
+// "\r\n"和"\n"都算行尾；行正好maxLength时"\r\n"要等齐，长一个字节就出错
+void testLineAtMaxLength()
+{
+  const size_t kMax = 8;
+  LineFrameDecoder decoder(kMax);
+  LineFrameDecoder keep(kMax, false);
+  const std::string line(kMax, 'L');
+  std::string frame;
+  const char* error = NULL;
+
+  assert(decode(decoder, line + "\r\n", &frame) == static_cast<ssize_t>(kMax + 2));
+  assert(frame == line);
+  assert(decode(keep, line + "\r\n", &frame) == static_cast<ssize_t>(kMax + 2));
+  assert(frame == line + "\r\n");
+  assert(decode(decoder, line + "\n", &frame) == static_cast<ssize_t>(kMax + 1));
+  assert(frame == line);
+  // 只到了'\r'：可能是合法的行尾，等下次
+  assert(decode(decoder, line + "\r", &frame) == 0);
+  assert(decode(decoder, line, &frame) == 0);
+
+  assert(decode(decoder, line + "X\n", &frame, &error) == -1);
+  assert(std::string(error) == "line length exceeds maxLength");
+  // 没有行尾但已经不可能不超长
+  assert(decode(decoder, line + "XY", &frame, &error) == -1);
+  assert(decode(decoder, line + "\rX", &frame, &error) == -1);
+
+  assert(decode(decoder, "\n", &frame) == 1 && frame.empty());
+  assert(decode(decoder, "\r\n", &frame) == 2 && frame.empty());
+}
+
+void testDelimiterAndFixedLength()
+{
+  DelimiterFrameDecoder decoder("||", 5);
+  DelimiterFrameDecoder keep("||", 5, false);
+  std::string frame;
+  const char* error = NULL;
+
+  assert(decode(decoder, "a|b||rest", &frame) == 5);
+  assert(frame == "a|b");
+  assert(decode(keep, "a|b||rest", &frame) == 5);
+  assert(frame == "a|b||");
+  assert(decode(decoder, "abcde||", &frame) == 7);
+  assert(frame == "abcde");
+  // 分隔符只到了一半
+  assert(decode(decoder, "abcde|", &frame) == 0);
+  assert(decode(decoder, "abcdef||", &frame, &error) == -1);
+  assert(std::string(error) == "frame length exceeds maxFrameLength");
+
+  FixedLengthFrameDecoder fixed(3);
+  assert(decode(fixed, "ab", &frame) == 0);
+  assert(decode(fixed, "abcd", &frame) == 3);
+  assert(frame == "abc");
+}
+
+// 一次读到的帧超过kMaxBatch时分几批回调，每批不超过kMaxBatch，顺序不变
+void testBatchesOverRealConnection()
+{
+  EventLoopThread loopThread;
+  loopThread.run();
+  EventLoop* loop = loopThread.getLoop();
+  uint16_t port = testutil::freePort();
+
+  const size_t kFrameSize = 8;
+  const size_t kFrames = 3 * FrameDecoder::kMaxBatch + 8;
+  FixedLengthFrameDecoder decoder(kFrameSize);
+  std::mutex mutex;
+  std::vector<size_t> batches;
+  std::string received;
+  decoder.setFrameCallback([&](const TcpConnectionRef&, const FrameView* frames, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex);
+    batches.push_back(n);
+    for (size_t i = 0; i < n; ++i)
+      received += frames[i].toString();
+  });
+
+  std::unique_ptr<TcpServer> server;
+  testutil::runInLoopAndWait(loop, [&] {
+    server.reset(new TcpServer(loop, InetAddress(port, true), "FrameDecoderTest"));
+    server->setMessageCallback(std::bind(&FrameDecoder::onMessage, &decoder,
+                                         std::placeholders::_1, std::placeholders::_2));
+    server->start();
+  });
+
+  std::string sent;
+  for (size_t i = 0; i < kFrames; ++i)
+  {
+    char frame[kFrameSize + 1];
+    snprintf(frame, sizeof frame, "%07zu;", i);
+    sent.append(frame, kFrameSize);
+  }
+  int fd = testutil::connectTo(port);
+  assert(fd >= 0);
+  // 一次write，回环上一次读就能全部读到
+  testutil::writeAll(fd, sent);
+  assert(testutil::waitFor([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    return received.size() == sent.size();
+  }));
+  ::close(fd);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(received == sent);
+    size_t largest = 0;
+    for (size_t n : batches)
+    {
+      assert(n > 0 && n <= FrameDecoder::kMaxBatch);
+      largest = std::max(largest, n);
+    }
+    assert(largest == FrameDecoder::kMaxBatch);
+    assert(batches.size() >= 4);
+  }
+
+  testutil::runInLoopAndWait(loop, [&] { server.reset(); });
+}
+
+// 出错前解出的帧照常交出去，之后默认forceClose
+void testErrorAfterFramesOverRealConnection()
+{
+  EventLoopThread loopThread;
+  loopThread.run();
+  EventLoop* loop = loopThread.getLoop();
+  uint16_t port = testutil::freePort();
+
+  LengthFieldFrameDecoder decoder(16, 0, 1, 0, 1);
+  std::mutex mutex;
+  std::vector<std::string> frames;
+  decoder.setFrameCallback([&](const TcpConnectionRef&, const FrameView* views, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < n; ++i)
+      frames.push_back(views[i].toString());
+  });
+
+  std::unique_ptr<TcpServer> server;
+  testutil::runInLoopAndWait(loop, [&] {
+    server.reset(new TcpServer(loop, InetAddress(port, true), "FrameDecoderErrorTest"));
+    server->setMessageCallback(std::bind(&FrameDecoder::onMessage, &decoder,
+                                         std::placeholders::_1, std::placeholders::_2));
+    server->start();
+  });
+
+  int fd = testutil::connectTo(port);
+  assert(fd >= 0);
+  testutil::writeAll(fd, std::string("\x03") + "abc" + "\x02" + "de" + "\x64" + "too long");
+  // 服务端关掉连接
+  testutil::readUntilClosed(fd);
+  ::close(fd);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(frames.size() == 2);
+    assert(frames[0] == "abc");
+    assert(frames[1] == "de");
+  }
+
+  testutil::runInLoopAndWait(loop, [&] { server.reset(); });
+}
+
+}  // namespace
+
+int main()
+{
+  testLengthFieldWidthsAndOrders();
+  testLengthAdjustmentAndStrip();
+  testLengthFieldOverLimit();
+  testLineAtMaxLength();
+  testDelimiterAndFixedLength();
+  testBatchesOverRealConnection();
+  testErrorAfterFramesOverRealConnection();
+  printf("ok\n");
+}
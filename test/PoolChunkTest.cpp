@@ -0,0 +1,190 @@
+// PageBitmap和PoolChunk空闲run合并的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../buffer/PageBitmap.h"
+#include "../buffer/PooledByteBufAllocator.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace buffer;
+
+namespace
+{
+
+// 两级位图：64位一个字，64个字一个summary字。4096是第二个summary字的开头
+const int kBits = 3 * 4096 + 100;
+
+// next()在字内、跨字、跨summary字的边界
+void testBitmapBoundaries()
+{
+  PageBitmap bitmap(kBits);
+  assert(bitmap.isEmpty());
+  assert(bitmap.first() == PageBitmap::NO_VALUE);
+
+  bitmap.set(64);
+  assert(bitmap.first() == 64);
+  assert(bitmap.next(63) == 64);
+  assert(bitmap.next(64) == 64);
+  assert(bitmap.next(65) == PageBitmap::NO_VALUE);
+
+  bitmap.set(63);
+  assert(bitmap.next(0) == 63);
+  assert(bitmap.next(63) == 63);
+  assert(bitmap.next(64) == 64);
+
+  // 跨summary字：4095是第一个summary字的最后一个字的最后一位
+  bitmap.set(4096);
+  assert(bitmap.next(65) == 4096);
+  assert(bitmap.next(4095) == 4096);
+  bitmap.set(4095);
+  assert(bitmap.next(65) == 4095);
+  assert(bitmap.next(4096) == 4096);
+  assert(bitmap.next(4097) == PageBitmap::NO_VALUE);
+
+  // 中间整个summary字为0，直接跳到第三个summary字里的最后一位
+  bitmap.set(kBits - 1);
+  assert(bitmap.next(4097) == kBits - 1);
+  assert(bitmap.next(kBits - 1) == kBits - 1);
+  assert(bitmap.next(kBits) == PageBitmap::NO_VALUE);
+
+  // 字清空后summary里对应的位也清掉，next()跳过它
+  bitmap.clear(4096);
+  assert(bitmap.next(4096) == kBits - 1);
+  bitmap.clear(4095);
+  assert(bitmap.next(65) == kBits - 1);
+  bitmap.clear(63);
+  bitmap.clear(64);
+  bitmap.clear(kBits - 1);
+  assert(bitmap.isEmpty());
+}
+
+// 随机set/clear，和std::set比较每个边界附近的next()
+void testBitmapAgainstSet()
+{
+  PageBitmap bitmap(kBits);
+  std::set<int> expected;
+  std::mt19937 rng(50);
+  std::vector<int> probes;
+  for (int b = 0; b <= kBits; b += 64)
+  {
+    probes.push_back(b > 0 ? b - 1 : 0);
+    probes.push_back(b);
+  }
+  for (int i = 0; i < 20000; ++i)
+  {
+    // 稀疏的位更容易让整字、整个summary字为0
+    int bit = (rng() % 2) ? static_cast<int>(rng() % kBits) : static_cast<int>(rng() % 64) * 193 % kBits;
+    if (expected.count(bit))
+    {
+      bitmap.clear(bit);
+      expected.erase(bit);
+    }
+    else
+    {
+      bitmap.set(bit);
+      expected.insert(bit);
+    }
+    if (i % 100 != 0)
+      continue;
+    for (int from : probes)
+    {
+      auto it = expected.lower_bound(from);
+      int want = it == expected.end() ? PageBitmap::NO_VALUE : *it;
+      assert(bitmap.next(from) == want);
+    }
+    assert(bitmap.isEmpty() == expected.empty());
+  }
+}
+
+// 不带线程缓存、只有一个arena的实例，释放直接回到chunk。实例不能销毁，放在静态指针里
+PooledByteBufAllocator* newAllocator()
+{
+  return PooledByteBufAllocator::Builder()
+      .numArenas(1).smallCacheSize(0).normalCacheSize(0).build();
+}
+
+int numChunks(PooledByteBufAllocator* alloc)
+{
+  return alloc->metric().arenas[0].numChunks();
+}
+
+// 填满一个chunk，释放相邻的run后能分出它们合起来的大小；不相邻的空闲run凑不出来
+void testNeighbourRunsMerge()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  const int kMiB = 1024 * 1024;
+  const int n = alloc->chunkSize() / kMiB;
+  std::vector<PooledByteBuf*> bufs;
+  for (int i = 0; i < n; ++i)
+    bufs.push_back(alloc->buffer(kMiB, kMiB));
+  assert(numChunks(alloc) == 1);
+
+  // 4和6先释放，再释放5时和前后两个run合并
+  bufs[4]->release();
+  bufs[6]->release();
+  bufs[5]->release();
+  PooledByteBuf* merged = alloc->buffer(3 * kMiB, 3 * kMiB);
+  assert(numChunks(alloc) == 1);
+
+  // 1和3之间隔着2，分不出2MiB，只能新建chunk
+  bufs[1]->release();
+  bufs[3]->release();
+  PooledByteBuf* apart = alloc->buffer(2 * kMiB, 2 * kMiB);
+  assert(numChunks(alloc) == 2);
+  apart->release();
+
+  merged->release();
+  for (int i = 0; i < n; ++i)
+  {
+    if (i != 1 && i != 3 && (i < 4 || i > 6))
+      bufs[i]->release();
+  }
+}
+
+// 工作集不超过半个chunk，随机大小反复分配释放，空闲run都能合并回去，始终只用一个chunk
+void testChurnStaysInOneChunk()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  const int page = alloc->pageSize();
+  const long kWorkingSet = alloc->chunkSize() / 4;
+  std::mt19937 rng(7);
+  std::vector<PooledByteBuf*> live;
+  long liveBytes = 0;
+  for (int i = 0; i < 20000; ++i)
+  {
+    int size = page * (1 + static_cast<int>(rng() % 64));
+    while (liveBytes + size > kWorkingSet)
+    {
+      size_t victim = rng() % live.size();
+      liveBytes -= live[victim]->capacity();
+      live[victim]->release();
+      live[victim] = live.back();
+      live.pop_back();
+    }
+    PooledByteBuf* buf = alloc->buffer(size, size);
+    liveBytes += buf->capacity();
+    live.push_back(buf);
+    assert(numChunks(alloc) == 1);
+  }
+  for (PooledByteBuf* buf : live)
+    buf->release();
+}
+
+}  // namespace
+
+int main()
+{
+  testBitmapBoundaries();
+  testBitmapAgainstSet();
+  testNeighbourRunsMerge();
+  testChurnStaysInOneChunk();
+  printf("ok\n");
+}
@@ -0,0 +1,158 @@
+// PooledByteBufAllocator::metric()和dumpStats()的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../buffer/PooledByteBufAllocator.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+using namespace buffer;
+
+namespace
+{
+
+// chunkLists里的顺序
+enum ChunkListIndex { kInit, k000, k025, k050, k075, k100 };
+
+// 线程缓存不缓存任何规格、只有一个arena，分配释放都经过arena，计数只受这个测试影响。
+// 实例不能销毁，放在静态指针里
+PooledByteBufAllocator* newAllocator()
+{
+  return PooledByteBufAllocator::Builder()
+      .numArenas(1).smallCacheSize(0).normalCacheSize(0).build();
+}
+
+PoolArenaMetric arenaMetric(PooledByteBufAllocator* alloc)
+{
+  PooledByteBufAllocatorMetric m = alloc->metric();
+  assert(m.arenas.size() == 1);
+  assert(m.arenas[0].chunkLists.size() == 6);
+  return m.arenas[0];
+}
+
+// 只有第list个链表里有一个chunk
+void assertOnlyIn(PooledByteBufAllocator* alloc, int list)
+{
+  PoolArenaMetric m = arenaMetric(alloc);
+  for (int i = kInit; i <= k100; ++i)
+    assert(m.chunkLists[i].numChunks == (i == list ? 1 : 0));
+  assert(m.numChunks() == 1);
+}
+
+// 一个chunk按使用率在qInit -> q000 -> q025 -> q050 -> q100之间移动，释放时往回移；
+// 各链表的usedBytes/freeBytes和chunk一致
+void testChunkListsFollowUsage()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  const int chunkSize = alloc->chunkSize();
+  const int eighth = chunkSize / 8;
+  assert(arenaMetric(alloc).numChunks() == 0);
+
+  PooledByteBuf* a = alloc->buffer(eighth, eighth);          // 12.5%
+  assertOnlyIn(alloc, kInit);
+  assert(arenaMetric(alloc).chunkLists[kInit].usedBytes == eighth);
+  assert(arenaMetric(alloc).chunkLists[kInit].freeBytes == chunkSize - eighth);
+
+  PooledByteBuf* b = alloc->buffer(2 * eighth, 2 * eighth);  // 37.5%
+  assertOnlyIn(alloc, k000);
+  PooledByteBuf* c = alloc->buffer(2 * eighth, 2 * eighth);  // 62.5%
+  assertOnlyIn(alloc, k025);
+  PooledByteBuf* d = alloc->buffer(2 * eighth, 2 * eighth);  // 87.5%
+  assertOnlyIn(alloc, k050);
+  PooledByteBuf* e = alloc->buffer(eighth, eighth);          // 100%
+  assertOnlyIn(alloc, k100);
+  assert(arenaMetric(alloc).chunkLists[k100].freeBytes == 0);
+  assert(alloc->metric().usedBytes() == chunkSize);
+
+  d->release();                                              // 75%
+  assertOnlyIn(alloc, k075);
+  c->release();                                              // 50%
+  assertOnlyIn(alloc, k050);
+  b->release();                                              // 25%
+  assertOnlyIn(alloc, k025);
+  e->release();                                              // 12.5%
+  assertOnlyIn(alloc, k000);
+  // q000里的chunk全部释放后销毁
+  a->release();
+  assert(arenaMetric(alloc).numChunks() == 0);
+
+  PoolArenaMetric m = arenaMetric(alloc);
+  assert(m.allocationsNormal == 5);
+  assert(m.deallocationsNormal == 5);
+  assert(m.allocationsSmall == 0 && m.allocationsHuge == 0);
+}
+
+// small/normal/huge的分配释放各自计数，small的subpage也列出来
+void testCountersBySizeClass()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  const int kSmall = 256;
+  const int kNormal = alloc->pageSize() * 4;
+  const int kHuge = alloc->chunkSize() + 1;
+
+  std::vector<PooledByteBuf*> small;
+  for (int i = 0; i < 10; ++i)
+    small.push_back(alloc->buffer(kSmall, kSmall));
+  std::vector<PooledByteBuf*> normal;
+  for (int i = 0; i < 3; ++i)
+    normal.push_back(alloc->buffer(kNormal, kNormal));
+  PooledByteBuf* huge = alloc->buffer(kHuge, kHuge);
+
+  PoolArenaMetric m = arenaMetric(alloc);
+  assert(m.allocationsSmall == 10);
+  assert(m.allocationsNormal == 3);
+  assert(m.allocationsHuge == 1);
+  assert(m.numAllocations() == 14);
+  assert(m.numDeallocations() == 0);
+  assert(m.activeBytesHuge >= kHuge);
+  // huge不进chunk链表
+  assert(m.numChunks() == 1);
+  assert(m.smallSubpages.size() == 1);
+  assert(m.smallSubpages[0].elemSize == kSmall);
+  assert(m.smallSubpages[0].numSubpages == 1);
+  assert(m.smallSubpages[0].numElements - m.smallSubpages[0].numAvailable == 10);
+
+  for (int i = 0; i < 4; ++i)
+    small[i]->release();
+  normal[0]->release();
+  huge->release();
+
+  m = arenaMetric(alloc);
+  assert(m.deallocationsSmall == 4);
+  assert(m.deallocationsNormal == 1);
+  assert(m.deallocationsHuge == 1);
+  assert(m.activeBytesHuge == 0);
+  assert(m.smallSubpages[0].numElements - m.smallSubpages[0].numAvailable == 6);
+
+  // dumpStats()是同一份快照的文本
+  std::string stats = alloc->dumpStats();
+  assert(stats.find("allocations small 10 normal 3 huge 1, deallocations small 4 normal 1 huge 1") != std::string::npos);
+  assert(stats.find("thread cache(s), 1 chunk(s)") != std::string::npos);
+  assert(stats.find("qInit [1%, 25%]: 1 chunk(s)") != std::string::npos);
+  assert(stats.find("subpage    256: 1 page(s)") != std::string::npos);
+
+  for (size_t i = 4; i < small.size(); ++i)
+    small[i]->release();
+  for (size_t i = 1; i < normal.size(); ++i)
+    normal[i]->release();
+  m = arenaMetric(alloc);
+  assert(m.numAllocations() == m.numDeallocations());
+  // 最后一个空的subpage留在池里不还给chunk
+  assert(m.smallSubpages[0].numAvailable == m.smallSubpages[0].numElements);
+  assert(m.usedBytes() == alloc->pageSize());
+}
+
+}  // namespace
+
+int main()
+{
+  testChunkListsFollowUsage();
+  testCountersBySizeClass();
+  printf("ok\n");
+}
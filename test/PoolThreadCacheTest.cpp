@@ -0,0 +1,173 @@
+// PoolThreadCache跨线程释放和线程退出的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../buffer/PooledByteBufAllocator.h"
+#include "TestUtil.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <thread>
+#include <vector>
+
+using namespace buffer;
+using testutil::CountDownLatch;
+
+namespace
+{
+
+const int kSmall = 256;  // small规格，能进线程缓存
+
+// 每个测试一个单arena的实例，arena的计数只受这个测试影响。
+// 实例不能销毁，和ALLOCATOR()一样放在静态指针里
+PooledByteBufAllocator* newAllocator()
+{
+  return PooledByteBufAllocator::Builder().numArenas(1).build();
+}
+
+long arenaSmallFrees(PooledByteBufAllocator* alloc)
+{
+  return alloc->metric().arenas[0].deallocationsSmall;
+}
+
+// arena里的small块都空着。线程退出时缓存的归还不计入deallocationsSmall，只能这样看
+bool arenaSmallAllFree(PooledByteBufAllocator* alloc)
+{
+  PoolArenaMetric m = alloc->metric().arenas[0];
+  for (const PoolSubpageMetric& subpage : m.smallSubpages)
+  {
+    if (subpage.numAvailable != subpage.numElements)
+      return false;
+  }
+  return true;
+}
+
+// 所属线程活着时别的线程释放的buf进归还队列，所属线程下次分配时收进自己的缓存并命中，不经过arena
+void testRemoteFreeLandsInOwnerCache()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  PooledByteBuf* buf = nullptr;
+  CountDownLatch allocated(1);
+  CountDownLatch released(1);
+  PoolThreadCacheMetric m;
+  long arenaFrees = -1;
+  std::thread owner([&] {
+    buf = alloc->buffer(kSmall);
+    allocated.countDown();
+    released.wait();
+    PooledByteBuf* again = alloc->buffer(kSmall);
+    m = alloc->currentThreadCache()->metric();
+    arenaFrees = arenaSmallFrees(alloc);
+    assert(!arenaSmallAllFree(alloc));
+    again->release();
+  });
+  allocated.wait();
+  assert(alloc->currentThreadCache() == nullptr);
+  buf->release();
+  assert(arenaSmallFrees(alloc) == 0);
+  released.countDown();
+  owner.join();
+
+  assert(m.remoteFrees == 1);
+  assert(m.smallHits == 1);
+  assert(arenaFrees == 0);
+  // 所属线程退出时缓存还给arena
+  assert(arenaSmallAllFree(alloc));
+}
+
+// 所属线程退出后再释放的buf直接还给arena
+void testFreeAfterOwnerExitGoesToArena()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  const int kBufs = 10;
+  std::vector<PooledByteBuf*> bufs;
+  std::thread owner([&] {
+    for (int i = 0; i < kBufs; ++i)
+      bufs.push_back(alloc->buffer(kSmall));
+  });
+  owner.join();
+  assert(alloc->metric().threadCaches.empty());
+  assert(arenaSmallFrees(alloc) == 0);
+
+  for (PooledByteBuf* buf : bufs)
+    buf->release();
+  assert(arenaSmallFrees(alloc) == kBufs);
+}
+
+// 所属线程不分配也不trim时，归还队列最多积压kMaxRemoteFrees个，其余的直接还给arena
+void testRemoteFreesOverflowToArena()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  const int kOverflow = 88;
+  const int kBufs = PoolThreadCache::kMaxRemoteFrees + kOverflow;
+  std::vector<PooledByteBuf*> bufs;
+  CountDownLatch allocated(1);
+  CountDownLatch released(1);
+  PoolThreadCacheMetric m;
+  std::thread owner([&] {
+    for (int i = 0; i < kBufs; ++i)
+      bufs.push_back(alloc->buffer(kSmall));
+    allocated.countDown();
+    released.wait();
+    alloc->currentThreadCache()->trim();
+    m = alloc->currentThreadCache()->metric();
+  });
+  allocated.wait();
+  for (PooledByteBuf* buf : bufs)
+    buf->release();
+  assert(arenaSmallFrees(alloc) == kOverflow);
+  released.countDown();
+  owner.join();
+
+  assert(m.remoteFrees == PoolThreadCache::kMaxRemoteFrees);
+}
+
+// 退出线程关闭的缓存给下一个线程重新打开，不另建；之前分配的buf照常还回这个缓存
+void testClosedCacheReused()
+{
+  static PooledByteBufAllocator* alloc = newAllocator();
+  PoolThreadCache* first = nullptr;
+  PooledByteBuf* buf = nullptr;
+  std::thread a([&] {
+    first = alloc->threadCache();
+    buf = alloc->buffer(kSmall);
+  });
+  a.join();
+
+  CountDownLatch opened(1);
+  CountDownLatch released(1);
+  PoolThreadCache* second = nullptr;
+  PoolThreadCacheMetric m;
+  std::thread b([&] {
+    second = alloc->threadCache();
+    assert(second->metric().remoteFrees == 0);
+    assert(second->metric().hits() == 0);
+    opened.countDown();
+    released.wait();
+    second->trim();
+    m = second->metric();
+  });
+  opened.wait();
+  assert(second == first);
+  assert(alloc->metric().threadCaches.size() == 1);
+  assert(alloc->metric().arenas[0].numThreadCaches == 1);
+  buf->release();
+  released.countDown();
+  b.join();
+
+  assert(m.remoteFrees == 1);
+}
+
+}  // namespace
+
+int main()
+{
+  testRemoteFreeLandsInOwnerCache();
+  testFreeAfterOwnerExitGoesToArena();
+  testRemoteFreesOverflowToArena();
+  testClosedCacheReused();
+  printf("ok\n");
+}
@@ -0,0 +1,166 @@
+// Recycler的功能和跨线程回收测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../buffer/Recycler.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace buffer;
+
+namespace
+{
+
+// 每个测试用不同的T，线程局部的Stack互不影响
+template<int N>
+struct Object
+{
+  Object() { ++live; }
+  ~Object() { --live; }
+
+  typename Recycler<Object>::Handle m_recyclerHandle;
+  static std::atomic<int> live;
+};
+
+template<int N>
+std::atomic<int> Object<N>::live(0);
+
+template<int N>
+class ObjectRecycler : public Recycler<Object<N> >
+{
+ public:
+  ObjectRecycler(int ratio, int delayedQueueRatio)
+    : Recycler<Object<N> >(Recycler<Object<N> >::DEFAULT_MAX_CAPACITY_PER_THREAD,
+                           Recycler<Object<N> >::DEFAULT_MAX_SHARED_CAPACITY_FACTOR,
+                           ratio, 0, delayedQueueRatio),
+      created(0)
+  {
+  }
+
+  Object<N>* newObject()
+  {
+    ++created;
+    return new Object<N>();
+  }
+
+  std::atomic<int> created;
+};
+
+const int kObjects = 16;
+
+template<int N>
+std::vector<Object<N>*> getAll(ObjectRecycler<N>& recycler)
+{
+  std::vector<Object<N>*> objects;
+  for (int i = 0; i < kObjects; ++i)
+    objects.push_back(recycler.get());
+  return objects;
+}
+
+template<int N>
+void recycleInThread(ObjectRecycler<N>& recycler, const std::vector<Object<N>*>& objects)
+{
+  std::thread thread([&recycler, &objects] {
+    for (Object<N>* object : objects)
+      recycler.recycle(object);
+  });
+  thread.join();
+}
+
+// 本线程回收的对象，下次get()取回来
+void testSameThread()
+{
+  ObjectRecycler<0> recycler(1, 1);
+  Object<0>* object = recycler.get();
+  assert(recycler.recycle(object));
+  assert(recycler.threadLocalSize() == 1);
+  assert(recycler.get() == object);
+  assert(recycler.created == 1);
+  recycler.recycle(object);
+}
+
+// 别的线程回收的对象，创建线程Stack空了时取回
+void testCrossThreadClaim()
+{
+  ObjectRecycler<1> recycler(1, 1);
+  std::vector<Object<1>*> objects = getAll(recycler);
+  recycleInThread(recycler, objects);
+
+  std::set<Object<1>*> expected(objects.begin(), objects.end());
+  std::vector<Object<1>*> claimed = getAll(recycler);
+  assert(std::set<Object<1>*>(claimed.begin(), claimed.end()) == expected);
+  assert(recycler.created == kObjects);
+  for (Object<1>* object : claimed)
+    recycler.recycle(object);
+}
+
+// 从没回收过的对象在别的线程回收时按delayedQueueRatio丢弃，第一个总是留下
+void testCrossThreadDropsNew()
+{
+  ObjectRecycler<2> recycler(1, 8);
+  std::vector<Object<2>*> objects = getAll(recycler);
+  recycleInThread(recycler, objects);
+
+  // 丢弃的对象已经delete，地址可能被新对象复用，按新建的个数检查
+  std::vector<Object<2>*> claimed = getAll(recycler);
+  assert(recycler.created == 2 * kObjects - kObjects / 8);
+  for (Object<2>* object : claimed)
+    recycler.recycle(object);
+}
+
+// 回收过的对象在别的线程再回收时不再按比例丢弃
+void testCrossThreadKeepsRecycled()
+{
+  ObjectRecycler<3> recycler(1, 8);
+  std::vector<Object<3>*> objects = getAll(recycler);
+  for (Object<3>* object : objects)
+    assert(recycler.recycle(object));
+  objects = getAll(recycler);
+  assert(recycler.created == kObjects);
+  recycleInThread(recycler, objects);
+
+  std::set<Object<3>*> expected(objects.begin(), objects.end());
+  std::vector<Object<3>*> claimed = getAll(recycler);
+  assert(std::set<Object<3>*>(claimed.begin(), claimed.end()) == expected);
+  assert(recycler.created == kObjects);
+  for (Object<3>* object : claimed)
+    recycler.recycle(object);
+}
+
+// 别的线程在所属线程活着时回收了好几个Link的对象，所属线程没取回就退出：
+// 对象和队列的每个Link都要释放(Link的泄漏由ASan构建的LeakSanitizer检查)
+void testOwnerExitsWithQueuedObjects()
+{
+  ObjectRecycler<4> recycler(1, 1);
+  const int kQueued = 100;
+  static_assert(kQueued > 4 * Recycler<Object<4> >::LINK_CAPACITY, "queue must span several links");
+  std::thread owner([&recycler, kQueued] {
+    std::vector<Object<4>*> objects;
+    for (int i = 0; i < kQueued; ++i)
+      objects.push_back(recycler.get());
+    recycleInThread(recycler, objects);
+    assert(Object<4>::live == kQueued);
+  });
+  owner.join();
+  assert(Object<4>::live == 0);
+}
+
+}  // namespace
+
+int main()
+{
+  testSameThread();
+  testCrossThreadClaim();
+  testCrossThreadDropsNew();
+  testCrossThreadKeepsRecycled();
+  testOwnerExitsWithQueuedObjects();
+  printf("ok\n");
+}
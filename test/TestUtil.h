@@ -0,0 +1,150 @@
+// test/下各测试共用的小工具：闩锁、在loop线程里同步执行、找空闲端口、阻塞的客户端socket
+
+#ifndef MUTTY_TEST_TESTUTIL_H
+#define MUTTY_TEST_TESTUTIL_H
+
+#include "../EventLoop.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace testutil
+{
+
+class CountDownLatch
+{
+ public:
+  explicit CountDownLatch(int count) : count_(count) {}
+
+  void countDown()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--count_ == 0)
+      cond_.notify_all();
+  }
+
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return count_ <= 0; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  int count_;
+};
+
+// 在loop线程里执行f，等它返回
+inline void runInLoopAndWait(mutty::EventLoop* loop, const std::function<void()>& f)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop([&] {
+    f();
+    latch.countDown();
+  });
+  latch.wait();
+}
+
+// 反复检查cond直到为真，超时返回false
+inline bool waitFor(const std::function<bool()>& cond, int timeoutMs = 5000)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (!cond())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// 让内核分配一个回环地址上的空闲端口
+inline uint16_t freePort()
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  int rc = ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+  assert(rc == 0);
+  socklen_t len = sizeof addr;
+  rc = ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+  assert(rc == 0);
+  (void)rc;
+  ::close(fd);
+  return ntohs(addr.sin_port);
+}
+
+// 阻塞地连上127.0.0.1:port，失败返回-1
+inline int connectTo(uint16_t port)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) != 0)
+  {
+    ::close(fd);
+    return -1;
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+  return fd;
+}
+
+inline void writeAll(int fd, const std::string& data)
+{
+  size_t written = 0;
+  while (written < data.size())
+  {
+    ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+    assert(n > 0);
+    written += static_cast<size_t>(n);
+  }
+}
+
+// 读满n个字节，对端关闭时返回已读到的
+inline std::string readN(int fd, size_t n)
+{
+  std::string result(n, '\0');
+  size_t got = 0;
+  while (got < n)
+  {
+    ssize_t r = ::read(fd, &result[got], n - got);
+    if (r <= 0)
+      break;
+    got += static_cast<size_t>(r);
+  }
+  result.resize(got);
+  return result;
+}
+
+// 读到对端关闭为止，返回读到的字节数
+inline size_t readUntilClosed(int fd)
+{
+  char buf[65536];
+  size_t total = 0;
+  ssize_t n;
+  while ((n = ::read(fd, buf, sizeof buf)) > 0)
+    total += static_cast<size_t>(n);
+  return total;
+}
+
+}  // namespace testutil
+
+#endif  // MUTTY_TEST_TESTUTIL_H
@@ -0,0 +1,214 @@
+// 写超时和请求超时的测试，用assert检查，全部通过时输出ok
+//
+//   cmake -S test -B build && cmake --build build && ctest --test-dir build
+
+#undef NDEBUG
+
+#include "../EventLoop.h"
+#include "../EventLoopThread.h"
+#include "../InetAddress.h"
+#include "../TcpConnection.h"
+#include "../TcpServer.h"
+#include "../TimeoutWheel.h"
+#include "../http/HttpRequest.h"
+#include "../http/HttpResponse.h"
+#include "../http/HttpServer.h"
+#include "TestUtil.h"
+
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace mutty;
+
+namespace
+{
+
+// deadline是TimeoutWheel::now()的整秒，时间轮每秒一个tick。
+// 对端在[begin, end]这段时间里最后一次有进展，超时应该在
+// [begin + timeout, end + timeout + 1]秒之间触发：不早于deadline，最多晚一个tick
+void assertFiredOnTime(int64_t closedAt, int64_t begin, int64_t end, int timeout)
+{
+  assert(closedAt >= begin + timeout);
+  assert(closedAt <= end + timeout + 1);
+}
+
+// 连上127.0.0.1:port，接收缓冲区先设小，对端写不了多少就会卡住
+int connectWithSmallRcvbuf(uint16_t port)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int rcvbuf = 4096;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  int rc = ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+  assert(rc == 0);
+  (void)rc;
+  return fd;
+}
+
+// 不阻塞地看一眼连接是不是已经被对端关了，读到的数据丢掉
+bool peerClosed(int fd)
+{
+  char buf[4096];
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  while (::poll(&pfd, 1, 0) > 0)
+  {
+    ssize_t n = ::recv(fd, buf, sizeof buf, MSG_DONTWAIT);
+    if (n <= 0)
+      return true;
+  }
+  return false;
+}
+
+// 对端一直不读时，outputBuffer_里的数据在writeTimeout内没有进展就forceClose；
+// 一直在读的对端即使整个发送超过writeTimeout也不会被关
+void testWriteStall()
+{
+  EventLoopThread loopThread;
+  loopThread.run();
+  EventLoop* loop = loopThread.getLoop();
+  uint16_t port = testutil::freePort();
+
+  const int kTimeout = 2;
+  // 比两边的socket缓冲区加起来大得多，卡住时outputBuffer_里一定有剩的
+  const size_t kPayload = 16 * 1024 * 1024;
+  const std::string payload(kPayload, 'w');
+  std::atomic<int> connected(0);
+  std::atomic<int> closed(0);
+  std::atomic<int64_t> closedAt(0);
+
+  std::unique_ptr<TcpServer> server;
+  testutil::runInLoopAndWait(loop, [&] {
+    server.reset(new TcpServer(loop, InetAddress(port, true), "WriteStallTest"));
+    server->setWriteTimeout(kTimeout);
+    server->setConnectionCallback([&](const TcpConnectionPtr& conn) {
+      if (conn->connected())
+      {
+        ++connected;
+        conn->send(payload);
+      }
+      else
+      {
+        closedAt = TimeoutWheel::now();
+        ++closed;
+      }
+    });
+    server->start();
+  });
+
+  // 先连不读的，再连慢慢读的，两个同时计时
+  int64_t stallBegin = TimeoutWheel::now();
+  int stalled = connectWithSmallRcvbuf(port);
+  int reader = testutil::connectTo(port);
+  assert(reader >= 0);
+  assert(testutil::waitFor([&] { return connected == 2; }));
+  // 给不读的那条一点时间把缓冲区写满，之后不会再有进展
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  int64_t stallEnd = TimeoutWheel::now();
+
+  // 每次读一截歇一会儿，整个过程比kTimeout长，但每段间隔远小于kTimeout - 1
+  const size_t kChunk = kPayload / 8;
+  size_t received = 0;
+  while (received < kPayload)
+  {
+    std::string got = testutil::readN(reader, kChunk);
+    assert(!got.empty());
+    received += got.size();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  }
+  assert(received == kPayload);
+
+  assert(testutil::waitFor([&] { return closed == 1; }, (kTimeout + 3) * 1000));
+  assertFiredOnTime(closedAt, stallBegin, stallEnd, kTimeout);
+  // 已经进了内核缓冲区的还会收到，然后是连接关闭，没收全
+  assert(testutil::readUntilClosed(stalled) < kPayload);
+  // 读完的那条还连着
+  assert(!peerClosed(reader));
+  ::close(reader);
+  ::close(stalled);
+  assert(testutil::waitFor([&] { return closed == 2; }));
+
+  testutil::runInLoopAndWait(loop, [&] { server.reset(); });
+}
+
+void onRequest(const http::HttpRequest&, http::HttpResponse* resp)
+{
+  resp->setStatusCode(http::HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setBody("ok");
+}
+
+// 请求一个字节一个字节地来也不推后deadline，requestTimeout内没收完整就关；
+// 收完一个请求之后重新计时
+void testRequestTimeoutIgnoresTrickle()
+{
+  EventLoopThread loopThread;
+  loopThread.run();
+  EventLoop* loop = loopThread.getLoop();
+  uint16_t port = testutil::freePort();
+
+  const int kTimeout = 2;
+  std::unique_ptr<http::HttpServer> server;
+  testutil::runInLoopAndWait(loop, [&] {
+    server.reset(new http::HttpServer(loop, InetAddress(port, true), "RequestTimeoutTest"));
+    server->setRequestTimeout(kTimeout);
+    server->setHttpCallback(onRequest);
+    server->start();
+  });
+
+  // 一个永远写不完的请求头，每200ms一个字节
+  int64_t connectBegin = TimeoutWheel::now();
+  int trickle = testutil::connectTo(port);
+  assert(trickle >= 0);
+  int64_t connectEnd = TimeoutWheel::now();
+  testutil::writeAll(trickle, "GET / HTTP/1.1\r\nHost: test\r\nX-Slow: ");
+  int64_t closedAt = 0;
+  for (int i = 0; i < (kTimeout + 3) * 5; ++i)
+  {
+    if (peerClosed(trickle))
+    {
+      closedAt = TimeoutWheel::now();
+      break;
+    }
+    ::send(trickle, "x", 1, MSG_NOSIGNAL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  assert(closedAt != 0);
+  // 检查间隔200ms，最多晚这么一点，算在下一秒里
+  assertFiredOnTime(closedAt, connectBegin, connectEnd, kTimeout);
+  ::close(trickle);
+
+  // 完整的请求得到应答，之后空闲的keep-alive连接从应答时起重新计时
+  int client = testutil::connectTo(port);
+  assert(client >= 0);
+  int64_t requestBegin = TimeoutWheel::now();
+  testutil::writeAll(client, "GET / HTTP/1.1\r\nHost: test\r\n\r\n");
+  char response[256];
+  ssize_t n = ::read(client, response, sizeof response);
+  assert(n > 0);
+  assert(std::string(response, n).find("200 OK") != std::string::npos);
+  int64_t requestEnd = TimeoutWheel::now();
+  testutil::readUntilClosed(client);
+  assertFiredOnTime(TimeoutWheel::now(), requestBegin, requestEnd, kTimeout);
+  ::close(client);
+
+  testutil::runInLoopAndWait(loop, [&] { server.reset(); });
+}
+
+}  // namespace
+
+int main()
+{
+  testWriteStall();
+  testRequestTimeoutIgnoresTrickle();
+  printf("ok\n");
+}
@@ -65,7 +65,9 @@ void Timer::addTimerTaskEntry(TimerTaskEntry* timerTaskEntry)
       TimerTask* timerTask = timerTaskEntry->getTimerTask();
       // m_threadPool->submit(timerTask->getFunc());
       m_threadPool->addTask(timerTask->getFunc());
+      // 回调已经拷进线程池，TimerTask只有这个entry引用着，一起释放
       delete timerTaskEntry;
+      delete timerTask;
     }
   }
 }
@@ -68,6 +68,7 @@ TimerTaskList& TimerTaskList::operator=(const TimerTaskList& timerTaskList)
   root = timerTaskList.root;
   m_setFlag = timerTaskList.m_setFlag;
   m_expiration = timerTaskList.m_expiration;
+  return *this;
 }
 
 void TimerTaskList::add(TimerTaskEntry* timerTaskEntry){
@@ -123,11 +124,11 @@ bool TimerTaskList::setExpiration(m_timeval expiration){
 }
 
 const m_timeval TimerTaskList::getExpiration(){
-    while(!m_setFlag->test_and_set()) {
-        m_timeval expiration = m_expiration;
-        m_setFlag->clear();
-        return expiration;
-    }
+    // 等到拿到标志为止，不能在没拿到时走到函数末尾
+    while(m_setFlag->test_and_set()) {}
+    m_timeval expiration = m_expiration;
+    m_setFlag->clear();
+    return expiration;
 }
 
 void TimerTask::setTimerTaskEntry(TimerTaskEntry* entry)
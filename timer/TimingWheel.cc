@@ -11,7 +11,8 @@ m_queue(queue),
 m_overflowWheel(nullptr)
 {
   m_interval = tickMs * wheelSize;
-  m_buckets.resize(wheelSize, TimerTaskList());
+  // 每个槽默认构造自己的链表；按原型复制的话，TimerTaskList的拷贝共享root和锁，所有槽成了同一个链表
+  m_buckets.resize(wheelSize);
   m_currentTime = startMs - (startMs % tickMs);
 }
 
@@ -46,8 +47,10 @@ bool TimingWheel::add(TimerTaskEntry* timerTaskEntry)
     TimerTaskList& bucket = m_buckets.at(virtualId % m_wheelSize);
     bucket.add(timerTaskEntry);
     // 判断bucket是否已经设置了过期时间，避免bucket被重复添加到queue中
-    if(bucket.setExpiration(m_tickMs * virtualId)) 
-      m_queue->offer(&bucket,expiration);
+    // 按槽的起始时间入队，用任务自己的到期时间会让同一槽里更早的任务跟着晚一整格
+    m_timeval bucketExpiration = m_tickMs * virtualId;
+    if(bucket.setExpiration(bucketExpiration))
+      m_queue->offer(&bucket,bucketExpiration);
     return true;
   } else{
   // 需要将任务放入下一个时间轮中，递归
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include "delay_queue/DelayQueue.h"
 #include "delay_queue/TimeEntry.h"
@@ -47,8 +47,8 @@ struct delay_queue_entry{
   m_timeval dqe_expiration;
   void* appendix;
   delay_queue_entry(void* appe, m_timeval expiration)
-  :appendix(appe),
-  dqe_expiration(expiration)
+  :dqe_expiration(expiration),
+  appendix(appe)
   {};
   
   inline bool operator>(const delay_queue_entry& rdqe) const{